@@ -24,6 +24,8 @@
 #define VERTEX_POS 0
 #define VERTEX_NORMAL 1
 #define VERTEX_COLOR 2
+// The number of floats in each element of the vertex buffer (sizeof(Vertex) / sizeof(float))
+#define VERTEX_FLOATS 10
 
 // Uniform buffer object indexes
 #define UBO_SCENE 0
@@ -36,6 +38,17 @@
 #define IMG_COLOR 6
 #define IMG_WEIGHTED_COLOR 7
 #define IMG_WEIGHTED_REVEAL 8
+#define IMG_TILE_MASK 9
+#define IMG_TILE_LIST 10
+#define IMG_MATERIALS 11
+#define IMG_AUXOPACITY 12
+#define IMG_SCENE_VERTICES 13
+#define IMG_TRANSFORMED 14
+#define IMG_OBJECT_BOUNDS 15
+#define IMG_DRAW_COMMANDS 16
+#define IMG_SCENE_DEPTH 17
+#define IMG_HIZ 18
+#define IMG_OPAQUE_DEPTH 19
 
 // Although these are formally enums, we use #defines here to make them
 // compatible with GLSL.
@@ -63,9 +76,83 @@
 #define AA_SSAA_8X 5
 #define NUM_AATYPES 6
 
-// Affects several techniques, does a coarse depth-test to avoid
-// longer-lasting actions (helps when many layers are used)
-#define USE_EARLYDEPTH 1
+// How colors are stored in the A-buffer's 32-bit color slots. The sRGB
+// encodings match the sRGB color buffer most closely; the others trade
+// precision for cheaper decoding in composite passes.
+#define COLOR_ENCODING_SRGB 0      // Unpremultiplied sRGB RGBA8, decoded with pow()
+#define COLOR_ENCODING_SRGB_LUT 1  // Unpremultiplied sRGB RGBA8, decoded with a lookup table
+#define COLOR_ENCODING_GAMMA2 2    // Unpremultiplied RGBA8 with a gamma of 2, decoded by squaring
+#define COLOR_ENCODING_RGB10A2 3   // Unpremultiplied linear RGB10A2
+#define NUM_COLOR_ENCODINGS 4
+
+// How the fixed-layer algorithms arrange each pixel's layers in the A-buffer;
+// see oitABuffer.glsl. Which layout is fastest depends on the algorithm's
+// access pattern and the GPU's caches.
+#define ABUFFER_LAYOUT_LAYER_MAJOR 0  // Layer 0 of every pixel, then layer 1, and so on
+#define ABUFFER_LAYOUT_INTERLEAVED 1  // All layers of pixel 0, then all layers of pixel 1, and so on
+#define ABUFFER_LAYOUT_TILED 2        // Layer-major within ABUFFER_TILE_SIZE^2 blocks of pixels in Morton order
+#define NUM_ABUFFER_LAYOUTS 3
+#define ABUFFER_TILE_SIZE 8
+
+// Specialization constant IDs; see the declarations below.
+#define SPEC_OIT_LAYERS 0
+#define SPEC_OIT_TAILBLEND 1
+#define SPEC_USE_EARLYDEPTH 2
+#define SPEC_OIT_EPOCH_TAGS 3
+#define SPEC_OIT_TILED_COMPOSITE 4
+#define SPEC_OIT_DEFERRED_SHADING 5
+#define SPEC_OIT_OPACITY_EARLY_OUT 6
+#define SPEC_OIT_OPACITY_CULLING 7
+#define SPEC_OIT_COLOR_ENCODING 8
+#define SPEC_OIT_ABUFFER_LAYOUT 9
+
+// Epoch tagging (see State::epochTags). Auxiliary values (counters, list
+// heads, and furthest depths) store the epoch of the pass that wrote them in
+// their top 8 bits, and values from other epochs are treated as cleared.
+// Epoch 0 is never used by a pass, so cleared images have epoch 0.
+#define EPOCH_SHIFT 24
+#define EPOCH_MAX 255
+#define EPOCH_VALUE_MASK 0x00FFFFFFu
+
+// Tiled composite (see State::tiledComposite). Color passes mark the
+// TILE_SIZE x TILE_SIZE tiles they touch in a bitmask, and
+// oitTileClassify.comp.glsl compacts the marked tiles into a list, using
+// workgroups of TILE_CLASSIFY_WORKGROUP_SIZE tiles.
+#define TILE_SIZE 16
+#define TILE_CLASSIFY_WORKGROUP_SIZE 64
+
+// Vertex pre-transform (see State::preTransform). preTransform.comp.glsl
+// transforms PRE_TRANSFORM_WORKGROUP_SIZE vertices per workgroup.
+#define PRE_TRANSFORM_WORKGROUP_SIZE 64
+
+// Frustum culling (see State::frustumCulling). objectCull.comp.glsl culls
+// CULL_WORKGROUP_SIZE objects per workgroup, and writes the draw commands of
+// the visible ones after a header of DRAW_COMMANDS_HEADER_UINTS uints.
+#define CULL_WORKGROUP_SIZE 64
+#define DRAW_COMMANDS_HEADER_UINTS 4
+// With State::usesLod, each sphere also has up to MAX_LODS - 1 coarser
+// levels of detail, and objectCull.comp.glsl picks one per object.
+#define MAX_LODS 4
+
+// objectCull.comp.glsl passes. CULL_PASS_ALL culls every object against the
+// frustum. With occlusion culling (see State::occlusionCulling),
+// CULL_PASS_OPAQUE only handles the opaque objects, and CULL_PASS_OCCLUSION
+// handles the transparent objects after the opaque draw, also testing them
+// against the Hi-Z pyramid.
+#define CULL_PASS_ALL 0
+#define CULL_PASS_OPAQUE 1
+#define CULL_PASS_OCCLUSION 2
+
+// Hi-Z pyramid. hiZBuild.comp.glsl builds each level in
+// HIZ_WORKGROUP_SIZE x HIZ_WORKGROUP_SIZE workgroups.
+#define HIZ_WORKGROUP_SIZE 8
+
+// Sphere impostors (see State::sphereImpostors). Each object is drawn as
+// IMPOSTOR_VERTICES vertices: a quad for the front surface and a quad for the
+// back surface. opaqueDepthCopy.comp.glsl copies the opaque depth buffer in
+// OPAQUE_DEPTH_WORKGROUP_SIZE x OPAQUE_DEPTH_WORKGROUP_SIZE workgroups.
+#define IMPOSTOR_VERTICES 8
+#define OPAQUE_DEPTH_WORKGROUP_SIZE 8
 
 // SceneData Uniform Buffer Object
 #ifdef __cplusplus
@@ -80,14 +167,55 @@ struct SceneData
   mat4 viewMatrix;
   mat4 viewMatrixInverseTranspose;
 
-  ivec3 viewport;  // (width, height, width*height)
+  ivec3 viewport;               // (width, height, width*height) of one band
   // For SIMPLE, INTERLOCK, SPINLOCK, LOOP, and LOOP64, the number of OIT layers;
   // for LINKEDLIST, the total number of elements in the A-buffer.
   uint linkedListAllocatedPerElement;
 
   float alphaMin;
   float alphaWidth;
-  vec2  _pad1;
+  uvec2 aBufferAddress;         // With OIT_ABUFFER_BDA, the A-buffer's address (low, high)
+  ivec2 colorSize;              // The size of m_colorImage
+  ivec2 tiles;                  // TILE_SIZE x TILE_SIZE tiles per row and column of a band
+  uint  verticesPerObject;      // Finds the object (and material) of a vertex
+  float opacityThreshold;       // See OIT_OPACITY_EARLY_OUT and OIT_OPACITY_CULLING
+  uint  indicesPerObject;       // Indices per object at level of detail 0
+  uint  transparentObjects;     // Where objectCull.comp.glsl splits the draw commands
+  uvec4 lodFirstIndex;          // Where each level of detail's indices start
+  uvec4 lodIndexCount;          // Indices per object at each level of detail
+  vec4  lodMinRadius;           // Smallest angular radius of each level; see sphereLod
+  uint  vertexOffsetPerObject;  // Object i's draws use vertexOffset i * this
+};
+
+// Push constants, set per band when rendering in bands.
+struct PushConstants
+{
+  int  bandOffsetY;  // The first row of m_colorImage covered by the current band.
+  uint epoch;        // The epoch of the current band, if OIT_EPOCH_TAGS is true.
+  uint hiZLevel;     // The Hi-Z level hiZBuild.comp.glsl writes.
+};
+
+// A vertex of the vertex buffer with State::usesCompressedVertices (8 bytes
+// instead of sizeof(Vertex) = 40); see sceneVertex.glsl. The position is
+// relative to the object's bounding sphere, with each component in
+// [-1, 1] stored as a 16-bit snorm. The normal is octahedral-encoded as two
+// 8-bit snorms. The color comes from the object's material instead.
+struct CompressedVertex
+{
+  uint positionXY;       // position.x in bits 0-15, position.y in bits 16-31
+  uint positionZNormal;  // position.z in bits 0-15, then the normal's two components in bits 16-23 and 24-31
+};
+
+// A vertex after preTransform.comp.glsl has run object.vert.glsl's work on
+// it; preTransformed.vert.glsl passes these on to the rasterizer.
+struct TransformedVertex
+{
+  vec4  position;  // Clip-space position
+  vec3  pos;       // World-space vertex position
+  float depth;     // Z coordinate after applying the view matrix
+  vec3  normal;    // World-space vertex normal
+  uint  objectID;  // Index of the object the vertex belongs to
+  vec4  color;     // Linear-space color
 };
 
 // GLSL-only code
@@ -99,15 +227,53 @@ layout(std140, binding = UBO_SCENE) uniform sceneBuffer
   SceneData scene;
 };
 
-#ifndef OIT_LAYERS
+layout(push_constant) uniform pushConstantBuffer
+{
+  PushConstants pushConstants;
+};
+
+#ifndef OIT_MSAA
 #define OIT OIT_INTERLOCK
-#define OIT_LAYERS 8
 #define OIT_LOOP_DEPTH
-#define OIT_TAILBLEND 1
 #define OIT_MSAA 8
 #define OIT_SAMPLE_SHADING 1
 #endif
 
+// These parameters are specialization constants instead of #defines, so that
+// changing them only requires creating new pipelines from the existing shader
+// modules, rather than recompiling the GLSL. Since they aren't preprocessor
+// values, use them in if statements rather than #if; the compiler still
+// removes the branches that can't be taken when creating the pipeline.
+// The number of OIT layers per pixel or sample; arrays sized with this are
+// sized when the pipeline is created.
+layout(constant_id = SPEC_OIT_LAYERS) const int OIT_LAYERS = 8;
+// Whether fragments that don't fit in the A-buffer are tail-blended.
+layout(constant_id = SPEC_OIT_TAILBLEND) const bool OIT_TAILBLEND = true;
+// Affects several techniques, does a coarse depth-test to avoid
+// longer-lasting actions (helps when many layers are used)
+layout(constant_id = SPEC_USE_EARLYDEPTH) const bool USE_EARLYDEPTH = true;
+// Whether auxiliary values are tagged with pushConstants.epoch, so that they
+// only need to be cleared when the epoch wraps around.
+layout(constant_id = SPEC_OIT_EPOCH_TAGS) const bool OIT_EPOCH_TAGS = false;
+// Whether color passes mark the tiles they touch in the tile mask, so that
+// the composite pass only draws those tiles.
+layout(constant_id = SPEC_OIT_TILED_COMPOSITE) const bool OIT_TILED_COMPOSITE = false;
+// Whether the A-buffer stores a shading payload (an object index and a
+// normal) instead of a shaded color, so that only fragments that are
+// composited or tail-blended are shaded.
+layout(constant_id = SPEC_OIT_DEFERRED_SHADING) const bool OIT_DEFERRED_SHADING = false;
+// Whether composite passes (and OIT_LINKEDLIST's tail blend) stop blending
+// once the accumulated opacity reaches scene.opacityThreshold.
+layout(constant_id = SPEC_OIT_OPACITY_EARLY_OUT) const bool OIT_OPACITY_EARLY_OUT = false;
+// Whether color passes track a conservative bound on each pixel's accumulated
+// opacity in IMG_AUXOPACITY, and reject fragments behind scene.opacityThreshold
+// of it before touching the A-buffer.
+layout(constant_id = SPEC_OIT_OPACITY_CULLING) const bool OIT_OPACITY_CULLING = false;
+// One of the COLOR_ENCODING_* values; see packFragmentColor.
+layout(constant_id = SPEC_OIT_COLOR_ENCODING) const int OIT_COLOR_ENCODING = COLOR_ENCODING_SRGB;
+// One of the ABUFFER_LAYOUT_* values; see abufferListPos.
+layout(constant_id = SPEC_OIT_ABUFFER_LAYOUT) const int OIT_ABUFFER_LAYOUT = ABUFFER_LAYOUT_LAYER_MAJOR;
+
 // When using MSAA, we can either use the coverage shading technique (not
 // coverage-to-alpha! This stores the coverage (i.e. MSAA sample mask) of each
 // fragment in the A-buffer) or sample shading (lower-level supersampling; each
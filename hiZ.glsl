@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Declares the Hi-Z pyramid (see Sample::cmdOcclusionCull) and functions for
+// finding its levels. The pyramid is a storage buffer of floats holding each
+// level's texels in row-major order, one level after another. Level 0 has
+// half the resolution of m_depthImage (rounded up), each level after that
+// halves the previous one again, and the last level is 1x1. Each texel holds
+// the farthest depth of the area of m_depthImage it covers.
+//
+// Requires common.h to have been included.
+
+layout(binding = IMG_HIZ, std430) restrict buffer hiZBuffer
+{
+  float hiZ[];
+};
+
+// Returns the size of a level below level, given the size of level.
+ivec2 hiZNextLevelSize(ivec2 size)
+{
+  return max((size + 1) / 2, ivec2(1));
+}
+
+// Returns the number of texels in each row and column of a level.
+ivec2 hiZLevelSize(uint level)
+{
+  ivec2 size = hiZNextLevelSize(scene.colorSize);
+  for(uint i = 0; i < level; i++)
+  {
+    size = hiZNextLevelSize(size);
+  }
+  return size;
+}
+
+// Returns the index in hiZ of the first texel of a level.
+uint hiZLevelOffset(uint level)
+{
+  ivec2 size   = hiZNextLevelSize(scene.colorSize);
+  uint  offset = 0;
+  for(uint i = 0; i < level; i++)
+  {
+    offset += uint(size.x * size.y);
+    size   = hiZNextLevelSize(size);
+  }
+  return offset;
+}
+
+// Returns the number of levels, including the 1x1 level.
+uint hiZNumLevels()
+{
+  ivec2 size      = hiZNextLevelSize(scene.colorSize);
+  uint  numLevels = 1;
+  while(size.x > 1 || size.y > 1)
+  {
+    size = hiZNextLevelSize(size);
+    numLevels++;
+  }
+  return numLevels;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Builds level pushConstants.hiZLevel of the Hi-Z pyramid (see hiZ.glsl) from
+// 2x2 blocks of m_depthImage (for level 0) or of the level before it. Each
+// invocation writes one texel.
+
+#include "common.h"
+#include "hiZ.glsl"
+#include "sceneDepth.glsl"
+
+layout(local_size_x = HIZ_WORKGROUP_SIZE, local_size_y = HIZ_WORKGROUP_SIZE) in;
+
+// Returns the farthest depth of the samples of a pixel of m_depthImage.
+float farthestDepth(ivec2 pixel)
+{
+  float farthest = 0.0;
+  for(int s = 0; s < OIT_MSAA; s++)
+  {
+    farthest = max(farthest, sceneDepth(pixel, s));
+  }
+  return farthest;
+}
+
+void main()
+{
+  const uint  level = pushConstants.hiZLevel;
+  const ivec2 size  = hiZLevelSize(level);
+  const ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if(any(greaterThanEqual(texel, size)))
+  {
+    return;
+  }
+
+  float farthest = 0.0;
+  if(level == 0)
+  {
+    for(int i = 0; i < 4; i++)
+    {
+      farthest = max(farthest, farthestDepth(min(2 * texel + ivec2(i & 1, i >> 1), scene.colorSize - 1)));
+    }
+  }
+  else
+  {
+    const ivec2 sourceSize   = hiZLevelSize(level - 1);
+    const uint  sourceOffset = hiZLevelOffset(level - 1);
+    for(int i = 0; i < 4; i++)
+    {
+      const ivec2 source = min(2 * texel + ivec2(i & 1, i >> 1), sourceSize - 1);
+      farthest           = max(farthest, hiZ[sourceOffset + uint(source.y * sourceSize.x + source.x)]);
+    }
+  }
+
+  hiZ[hiZLevelOffset(level) + uint(texel.y * size.x + texel.x)] = farthest;
+}
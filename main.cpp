@@ -30,7 +30,10 @@
 // oitRender.cpp: Main OIT-specific rendering functions.
 // oit.cpp: Main OIT-specific resource creation functions.
 // oitGui.cpp: GUI for the application.
+// oitAutoTune.cpp: Automatic selection of the algorithm and A-buffer sizes.
+// oitStatistics.cpp: Pipeline statistics and shader statistics per OIT pass.
 // utilities_vk.h: Helper functions that can exist without a sample.
+// trace_vk.h, trace_vk.cpp: Records CPU and GPU zones to a Chrome trace file.
 // main.cpp: All other functions not specific to OIT.
 
 #pragma warning(disable : 26812)  // Disable the warning about Vulkan's enumerations being untyped in VS2019.
@@ -50,10 +53,15 @@
 #include <GLFW/glfw3.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <random>
 #include <set>
@@ -148,10 +156,14 @@ bool Sample::begin()
   m_ringFences.init(m_context);
   m_ringCmdPool.init(m_context, m_context.m_queueGCT.familyIndex, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
   m_submission.init(m_context.m_queueGCT.queue);
+  m_trace.init(m_context, nvvk::DEFAULT_RING_SIZE, m_context.hasDeviceExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME));
 
   createTextureSampler();
   
   m_allocatorDma.init(m_context.m_device, m_context.getPhysicalDevices().front());
+  createAutoTuneResources();
+  createStatisticsResources();
+  createSceneUploadResources();
   // Configure shader system (note that this also creates shader modules as we add them)
   {
     // Initialize shader system (this keeps track of shaders so that you can reload all of them at once):
@@ -170,7 +182,13 @@ bool Sample::begin()
     m_shaderModuleManager.registerInclude("common.h");
     m_shaderModuleManager.registerInclude("oitColorDepthDefines.glsl");
     m_shaderModuleManager.registerInclude("oitCompositeDefines.glsl");
+    m_shaderModuleManager.registerInclude("oitABuffer.glsl");
+    m_shaderModuleManager.registerInclude("hiZ.glsl");
+    m_shaderModuleManager.registerInclude("sceneDepth.glsl");
+    m_shaderModuleManager.registerInclude("sceneVertex.glsl");
     m_shaderModuleManager.registerInclude("shaderCommon.glsl");
+    m_shaderModuleManager.registerInclude("sphereImpostor.glsl");
+    m_shaderModuleManager.registerInclude("srgbLut.glsl");
   }
 
   // Call updateRendererImmediate to set up the rest of the renderer with the initial swapchain size:
@@ -208,6 +226,15 @@ bool Sample::begin()
     m_imGuiRegistry.enumAdd(GUI_AA, AA_SUPER_4X, "super 4x");
     m_imGuiRegistry.enumAdd(GUI_AA, AA_MSAA_8X, "msaa 8x pixel-shading");
     m_imGuiRegistry.enumAdd(GUI_AA, AA_SSAA_8X, "msaa 8x sample-shading");
+
+    m_imGuiRegistry.enumAdd(GUI_COLOR_ENCODING, COLOR_ENCODING_SRGB, "srgb8");
+    m_imGuiRegistry.enumAdd(GUI_COLOR_ENCODING, COLOR_ENCODING_SRGB_LUT, "srgb8 lookup table");
+    m_imGuiRegistry.enumAdd(GUI_COLOR_ENCODING, COLOR_ENCODING_GAMMA2, "gamma 2 rgba8");
+    m_imGuiRegistry.enumAdd(GUI_COLOR_ENCODING, COLOR_ENCODING_RGB10A2, "linear rgb10a2");
+
+    m_imGuiRegistry.enumAdd(GUI_ABUFFER_LAYOUT, ABUFFER_LAYOUT_LAYER_MAJOR, "layer-major");
+    m_imGuiRegistry.enumAdd(GUI_ABUFFER_LAYOUT, ABUFFER_LAYOUT_INTERLEAVED, "pixel-interleaved");
+    m_imGuiRegistry.enumAdd(GUI_ABUFFER_LAYOUT, ABUFFER_LAYOUT_TILED, "tiled 8x8 morton");
   }
 
   // Initialize camera
@@ -223,6 +250,8 @@ bool Sample::begin()
   m_sceneUbo.alphaMin   = 0.2f;
   m_sceneUbo.alphaWidth = 0.3f;
 
+  m_sceneUbo.opacityThreshold = 0.99f;
+
   m_frame     = 0;
   m_lastState = m_state;
 
@@ -231,10 +260,18 @@ bool Sample::begin()
 
 void Sample::updateRendererImmediate(bool swapchainSizeChanged, bool forceRebuildAll)
 {
-  VkCommandBuffer cmd = createTempCmdBuffer();
-  cmdUpdateRendererFromState(cmd, swapchainSizeChanged, forceRebuildAll);
+  VkCommandBuffer cmd     = createTempCmdBuffer();
+  const bool      changed = cmdUpdateRendererFromState(cmd, swapchainSizeChanged, forceRebuildAll);
   vkEndCommandBuffer(cmd);
 
+  // If nothing changed, the command buffer is empty and is freed with the
+  // rest of its ring cycle; frames in flight keep running, so that several
+  // frame-resource sets can overlap.
+  if(!changed)
+  {
+    return;
+  }
+
   m_submission.enqueue(cmd);
   submissionExecute();
   vkDeviceWaitIdle(m_context);
@@ -242,33 +279,74 @@ void Sample::updateRendererImmediate(bool swapchainSizeChanged, bool forceRebuil
   m_ringCmdPool.reset();
 }
 
-void Sample::cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchainSizeChanged, bool forceRebuildAll)
+bool Sample::cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchainSizeChanged, bool forceRebuildAll)
 {
   m_state.recomputeAntialiasingSettings();
+  m_state.aBufferDeviceAddress = m_state.aBufferDeviceAddress && supportsABufferDeviceAddress();
+  m_state.frustumCulling       = m_state.frustumCulling && supportsFrustumCulling();
+  m_state.asyncSceneUpload     = m_state.asyncSceneUpload && supportsAsyncSceneUpload();
+  m_state.preTransform         = m_state.preTransform && !m_state.usesSphereImpostors();  // Impostors are expanded in the vertex shader
+  m_state.frameResourceSets    = std::max(1u, std::min(m_state.frameResourceSets, MAX_FRAME_RESOURCE_SETS));
+
+  // Make sure the new settings fit in memory before comparing them to the old ones.
+  fitStateToMemoryBudget();
 
   // Determine what needs to be rebuilt
   swapchainSizeChanged |= forceRebuildAll;
 
   const bool vsyncChanged = (m_lastVsync != getVsync()) || forceRebuildAll;
 
+  // OIT_LAYERS, OIT_TAILBLEND, USE_EARLYDEPTH, and OIT_EPOCH_TAGS are
+  // specialization constants, so changing them only requires new pipelines.
+  // (Changing OIT_EPOCH_TAGS also recreates the images, so that they're cleared.)
   const bool shadersNeedUpdate = (m_state.algorithm != m_lastState.algorithm)             //
-                                 || (m_state.oitLayers != m_lastState.oitLayers)          //
-                                 || (m_state.tailBlend != m_lastState.tailBlend)          //
                                  || (m_state.msaa != m_lastState.msaa)                    //
                                  || (m_state.sampleShading != m_lastState.sampleShading)  //
+                                 || (m_state.hybridSamples != m_lastState.hybridSamples)  //
+                                 || (m_state.aBufferDeviceAddress != m_lastState.aBufferDeviceAddress)  //
+                                 || (m_state.usesOcclusionCulling() != m_lastState.usesOcclusionCulling())  //
+                                 || (m_state.usesSphereImpostors() != m_lastState.usesSphereImpostors())    //
+                                 || (m_state.usesCompressedVertices() != m_lastState.usesCompressedVertices())  //
                                  || forceRebuildAll;
 
-  const bool sceneNeedsReinit = (m_state.numObjects != m_lastState.numObjects)     //
-                                || (m_state.scaleWidth != m_lastState.scaleWidth)  //
-                                || (m_state.scaleMin != m_lastState.scaleMin)      //
-                                || (m_state.subdiv != m_lastState.subdiv)          //
-                                || forceRebuildAll;
+  // Changing the scene's contents, but not the format of its buffers, can be
+  // done asynchronously while the current scene keeps rendering; see
+  // startSceneUpload. Format changes also change shaders and pipelines, so
+  // they're made immediately.
+  const bool sceneContentsChanged = (m_state.numObjects != m_lastState.numObjects)     //
+                                    || (m_state.scaleWidth != m_lastState.scaleWidth)  //
+                                    || (m_state.scaleMin != m_lastState.scaleMin)      //
+                                    || (m_state.subdiv != m_lastState.subdiv);
+
+  const bool sceneFormatChanged = (m_state.preTransform != m_lastState.preTransform)                        //
+                                  || (m_state.usesSphereImpostors() != m_lastState.usesSphereImpostors())  //
+                                  || (m_state.usesLod() != m_lastState.usesLod())                          //
+                                  || (m_state.usesCompressedVertices() != m_lastState.usesCompressedVertices())  //
+                                  || (m_state.usesShortIndices() != m_lastState.usesShortIndices())              //
+                                  || forceRebuildAll;
+
+  const bool sceneNeedsReinit = sceneFormatChanged || (sceneContentsChanged && !m_state.asyncSceneUpload);
+
+  if(sceneContentsChanged && !sceneNeedsReinit)
+  {
+    startSceneUpload();
+  }
+  // Once an asynchronous upload is done, its scene replaces the current one.
+  const bool sceneUploadFinished = !sceneNeedsReinit && updateSceneUpload();
 
   const bool imagesNeedReinit = (m_state.supersample != m_lastState.supersample)         //
                                 || (m_state.msaa != m_lastState.msaa)                    //
                                 || (m_state.algorithm != m_lastState.algorithm)          //
                                 || (m_state.sampleShading != m_lastState.sampleShading)  //
                                 || (m_state.oitLayers != m_lastState.oitLayers)          //
+                                || (m_state.aBufferDeviceAddress != m_lastState.aBufferDeviceAddress)  //
+                                || (m_state.bands != m_lastState.bands)                  //
+                                || (m_state.frameResourceSets != m_lastState.frameResourceSets)  //
+                                || (m_state.usesEpochTags() != m_lastState.usesEpochTags())      //
+                                || (m_state.usesOpacityCulling() != m_lastState.usesOpacityCulling())  //
+                                || (m_state.aBufferLayout() != m_lastState.aBufferLayout())            //
+                                || (m_state.usesOcclusionCulling() != m_lastState.usesOcclusionCulling())  //
+                                || (m_state.usesSphereImpostors() != m_lastState.usesSphereImpostors())    //
                                 || ((m_state.algorithm == OIT_LINKEDLIST)
                                     && (m_state.linkedListAllocatedPerElement != m_lastState.linkedListAllocatedPerElement))  //
                                 || swapchainSizeChanged  //
@@ -276,6 +354,8 @@ void Sample::cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchai
 
   const bool descriptorSetsNeedReinit = ((m_state.algorithm == OIT_LOOP64) && (m_lastState.algorithm != OIT_LOOP64))  //
                                         || ((m_state.algorithm != OIT_LOOP64) && (m_lastState.algorithm == OIT_LOOP64))  //
+                                        || (m_state.aBufferDeviceAddress != m_lastState.aBufferDeviceAddress)            //
+                                        || (m_state.frameResourceSets != m_lastState.frameResourceSets)                  //
                                         || forceRebuildAll;
 
   const bool framebuffersAndDescriptorsNeedReinit = imagesNeedReinit  //
@@ -285,11 +365,22 @@ void Sample::cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchai
   const bool renderPassesNeedReinit = (m_state.msaa != m_lastState.msaa)  //
                                       || forceRebuildAll;
 
-  const bool pipelinesNeedReinit = (m_state.algorithm != m_lastState.algorithm)  //
+  const bool pipelinesNeedReinit = (m_state.algorithm != m_lastState.algorithm)      //
+                                   || (m_state.oitLayers != m_lastState.oitLayers)    //
+                                   || (m_state.tailBlend != m_lastState.tailBlend)    //
+                                   || (m_state.earlyDepth != m_lastState.earlyDepth)  //
+                                   || (m_state.usesTiledComposite() != m_lastState.usesTiledComposite())  //
+                                   || (m_state.usesDeferredShading() != m_lastState.usesDeferredShading())  //
+                                   || (m_state.usesOpacityEarlyOut() != m_lastState.usesOpacityEarlyOut())  //
+                                   || (m_state.usesOpacityCulling() != m_lastState.usesOpacityCulling())    //
+                                   || (m_state.colorEncoding != m_lastState.colorEncoding)                  //
+                                   || (m_state.preTransform != m_lastState.preTransform)                    //
+                                   || (m_state.frustumCulling != m_lastState.frustumCulling)                //
                                    || shadersNeedUpdate || imagesNeedReinit;
 
-  const bool anythingChanged = shadersNeedUpdate || sceneNeedsReinit || imagesNeedReinit || descriptorSetsNeedReinit
-                               || framebuffersAndDescriptorsNeedReinit || renderPassesNeedReinit;
+  const bool anythingChanged = shadersNeedUpdate || sceneNeedsReinit || sceneUploadFinished || imagesNeedReinit
+                               || descriptorSetsNeedReinit || framebuffersAndDescriptorsNeedReinit || renderPassesNeedReinit
+                               || pipelinesNeedReinit;
 
   if(anythingChanged)
   {
@@ -306,6 +397,10 @@ void Sample::cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchai
     {
       initScene(cmdBuffer);
     }
+    else if(sceneUploadFinished)
+    {
+      finishSceneUpload(cmdBuffer);
+    }
 
     if(imagesNeedReinit)
     {
@@ -322,9 +417,14 @@ void Sample::cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchai
       createNonGUIRenderPasses();
     }
 
-    if(framebuffersAndDescriptorsNeedReinit)
+    // The descriptor sets also refer to the scene's buffers.
+    if(framebuffersAndDescriptorsNeedReinit || sceneNeedsReinit || sceneUploadFinished)
     {
       updateAllDescriptorSets();
+    }
+
+    if(framebuffersAndDescriptorsNeedReinit)
+    {
       createFramebuffers();
     }
 
@@ -336,11 +436,14 @@ void Sample::cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchai
     if(pipelinesNeedReinit)
     {
       createGraphicsPipelines();
+      updateExecutableStatistics();
     }
 
     setUpViewportsAndScissors();
     m_lastVsync = getVsync();
   }
+
+  return anythingChanged;
 }
 
 void Sample::end()
@@ -362,9 +465,13 @@ void Sample::end()
   destroyScene();
   destroyUniformBuffers();
   // From begin
+  destroySceneUploadResources();
+  destroyStatisticsResources();
+  destroyAutoTuneResources();
   m_allocatorDma.deinit();
 
   destroyTextureSampler();
+  m_trace.deinit();
   m_ringCmdPool.deinit();
   m_ringFences.deinit();
 }
@@ -419,13 +526,92 @@ void Sample::createUniformBuffers()
 
 void Sample::destroyScene()
 {
+  m_allocatorDma.destroy(m_drawCommandBuffer);
+  m_allocatorDma.destroy(m_objectBoundsBuffer);
+  m_allocatorDma.destroy(m_transformedBuffer);
+  m_allocatorDma.destroy(m_materialBuffer);
   m_allocatorDma.destroy(m_indexBuffer);
   m_allocatorDma.destroy(m_vertexBuffer);
 }
 
-void Sample::initScene(VkCommandBuffer commandBuffer)
+// Packs a vertex of an object with the given bounding sphere into a
+// CompressedVertex; sceneVertex.glsl decodes it.
+static CompressedVertex compressVertex(const Vertex& vertex, const nvmath::vec4& sphere)
 {
-  destroyScene();
+  // Rounds x in [-1, 1] to a snorm with the given number of bits, like
+  // GLSL's packSnorm2x16 and packSnorm4x8.
+  auto snorm = [](float x, uint32_t bits) {
+    const float   scale = static_cast<float>((1u << (bits - 1)) - 1);
+    const int32_t value = static_cast<int32_t>(std::round(std::max(-1.0f, std::min(1.0f, x)) * scale));
+    return static_cast<uint32_t>(value) & ((1u << bits) - 1);
+  };
+
+  // The sphere mesh has radius 1 before scaling, so this is in [-1, 1]^3.
+  const nvmath::vec3 local = (vertex.pos - nvmath::vec3(sphere.x, sphere.y, sphere.z)) / sphere.w;
+
+  // Octahedral encoding: project the normal onto the octahedron
+  // |x| + |y| + |z| = 1, then fold its lower half over the upper half.
+  const nvmath::vec3& n    = vertex.normal;
+  const float         l1   = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  float               octX = n.x / l1;
+  float               octY = n.y / l1;
+  if(n.z < 0.0f)
+  {
+    const float foldedX = (1.0f - std::abs(octY)) * ((octX >= 0.0f) ? 1.0f : -1.0f);
+    const float foldedY = (1.0f - std::abs(octX)) * ((octY >= 0.0f) ? 1.0f : -1.0f);
+    octX                = foldedX;
+    octY                = foldedY;
+  }
+
+  CompressedVertex result;
+  result.positionXY      = snorm(local.x, 16) | (snorm(local.y, 16) << 16);
+  result.positionZNormal = snorm(local.z, 16) | (snorm(octX, 8) << 16) | (snorm(octY, 8) << 24);
+  return result;
+}
+
+std::array<SceneGeometry::Contents, NUM_SCENE_BUFFERS> SceneGeometry::contents() const
+{
+  std::array<Contents, NUM_SCENE_BUFFERS> result;
+
+  // With State::usesCompressedVertices, upload the compressed form of each
+  // vertex instead.
+  if(compressedVertices.empty())
+  {
+    result[SCENE_BUFFER_VERTICES].data = vertices.data();
+    result[SCENE_BUFFER_VERTICES].size = static_cast<VkDeviceSize>(vertices.size() * sizeof(Vertex));
+  }
+  else
+  {
+    result[SCENE_BUFFER_VERTICES].data = compressedVertices.data();
+    result[SCENE_BUFFER_VERTICES].size = static_cast<VkDeviceSize>(compressedVertices.size() * sizeof(CompressedVertex));
+  }
+
+  if(indexType == VK_INDEX_TYPE_UINT16)
+  {
+    result[SCENE_BUFFER_INDICES].data = shortIndices.data();
+    result[SCENE_BUFFER_INDICES].size = static_cast<VkDeviceSize>(shortIndices.size() * sizeof(uint16_t));
+  }
+  else
+  {
+    result[SCENE_BUFFER_INDICES].data = triangles.data();
+    result[SCENE_BUFFER_INDICES].size = static_cast<VkDeviceSize>(triangles.size() * sizeof(nvmath::vec3ui));
+  }
+
+  result[SCENE_BUFFER_MATERIALS].data     = materials.data();
+  result[SCENE_BUFFER_MATERIALS].size     = static_cast<VkDeviceSize>(materials.size() * sizeof(nvmath::vec4));
+  result[SCENE_BUFFER_OBJECT_BOUNDS].data = objectBounds.data();
+  result[SCENE_BUFFER_OBJECT_BOUNDS].size = static_cast<VkDeviceSize>(objectBounds.size() * sizeof(nvmath::vec4));
+  return result;
+}
+
+// Generates the scene for the given state. This only reads its arguments, so
+// startSceneUpload runs it on a worker thread; if *cancel becomes true, it
+// returns early with an incomplete scene.
+static SceneGeometry generateScene(const State& state, const std::atomic<bool>* cancel)
+{
+  SceneGeometry scene;
+  scene.subdiv = state.subdiv;
+
   // A Mesh consists of vectors of vertices, triangle list indices, and lines.
   // It assumes that its type contains variables, at least, each vertex's position, normal, and color.
   // (We'll ignore lines when converting this to a vertex and index buffer.)
@@ -436,15 +622,33 @@ void Sample::initScene(VkCommandBuffer commandBuffer)
   std::default_random_engine            rnd(3625);  // Fixed seed
   std::uniform_real_distribution<float> uniformDist;
 
-  for(uint32_t i = 0; i < m_state.numObjects; i++)
+  // The color of each object, for deferred shading, and the bounding sphere
+  // of each object (center and radius), for frustum culling.
+  scene.materials.reserve(state.numObjects);
+  scene.objectBounds.reserve(state.numObjects);
+  // With State::usesLod, the triangles of each coarser level of detail, each
+  // with half the subdivision of the one before. Their vertices follow each
+  // object's level 0 vertices, but their indices go after all objects' level
+  // 0 indices, so that drawing a range of objects at level 0 is still a
+  // single range of the index buffer. Level L of object i then uses
+  // lodIndexCount[L] indices starting at lodFirstIndex[L] + i * lodIndexCount[L].
+  const uint32_t                                    numLods = (state.usesLod() ? MAX_LODS : 1);
+  std::array<std::vector<nvmath::vec3ui>, MAX_LODS> lodTriangles;
+
+  for(uint32_t i = 0; i < state.numObjects; i++)
   {
+    if((cancel != nullptr) && cancel->load())
+    {
+      return scene;
+    }
+
     // Generate a random position in [-GLOBAL_SCALE/2, GLOBAL_SCALE/2)^3
     nvmath::vec3 center(uniformDist(rnd), uniformDist(rnd), uniformDist(rnd));
     center = (center - nvmath::vec3(0.5)) * GLOBAL_SCALE;
 
     // Generate a random radius
     float radius = GLOBAL_SCALE * 0.9f / GRID_SIZE;
-    radius *= uniformDist(rnd) * m_state.scaleWidth + m_state.scaleMin;
+    radius *= uniformDist(rnd) * state.scaleWidth + state.scaleMin;
 
     // Our vectors are vertical, so this represents a scale followed by a translation:
     nvmath::mat4 matrix = nvmath::translation_mat4(center) * nvmath::scale_mat4(nvmath::vec3(radius));
@@ -452,11 +656,52 @@ void Sample::initScene(VkCommandBuffer commandBuffer)
     // Add a sphere to the complete mesh, and then color it:
     const uint32_t vtxStart = completeMesh.getVerticesCount();  // First vertex to color
 
-    nvh::geometry::Sphere<Vertex>::add(completeMesh, matrix, m_state.subdiv * 2, m_state.subdiv);
+    if(state.usesSphereImpostors())
+    {
+      // The corners of the front and back impostor quads; see
+      // sphereImpostor.vert.glsl.
+      static const float corners[IMPOSTOR_VERTICES / 2][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}, {-1.0f, 1.0f}};
+      for(float side : {1.0f, -1.0f})
+      {
+        const uint32_t quadStart = completeMesh.getVerticesCount();
+        for(const auto& corner : corners)
+        {
+          completeMesh.m_vertices.push_back(Vertex(center, nvmath::vec3(corner[0], corner[1], side), nvmath::vec4(1.0f)));
+        }
+        completeMesh.m_indicesTriangles.push_back(nvmath::vec3ui(quadStart, quadStart + 1, quadStart + 2));
+        completeMesh.m_indicesTriangles.push_back(nvmath::vec3ui(quadStart, quadStart + 2, quadStart + 3));
+      }
+    }
+    else
+    {
+      nvh::geometry::Sphere<Vertex>::add(completeMesh, matrix, state.subdiv * 2, state.subdiv);
+      for(uint32_t lod = 1; lod < numLods; lod++)
+      {
+        const uint32_t              lodSubdiv = std::max(2u, state.subdiv >> lod);
+        nvh::geometry::Mesh<Vertex> lodMesh;
+        nvh::geometry::Sphere<Vertex>::add(lodMesh, matrix, lodSubdiv * 2, lodSubdiv);
+
+        const uint32_t lodVtxStart = completeMesh.getVerticesCount();
+        completeMesh.m_vertices.insert(completeMesh.m_vertices.end(), lodMesh.m_vertices.begin(), lodMesh.m_vertices.end());
+        for(const nvmath::vec3ui& triangle : lodMesh.m_indicesTriangles)
+        {
+          lodTriangles[lod].push_back(
+              nvmath::vec3ui(triangle.x + lodVtxStart, triangle.y + lodVtxStart, triangle.z + lodVtxStart));
+        }
+      }
+    }
+    scene.objectBounds.push_back(nvmath::vec4(center, radius));  // The sphere mesh has radius 1 before scaling
 
     if(i == 0)
     {
-      m_objectTriangleIndices = completeMesh.getTriangleIndicesCount();
+      scene.objectTriangleIndices = completeMesh.getTriangleIndicesCount();
+      scene.verticesPerObject     = completeMesh.getVerticesCount();
+      for(uint32_t lod = 0; lod < MAX_LODS; lod++)
+      {
+        // Levels that weren't built fall back to level 0.
+        scene.lodIndexCount[lod] =
+            ((lod == 0) || (lod >= numLods)) ? scene.objectTriangleIndices : static_cast<uint32_t>(lodTriangles[lod].size() * 3);
+      }
     }
 
     // Color in unpremultiplied linear space
@@ -469,15 +714,66 @@ void Sample::initScene(VkCommandBuffer commandBuffer)
     {
       completeMesh.m_vertices[v].color = color;
     }
+    scene.materials.push_back(color);
+  }
+
+  // Count the total number of triangle indices at level of detail 0
+  scene.sceneTriangleIndices = completeMesh.getTriangleIndicesCount();
+
+  // Then append the coarser levels of detail.
+  for(uint32_t lod = 0; lod < MAX_LODS; lod++)
+  {
+    scene.lodFirstIndex[lod] = ((lod == 0) || (lod >= numLods)) ? 0 : completeMesh.getTriangleIndicesCount();
+    completeMesh.m_indicesTriangles.insert(completeMesh.m_indicesTriangles.end(), lodTriangles[lod].begin(),
+                                           lodTriangles[lod].end());
+  }
+
+  // With State::usesShortIndices, make each index relative to its object's
+  // first vertex, so that it fits in 16 bits; draw commands then add the
+  // object's first vertex back as their vertexOffset, which is
+  // i * vertexOffsetPerObject for object i. All objects have the same number
+  // of vertices, and are stored in order.
+  if(state.usesShortIndices() && (scene.verticesPerObject <= 65536))
+  {
+    scene.indexType             = VK_INDEX_TYPE_UINT16;
+    scene.vertexOffsetPerObject = scene.verticesPerObject;
+    scene.shortIndices.reserve(completeMesh.getTriangleIndicesCount());
+    for(const nvmath::vec3ui& triangle : completeMesh.m_indicesTriangles)
+    {
+      scene.shortIndices.push_back(static_cast<uint16_t>(triangle.x % scene.verticesPerObject));
+      scene.shortIndices.push_back(static_cast<uint16_t>(triangle.y % scene.verticesPerObject));
+      scene.shortIndices.push_back(static_cast<uint16_t>(triangle.z % scene.verticesPerObject));
+    }
   }
 
-  // Count the total number of triangle indices
-  m_sceneTriangleIndices = completeMesh.getTriangleIndicesCount();
+  // With State::usesCompressedVertices, also compute the compressed form of
+  // each vertex. All objects have the same number of vertices, and are
+  // stored in order.
+  if(state.usesCompressedVertices())
+  {
+    scene.compressedVertices.reserve(completeMesh.m_vertices.size());
+    for(size_t v = 0; v < completeMesh.m_vertices.size(); v++)
+    {
+      scene.compressedVertices.push_back(
+          compressVertex(completeMesh.m_vertices[v], scene.objectBounds[v / scene.verticesPerObject]));
+    }
+  }
+
+  scene.vertices  = std::move(completeMesh.m_vertices);
+  scene.triangles = std::move(completeMesh.m_indicesTriangles);
+  return scene;
+}
 
-  // Create the vertex and index buffers and synchronously upload them to the
-  // GPU, waiting for them to finish uploading. Note that applications may wish
-  // to implement asynchronous uploads, which you can see how to do in the
-  // vk_async_resources sample.
+void Sample::initScene(VkCommandBuffer commandBuffer)
+{
+  cancelSceneUpload();
+  const SceneGeometry geometry = generateScene(m_state, nullptr);
+
+  // Create the scene's buffers and synchronously upload them to the GPU,
+  // waiting for them to finish uploading. (With State::asyncSceneUpload,
+  // startSceneUpload uploads scenes asynchronously instead.)
+  std::array<nvvk::Buffer, NUM_SCENE_BUFFERS> buffers;
+  createSceneBuffers(geometry, buffers);
 
   nvvk::StagingMemoryManager scopedTransfer(m_allocatorDma.getMemoryAllocator());
   {
@@ -485,17 +781,321 @@ void Sample::initScene(VkCommandBuffer commandBuffer)
     // 'scopedTransfer' can then safely go out of scope after it.
     nvvk::ScopeCommandBuffer cmd(m_context, m_context.m_queueT, m_context.m_queueT);
 
-    // Create vertex buffer
-    VkDeviceSize vtxBufferSize = static_cast<VkDeviceSize>(completeMesh.getVerticesSize());
-    m_vertexBuffer             = m_allocatorDma.createBuffer(vtxBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    scopedTransfer.cmdToBuffer(cmd, m_vertexBuffer.buffer, 0, vtxBufferSize, completeMesh.m_vertices.data());
-    m_debug.setObjectName(m_vertexBuffer.buffer, "m_vertexBuffer");
+    const std::array<SceneGeometry::Contents, NUM_SCENE_BUFFERS> contents = geometry.contents();
+    for(uint32_t i = 0; i < NUM_SCENE_BUFFERS; i++)
+    {
+      scopedTransfer.cmdToBuffer(cmd, buffers[i].buffer, 0, contents[i].size, contents[i].data);
+    }
+  }
+
+  adoptScene(geometry, buffers);
+}
+
+void Sample::createSceneBuffers(const SceneGeometry& geometry, std::array<nvvk::Buffer, NUM_SCENE_BUFFERS>& buffers)
+{
+  // (The vertex pre-transform, and vertex pulling with compressed vertices,
+  // also read the vertex buffer as a storage buffer.)
+  const VkBufferUsageFlags usages[NUM_SCENE_BUFFERS] = {
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,  // SCENE_BUFFER_VERTICES
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT,                                        // SCENE_BUFFER_INDICES
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,                                      // SCENE_BUFFER_MATERIALS
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT                                       // SCENE_BUFFER_OBJECT_BOUNDS
+  };
+  const char* const names[NUM_SCENE_BUFFERS] = {"m_vertexBuffer", "m_indexBuffer", "m_materialBuffer", "m_objectBoundsBuffer"};
+
+  const std::array<SceneGeometry::Contents, NUM_SCENE_BUFFERS> contents = geometry.contents();
+  for(uint32_t i = 0; i < NUM_SCENE_BUFFERS; i++)
+  {
+    buffers[i] = m_allocatorDma.createBuffer(contents[i].size, usages[i] | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    m_debug.setObjectName(buffers[i].buffer, names[i]);
+  }
+}
+
+void Sample::adoptScene(const SceneGeometry& geometry, std::array<nvvk::Buffer, NUM_SCENE_BUFFERS>& buffers)
+{
+  destroyScene();
+
+  m_vertexBuffer       = buffers[SCENE_BUFFER_VERTICES];
+  m_indexBuffer        = buffers[SCENE_BUFFER_INDICES];
+  m_materialBuffer     = buffers[SCENE_BUFFER_MATERIALS];
+  m_objectBoundsBuffer = buffers[SCENE_BUFFER_OBJECT_BOUNDS];
+  buffers.fill(nvvk::Buffer());
+
+  m_indexType                      = geometry.indexType;
+  m_sceneSubdiv                    = geometry.subdiv;
+  m_objectTriangleIndices          = geometry.objectTriangleIndices;
+  m_sceneTriangleIndices           = geometry.sceneTriangleIndices;
+  m_sceneUbo.verticesPerObject     = geometry.verticesPerObject;
+  m_sceneUbo.indicesPerObject      = geometry.objectTriangleIndices;
+  m_sceneUbo.vertexOffsetPerObject = geometry.vertexOffsetPerObject;
+  for(uint32_t lod = 0; lod < MAX_LODS; lod++)
+  {
+    m_sceneUbo.lodFirstIndex[lod] = geometry.lodFirstIndex[lod];
+    m_sceneUbo.lodIndexCount[lod] = geometry.lodIndexCount[lod];
+  }
+
+  // A header with the opaque and transparent draw counts, followed by space
+  // for a draw command per object in each list.
+  const VkDeviceSize drawCommandBufferSize =
+      DRAW_COMMANDS_HEADER_UINTS * sizeof(uint32_t) + 2 * geometry.objectBounds.size() * sizeof(VkDrawIndexedIndirectCommand);
+  m_drawCommandBuffer = m_allocatorDma.createBuffer(
+      drawCommandBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+  m_debug.setObjectName(m_drawCommandBuffer.buffer, "m_drawCommandBuffer");
+
+  if(m_state.preTransform)
+  {
+    const VkDeviceSize transformedBufferSize = static_cast<VkDeviceSize>(geometry.vertices.size()) * sizeof(TransformedVertex);
+    m_transformedBuffer = m_allocatorDma.createBuffer(transformedBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_debug.setObjectName(m_transformedBuffer.buffer, "m_transformedBuffer");
+  }
+}
+
+// Waits up to timeout nanoseconds for the timeline semaphore to reach the
+// given value, and returns whether it did. (vkWaitSemaphoresKHR, unlike
+// vkGetSemaphoreCounterValueKHR, also makes the work that signaled the value
+// visible to the host.)
+static bool waitForTimeline(VkDevice device, VkSemaphore timeline, uint64_t value, uint64_t timeout)
+{
+  VkSemaphoreWaitInfoKHR waitInfo = nvvk::make<VkSemaphoreWaitInfoKHR>();
+  waitInfo.semaphoreCount         = 1;
+  waitInfo.pSemaphores            = &timeline;
+  waitInfo.pValues                = &value;
+  const VkResult result           = vkWaitSemaphoresKHR(device, &waitInfo, timeout);
+  if(result == VK_TIMEOUT)
+  {
+    return false;
+  }
+  NVVK_CHECK(result);
+  return true;
+}
+
+// Returns barriers that transfer ownership of a scene's buffers between queue
+// families. The transfer queue records them to release the buffers, and the
+// graphics queue to acquire them, with the given access masks.
+static std::array<VkBufferMemoryBarrier, NUM_SCENE_BUFFERS> makeSceneOwnershipBarriers(const std::array<nvvk::Buffer, NUM_SCENE_BUFFERS>& buffers,
+                                                                                       uint32_t      srcQueueFamilyIndex,
+                                                                                       uint32_t      dstQueueFamilyIndex,
+                                                                                       VkAccessFlags srcAccessMask,
+                                                                                       VkAccessFlags dstAccessMask)
+{
+  std::array<VkBufferMemoryBarrier, NUM_SCENE_BUFFERS> barriers;
+  for(uint32_t i = 0; i < NUM_SCENE_BUFFERS; i++)
+  {
+    barriers[i]                     = nvvk::make<VkBufferMemoryBarrier>();
+    barriers[i].srcAccessMask       = srcAccessMask;
+    barriers[i].dstAccessMask       = dstAccessMask;
+    barriers[i].srcQueueFamilyIndex = srcQueueFamilyIndex;
+    barriers[i].dstQueueFamilyIndex = dstQueueFamilyIndex;
+    barriers[i].buffer              = buffers[i].buffer;
+    barriers[i].offset              = 0;
+    barriers[i].size                = VK_WHOLE_SIZE;
+  }
+  return barriers;
+}
+
+void Sample::destroySceneUploadResources()
+{
+  cancelSceneUpload();
+
+  for(nvvk::Buffer& stagingBuffer : m_sceneUpload.stagingBuffers)
+  {
+    m_allocatorDma.destroy(stagingBuffer);
+  }
+  // This also frees the command buffers.
+  vkDestroyCommandPool(m_context, m_sceneUpload.commandPool, nullptr);
+  m_sceneUpload.commandPool = VK_NULL_HANDLE;
+  m_sceneUpload.commandBuffers.fill(VK_NULL_HANDLE);
+  vkDestroySemaphore(m_context, m_sceneUpload.timeline, nullptr);
+  m_sceneUpload.timeline      = VK_NULL_HANDLE;
+  m_sceneUpload.timelineValue = 0;
+}
+
+void Sample::createSceneUploadResources()
+{
+  destroySceneUploadResources();
+  if(!supportsAsyncSceneUpload())
+  {
+    return;
+  }
+
+  VkSemaphoreTypeCreateInfoKHR semaphoreTypeInfo = nvvk::make<VkSemaphoreTypeCreateInfoKHR>();
+  semaphoreTypeInfo.semaphoreType                = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+  semaphoreTypeInfo.initialValue                 = 0;
+  VkSemaphoreCreateInfo semaphoreInfo            = nvvk::make<VkSemaphoreCreateInfo>();
+  semaphoreInfo.pNext                            = &semaphoreTypeInfo;
+  NVVK_CHECK(vkCreateSemaphore(m_context, &semaphoreInfo, nullptr, &m_sceneUpload.timeline));
+  m_debug.setObjectName(m_sceneUpload.timeline, "m_sceneUpload.timeline");
+
+  // Each command buffer is re-recorded whenever its staging buffer is reused.
+  VkCommandPoolCreateInfo commandPoolInfo = nvvk::make<VkCommandPoolCreateInfo>();
+  commandPoolInfo.flags                   = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  commandPoolInfo.queueFamilyIndex        = m_context.m_queueT.familyIndex;
+  NVVK_CHECK(vkCreateCommandPool(m_context, &commandPoolInfo, nullptr, &m_sceneUpload.commandPool));
+
+  VkCommandBufferAllocateInfo commandBufferInfo = nvvk::make<VkCommandBufferAllocateInfo>();
+  commandBufferInfo.commandPool                 = m_sceneUpload.commandPool;
+  commandBufferInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  commandBufferInfo.commandBufferCount          = SCENE_UPLOAD_CHUNKS;
+  NVVK_CHECK(vkAllocateCommandBuffers(m_context, &commandBufferInfo, m_sceneUpload.commandBuffers.data()));
+
+  for(nvvk::Buffer& stagingBuffer : m_sceneUpload.stagingBuffers)
+  {
+    stagingBuffer = m_allocatorDma.createBuffer(SCENE_UPLOAD_CHUNK_SIZE,           // Buffer size
+                                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,  // Usage
+                                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT  // Memory flags
+    );
+    m_debug.setObjectName(stagingBuffer.buffer, "m_sceneUpload.stagingBuffers");
+  }
+}
+
+void Sample::startSceneUpload()
+{
+  cancelSceneUpload();
+
+  m_sceneUpload.active     = true;
+  m_sceneUpload.cancel     = false;
+  m_sceneUpload.nextBuffer = 0;
+  m_sceneUpload.nextOffset = 0;
+  // std::async copies m_state, so the worker thread never reads it while the
+  // GUI changes it.
+  m_sceneUpload.future = std::async(std::launch::async, generateScene, m_state, &m_sceneUpload.cancel);
+}
+
+void Sample::cancelSceneUpload()
+{
+  if(!m_sceneUpload.active)
+  {
+    return;
+  }
+
+  // Stop the worker thread, and wait for the copies that were submitted.
+  m_sceneUpload.cancel = true;
+  if(m_sceneUpload.future.valid())
+  {
+    m_sceneUpload.future.wait();
+    m_sceneUpload.future = std::future<SceneGeometry>();
+  }
+  waitForTimeline(m_context, m_sceneUpload.timeline, m_sceneUpload.timelineValue, UINT64_MAX);
 
-    VkDeviceSize idxBufferSize = static_cast<VkDeviceSize>(completeMesh.getTriangleIndicesSize());
-    m_indexBuffer              = m_allocatorDma.createBuffer(idxBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-    scopedTransfer.cmdToBuffer(cmd, m_indexBuffer.buffer, 0, idxBufferSize, completeMesh.m_indicesTriangles.data());
-    m_debug.setObjectName(m_indexBuffer.buffer, "m_indexBuffer");
+  for(nvvk::Buffer& buffer : m_sceneUpload.buffers)
+  {
+    m_allocatorDma.destroy(buffer);
   }
+  m_sceneUpload.geometry = SceneGeometry();
+  m_sceneUpload.active   = false;
+}
+
+bool Sample::updateSceneUpload()
+{
+  SceneUpload& upload = m_sceneUpload;
+  if(!upload.active)
+  {
+    return false;
+  }
+
+  // Wait for the worker thread without blocking; then, the new scene's
+  // buffers can be created.
+  if(upload.future.valid())
+  {
+    if(upload.future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      return false;
+    }
+    upload.geometry = upload.future.get();
+    createSceneBuffers(upload.geometry, upload.buffers);
+  }
+
+  // Copy chunks of the scene until all of it has been submitted, or until the
+  // next staging buffer is still being copied from. Submission N uses staging
+  // buffer N % SCENE_UPLOAD_CHUNKS, which submission N - SCENE_UPLOAD_CHUNKS
+  // used before; that submission signaled N - SCENE_UPLOAD_CHUNKS + 1.
+  const std::array<SceneGeometry::Contents, NUM_SCENE_BUFFERS> contents = upload.geometry.contents();
+  while(upload.nextBuffer < NUM_SCENE_BUFFERS)
+  {
+    const uint64_t submission = upload.timelineValue;
+    if((submission >= SCENE_UPLOAD_CHUNKS) && !waitForTimeline(m_context, upload.timeline, submission - SCENE_UPLOAD_CHUNKS + 1, 0))
+    {
+      break;
+    }
+    const uint32_t      chunk         = static_cast<uint32_t>(submission % SCENE_UPLOAD_CHUNKS);
+    const nvvk::Buffer& stagingBuffer = upload.stagingBuffers[chunk];
+    VkCommandBuffer     cmdBuffer     = upload.commandBuffers[chunk];
+
+    VkCommandBufferBeginInfo beginInfo = nvvk::make<VkCommandBufferBeginInfo>();
+    beginInfo.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    NVVK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+
+    // Fill the staging buffer with as much of the scene's buffers as fits.
+    uint8_t*     staging       = static_cast<uint8_t*>(m_allocatorDma.map(stagingBuffer));
+    VkDeviceSize stagingOffset = 0;
+    while((upload.nextBuffer < NUM_SCENE_BUFFERS) && (stagingOffset < SCENE_UPLOAD_CHUNK_SIZE))
+    {
+      const SceneGeometry::Contents& source = contents[upload.nextBuffer];
+      const VkDeviceSize size = std::min(source.size - upload.nextOffset, SCENE_UPLOAD_CHUNK_SIZE - stagingOffset);
+      memcpy(staging + stagingOffset, static_cast<const uint8_t*>(source.data) + upload.nextOffset, size);
+
+      VkBufferCopy region;
+      region.srcOffset = stagingOffset;
+      region.dstOffset = upload.nextOffset;
+      region.size      = size;
+      vkCmdCopyBuffer(cmdBuffer, stagingBuffer.buffer, upload.buffers[upload.nextBuffer].buffer, 1, &region);
+
+      stagingOffset += size;
+      upload.nextOffset += size;
+      if(upload.nextOffset == source.size)
+      {
+        upload.nextBuffer++;
+        upload.nextOffset = 0;
+      }
+    }
+    m_allocatorDma.unmap(stagingBuffer);
+
+    // After the last copy, release the buffers to the graphics queue's
+    // family, if it's different; finishSceneUpload acquires them.
+    if((upload.nextBuffer == NUM_SCENE_BUFFERS) && (m_context.m_queueT.familyIndex != m_context.m_queueGCT.familyIndex))
+    {
+      const std::array<VkBufferMemoryBarrier, NUM_SCENE_BUFFERS> barriers =
+          makeSceneOwnershipBarriers(upload.buffers, m_context.m_queueT.familyIndex, m_context.m_queueGCT.familyIndex,
+                                     VK_ACCESS_TRANSFER_WRITE_BIT, 0);
+      vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                           NUM_SCENE_BUFFERS, barriers.data(), 0, nullptr);
+    }
+
+    NVVK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+    upload.timelineValue = submission + 1;
+    VkTimelineSemaphoreSubmitInfoKHR timelineInfo = nvvk::make<VkTimelineSemaphoreSubmitInfoKHR>();
+    timelineInfo.signalSemaphoreValueCount        = 1;
+    timelineInfo.pSignalSemaphoreValues           = &upload.timelineValue;
+    VkSubmitInfo submitInfo                       = nvvk::make<VkSubmitInfo>();
+    submitInfo.pNext                              = &timelineInfo;
+    submitInfo.commandBufferCount                 = 1;
+    submitInfo.pCommandBuffers                    = &cmdBuffer;
+    submitInfo.signalSemaphoreCount               = 1;
+    submitInfo.pSignalSemaphores                  = &upload.timeline;
+    NVVK_CHECK(vkQueueSubmit(m_context.m_queueT.queue, 1, &submitInfo, VK_NULL_HANDLE));
+  }
+
+  // The scene is ready once the last submission has completed.
+  return (upload.nextBuffer == NUM_SCENE_BUFFERS) && waitForTimeline(m_context, upload.timeline, upload.timelineValue, 0);
+}
+
+void Sample::finishSceneUpload(VkCommandBuffer cmdBuffer)
+{
+  SceneUpload& upload = m_sceneUpload;
+
+  if(m_context.m_queueT.familyIndex != m_context.m_queueGCT.familyIndex)
+  {
+    const std::array<VkBufferMemoryBarrier, NUM_SCENE_BUFFERS> barriers =
+        makeSceneOwnershipBarriers(upload.buffers, m_context.m_queueT.familyIndex, m_context.m_queueGCT.familyIndex, 0,
+                                   VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+                         NUM_SCENE_BUFFERS, barriers.data(), 0, nullptr);
+  }
+
+  adoptScene(upload.geometry, upload.buffers);
+  upload.geometry = SceneGeometry();
+  upload.active   = false;
 }
 
 void Sample::destroyFramebuffers()
@@ -506,10 +1106,13 @@ void Sample::destroyFramebuffers()
   vkDestroyFramebuffer(m_context, m_guiFramebuffer, nullptr);
   m_guiFramebuffer = nullptr;
 
-  if(m_weightedFramebuffer != nullptr)
+  for(OitFrameResources& frame : m_oitFrames)
   {
-    vkDestroyFramebuffer(m_context, m_weightedFramebuffer, nullptr);
-    m_weightedFramebuffer = nullptr;
+    if(frame.weightedFramebuffer != nullptr)
+    {
+      vkDestroyFramebuffer(m_context, frame.weightedFramebuffer, nullptr);
+      frame.weightedFramebuffer = nullptr;
+    }
   }
 }
 
@@ -535,24 +1138,29 @@ void Sample::createFramebuffers()
 
   // Weighted color + weighted reveal framebuffer (for Weighted, Blended
   // Order-Independent Transparency). See the render pass description for more info.
+  // There's one per frame-resource set.
   if(m_state.algorithm == OIT_WEIGHTED)
   {
-    std::array<VkImageView, 4> attachments = {m_oitWeightedColorImage.view,   //
-                                              m_oitWeightedRevealImage.view,  //
-                                              m_colorImage.view,              //
-                                              m_depthImage.view};
-
-    VkFramebufferCreateInfo framebufferInfo = nvvk::make<VkFramebufferCreateInfo>();
-    framebufferInfo.renderPass              = m_renderPassWeighted;
-    framebufferInfo.attachmentCount         = static_cast<uint32_t>(attachments.size());
-    framebufferInfo.pAttachments            = attachments.data();
-    framebufferInfo.width                   = m_oitWeightedColorImage.c_width;
-    framebufferInfo.height                  = m_oitWeightedColorImage.c_height;
-    framebufferInfo.layers                  = 1;
-
-    NVVK_CHECK(vkCreateFramebuffer(m_context, &framebufferInfo, nullptr, &m_weightedFramebuffer));
-
-    m_debug.setObjectName(m_weightedFramebuffer, "m_weightedColorRevealFramebuffer");
+    for(uint32_t set = 0; set < m_state.frameResourceSets; set++)
+    {
+      OitFrameResources&         frame       = m_oitFrames[set];
+      std::array<VkImageView, 4> attachments = {frame.weightedColorImage.view,   //
+                                                frame.weightedRevealImage.view,  //
+                                                m_colorImage.view,               //
+                                                m_depthImage.view};
+
+      VkFramebufferCreateInfo framebufferInfo = nvvk::make<VkFramebufferCreateInfo>();
+      framebufferInfo.renderPass              = m_renderPassWeighted;
+      framebufferInfo.attachmentCount         = static_cast<uint32_t>(attachments.size());
+      framebufferInfo.pAttachments            = attachments.data();
+      framebufferInfo.width                   = frame.weightedColorImage.c_width;
+      framebufferInfo.height                  = frame.weightedColorImage.c_height;
+      framebufferInfo.layers                  = 1;
+
+      NVVK_CHECK(vkCreateFramebuffer(m_context, &framebufferInfo, nullptr, &frame.weightedFramebuffer));
+
+      m_debug.setObjectName(frame.weightedFramebuffer, "m_weightedColorRevealFramebuffer");
+    }
   }
 
   // ui related
@@ -636,9 +1244,51 @@ VkPipeline Sample::createGraphicsPipeline(const nvvk::ShaderModuleID& vertShader
                           VK_SHADER_STAGE_VERTEX_BIT  // Stage
   );
 
-  pipelineState.addShader(fragShaderModule,             // Shader module
-                          VK_SHADER_STAGE_FRAGMENT_BIT  // Stage
+  // Set the specialization constants declared in common.h.
+  struct SpecializationData
+  {
+    int32_t  oitLayers;
+    VkBool32 tailBlend;
+    VkBool32 earlyDepth;
+    VkBool32 epochTags;
+    VkBool32 tiledComposite;
+    VkBool32 deferredShading;
+    VkBool32 opacityEarlyOut;
+    VkBool32 opacityCulling;
+    int32_t  colorEncoding;
+    int32_t  aBufferLayout;
+  };
+  const SpecializationData specializationData = {static_cast<int32_t>(m_state.oitLayers),
+                                                 m_state.tailBlend ? VK_TRUE : VK_FALSE, m_state.earlyDepth ? VK_TRUE : VK_FALSE,
+                                                 m_state.usesEpochTags() ? VK_TRUE : VK_FALSE,
+                                                 m_state.usesTiledComposite() ? VK_TRUE : VK_FALSE,
+                                                 m_state.usesDeferredShading() ? VK_TRUE : VK_FALSE,
+                                                 m_state.usesOpacityEarlyOut() ? VK_TRUE : VK_FALSE,
+                                                 m_state.usesOpacityCulling() ? VK_TRUE : VK_FALSE,
+                                                 static_cast<int32_t>(m_state.colorEncoding),
+                                                 static_cast<int32_t>(m_state.aBufferLayout())};
+  const std::array<VkSpecializationMapEntry, 10> specializationEntries = {{
+      {SPEC_OIT_LAYERS, offsetof(SpecializationData, oitLayers), sizeof(int32_t)},
+      {SPEC_OIT_TAILBLEND, offsetof(SpecializationData, tailBlend), sizeof(VkBool32)},
+      {SPEC_USE_EARLYDEPTH, offsetof(SpecializationData, earlyDepth), sizeof(VkBool32)},
+      {SPEC_OIT_EPOCH_TAGS, offsetof(SpecializationData, epochTags), sizeof(VkBool32)},
+      {SPEC_OIT_TILED_COMPOSITE, offsetof(SpecializationData, tiledComposite), sizeof(VkBool32)},
+      {SPEC_OIT_DEFERRED_SHADING, offsetof(SpecializationData, deferredShading), sizeof(VkBool32)},
+      {SPEC_OIT_OPACITY_EARLY_OUT, offsetof(SpecializationData, opacityEarlyOut), sizeof(VkBool32)},
+      {SPEC_OIT_OPACITY_CULLING, offsetof(SpecializationData, opacityCulling), sizeof(VkBool32)},
+      {SPEC_OIT_COLOR_ENCODING, offsetof(SpecializationData, colorEncoding), sizeof(int32_t)},
+      {SPEC_OIT_ABUFFER_LAYOUT, offsetof(SpecializationData, aBufferLayout), sizeof(int32_t)},
+  }};
+  VkSpecializationInfo specializationInfo = {};
+  specializationInfo.mapEntryCount        = static_cast<uint32_t>(specializationEntries.size());
+  specializationInfo.pMapEntries          = specializationEntries.data();
+  specializationInfo.dataSize             = sizeof(specializationData);
+  specializationInfo.pData                = &specializationData;
+
+  VkPipelineShaderStageCreateInfo& fragStage = pipelineState.addShader(fragShaderModule,             // Shader module
+                                                                       VK_SHADER_STAGE_FRAGMENT_BIT  // Stage
   );
+  fragStage.pSpecializationInfo = &specializationInfo;
 
   if(usesVertexInput)
   {
@@ -673,6 +1323,8 @@ VkPipeline Sample::createGraphicsPipeline(const nvvk::ShaderModuleID& vertShader
   pipelineState.setViewport(0, viewport);
   pipelineState.setScissorsCount(1);
   pipelineState.setScissor(0, scissor);
+  // render() sets the scissor rectangle to each band when rendering in bands.
+  pipelineState.addDynamicStateEnable(VK_DYNAMIC_STATE_SCISSOR);
 
   // Enable backface culling
   pipelineState.rasterizationState.cullMode        = (isDoubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT);
@@ -764,6 +1416,12 @@ VkPipeline Sample::createGraphicsPipeline(const nvvk::ShaderModuleID& vertShader
   pipelineState.setRenderPass(renderPass);
   pipelineState.createInfo.subpass = subpass;
 
+  // Ask the driver to keep shader statistics for oitStatistics.cpp.
+  if(supportsPipelineExecutableStatistics())
+  {
+    pipelineState.createInfo.flags |= VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR;
+  }
+
   VkPipeline pipeline = pipelineState.createPipeline();
   if(pipeline == VK_NULL_HANDLE)
   {
@@ -802,14 +1460,34 @@ void Sample::updateUniformBuffer(uint32_t currentImage, double time)
   const uint32_t width       = m_colorImage.c_width;
   const uint32_t height      = m_colorImage.c_height;
   const float    aspectRatio = static_cast<float>(width) / static_cast<float>(height);
-  nvmath::mat4   projection  = nvmath::perspectiveVK(45.0f, aspectRatio, 0.01f, 50.0f);
+  const float    fovY        = 45.0f;  // In degrees
+  nvmath::mat4   projection  = nvmath::perspectiveVK(fovY, aspectRatio, 0.01f, 50.0f);
   nvmath::mat4   view        = m_cameraControl.m_viewMatrix;
 
   m_sceneUbo.projViewMatrix             = projection * view;
   m_sceneUbo.viewMatrix                 = view;
   m_sceneUbo.viewMatrixInverseTranspose = nvmath::transpose(nvmath::invert(view));
 
-  m_sceneUbo.viewport = nvmath::ivec3(width, height, width * height);
+  // The A-buffer only covers a single band of rows.
+  const uint32_t bandHeight = m_state.bandHeight(height);
+  m_sceneUbo.viewport       = nvmath::ivec3(width, bandHeight, width * bandHeight);
+  m_sceneUbo.colorSize      = nvmath::ivec2(width, height);
+
+  m_sceneUbo.transparentObjects = static_cast<uint32_t>(getNumTransparentObjects());
+
+  // A sphere with angular radius a covers about a * pixelsPerRadian pixels of
+  // radius, so the edges of a level of detail with n rows of triangles are
+  // about pi * a * pixelsPerRadian / n pixels long. Level L is fine enough
+  // while that's at least lodTriangleSize.
+  const float pixelsPerRadian = static_cast<float>(height) / (2.0f * std::tan(fovY * 0.5f * nv_pi / 180.0f));
+  for(uint32_t lod = 0; lod < MAX_LODS; lod++)
+  {
+    const float rows             = static_cast<float>(std::max(2u, m_sceneSubdiv >> lod));
+    m_sceneUbo.lodMinRadius[lod] = m_state.usesLod() ? (m_state.lodTriangleSize * rows / (nv_pi * pixelsPerRadian)) : 0.0f;
+  }
+
+  // Each frame-resource set has its own A-buffer.
+  m_sceneUbo.aBufferAddress = currentOitFrame().aBufferAddress;
 
   void* data = m_allocatorDma.map(m_uniformBuffers[currentImage]);
   memcpy(data, &m_sceneUbo, sizeof(m_sceneUbo));
@@ -849,6 +1527,7 @@ void Sample::copyOffscreenToBackBuffer(int winWidth, int winHeight, ImDrawData*
   // Start a separate command buffer for this function.
   VkCommandBuffer          cmdBuffer = createTempCmdBuffer();
   nvh::Profiler::SectionID sec       = m_profilerVK.beginSection("CopyOffscreenToBackBuffer", cmdBuffer);
+  const uint32_t           traceZone = m_trace.cmdBeginGpuZone(cmdBuffer, "CopyOffscreenToBackBuffer");
 
   // Prepare to transfer from m_colorImage; check its initial state for soundness
   assert(m_colorImage.currentLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -1007,6 +1686,7 @@ void Sample::copyOffscreenToBackBuffer(int winWidth, int winHeight, ImDrawData*
   m_colorImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                             VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
 
+  m_trace.cmdEndGpuZone(cmdBuffer, traceZone);
   m_profilerVK.endSection(sec, cmdBuffer);
 
   vkEndCommandBuffer(cmdBuffer);
@@ -1043,17 +1723,55 @@ void Sample::think(double time)
   int    height         = m_windowState.m_swapSize[1];
   double frameStartTime = getTime();
 
+  // Finish recording a trace once it has captured enough frames. We do this
+  // before the frame's zones start, so that every recorded frame is complete.
+  if(m_trace.isRecording() && m_frame >= m_traceEndFrame)
+  {
+    if(m_trace.stop(TRACE_FILENAME))
+    {
+      LOGI("Wrote trace to %s\n", TRACE_FILENAME);
+    }
+    else
+    {
+      LOGW("Could not write trace to %s\n", TRACE_FILENAME);
+    }
+  }
+
+  m_trace.beginFrame(m_frame);
+  const TraceRecorder::CpuZone frameZone(m_trace, "Frame");
+
   // Create Dear ImGui interface
-  DoGUI(width, height, time);
+  {
+    const TraceRecorder::CpuZone zone(m_trace, "DoGUI");
+    DoGUI(width, height, time);
+  }
+
+  // If auto-tuning is enabled, this may change the algorithm and A-buffer sizes.
+  {
+    const TraceRecorder::CpuZone zone(m_trace, "AutoTune");
+    autoTuneState();
+  }
 
   // If elements of m_state change, this reinitializes parts of the renderer.
-  updateRendererImmediate(false, false);
+  {
+    const TraceRecorder::CpuZone zone(m_trace, "UpdateRendererImmediate");
+    updateRendererImmediate(false, false);
+  }
 
   // Begin frame
   {
+    const TraceRecorder::CpuZone zone(m_trace, "WaitForFrame");
     m_submissionWaitForRead = true;
     m_ringFences.setCycleAndWait(m_frame);
     m_ringCmdPool.setCycle(m_ringFences.getCycleIndex());
+    // The frame that last used this cycle has finished, so we can read its statistics.
+    collectDepthComplexity();
+    collectPassStatistics();
+    m_trace.collectCycle(m_ringFences.getCycleIndex());
+    // Alternate between frame-resource sets, so that this frame's clear
+    // doesn't have to wait for the previous frame's composite pass. Each set
+    // costs another A-buffer and set of auxiliary images.
+    m_oitFrameIndex = m_frame % m_state.frameResourceSets;
   }
 
   // Update camera
@@ -1062,11 +1780,16 @@ void Sample::think(double time)
                                  m_windowState.m_mouseButtonFlags, m_windowState.m_mouseWheel);
 
   // Update the GPU's uniform buffer
-  updateUniformBuffer(m_swapChain.getActiveImageIndex(), frameStartTime);
+  {
+    const TraceRecorder::CpuZone zone(m_trace, "UpdateUniformBuffer");
+    updateUniformBuffer(m_swapChain.getActiveImageIndex(), frameStartTime);
+  }
 
   // Record this frame's command buffer
   VkCommandBuffer cmdBuffer = m_ringCmdPool.createCommandBuffer();
   {
+    const TraceRecorder::CpuZone zone(m_trace, "Record");
+    m_trace.cmdBeginCycle(cmdBuffer, m_ringFences.getCycleIndex());
     render(cmdBuffer);
     NVVK_CHECK(vkEndCommandBuffer(cmdBuffer));
     m_submission.enqueue(cmdBuffer);
@@ -1074,17 +1797,19 @@ void Sample::think(double time)
 
   // Render Dear ImGui and translate the internal image to the swapchain
   {
+    const TraceRecorder::CpuZone zone(m_trace, "CopyOffscreenToBackBuffer");
     ImGui::Render();
     copyOffscreenToBackBuffer(width, height, ImGui::GetDrawData());
   }
 
   // End frame
   {
+    const TraceRecorder::CpuZone zone(m_trace, "Submit");
     submissionExecute(m_ringFences.getFence(), true, true);
-    m_frame++;
-    ImGui::EndFrame();
-    m_lastState = m_state;
   }
+  m_frame++;
+  ImGui::EndFrame();
+  m_lastState = m_state;
 }
 
 int main(int argc, const char** argv)
@@ -1103,6 +1828,24 @@ int main(int argc, const char** argv)
   // These extensions are both optional - there are algorithms we can use if we have them, but
   // if the device doesn't support these extensions, we don't allow the user to select those algorithms.
   sample.m_contextInfo.addDeviceExtension(VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME, true);
+  // VK_EXT_memory_budget is optional as well; without it, auto-tuning uses the size of the memory heaps.
+  sample.m_contextInfo.addDeviceExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, true);
+  // VK_KHR_buffer_device_address lets us address A-buffers larger than a texel
+  // buffer view or storage buffer descriptor allows.
+  VkPhysicalDeviceBufferDeviceAddressFeaturesKHR bufferDeviceAddressFeatures = nvvk::make<VkPhysicalDeviceBufferDeviceAddressFeaturesKHR>();
+  bufferDeviceAddressFeatures.bufferDeviceAddress = VK_TRUE;
+  sample.m_contextInfo.addDeviceExtension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, true, &bufferDeviceAddressFeatures);
+  // VK_EXT_calibrated_timestamps lets traces line up CPU and GPU zones without
+  // stalling the GPU to calibrate.
+  sample.m_contextInfo.addDeviceExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME, true);
+  // VK_KHR_timeline_semaphore lets asynchronous scene uploads track their
+  // transfer submissions with a single semaphore.
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphoreFeatures = nvvk::make<VkPhysicalDeviceTimelineSemaphoreFeaturesKHR>();
+  timelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+  sample.m_contextInfo.addDeviceExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, true, &timelineSemaphoreFeatures);
+  // VK_KHR_draw_indirect_count lets frustum culling draw a GPU-computed
+  // number of objects.
+  sample.m_contextInfo.addDeviceExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, true);
   // VK_EXT_FRAGMENT_SHADER_INTERLOCK uses an extension which will be passed to device creation via
   // VkDeviceCreateInfo's pNext chain:
   VkPhysicalDeviceFragmentShaderInterlockFeaturesEXT m_fragmentShaderInterlockFeatures{
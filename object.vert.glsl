@@ -23,17 +23,33 @@
 
 #include "shaderCommon.glsl"
 
+// With OIT_COMPRESSED_VERTICES, there are no vertex attributes; we fetch and
+// decode each vertex ourselves (vertex pulling).
+#if OIT_COMPRESSED_VERTICES
+#include "sceneVertex.glsl"
+#else
 layout(location = VERTEX_POS) in vec3 inPosition;
 layout(location = VERTEX_NORMAL) in vec3 inNormal;
 layout(location = VERTEX_COLOR) in vec4 inColor;
+#endif
 
 layout(location = 0) out Interpolants OUT;
+layout(location = OBJECT_ID_LOCATION) flat out uint outObjectID;
 
 void main()
 {
+#if OIT_COMPRESSED_VERTICES
+  const SceneVertex vertex     = loadSceneVertex(uint(gl_VertexIndex));
+  const vec3        inPosition = vertex.position;
+  const vec3        inNormal   = vertex.normal;
+  const vec4        inColor    = vertex.color;
+#endif
+
   gl_Position = scene.projViewMatrix * vec4(inPosition, 1.0);
   OUT.depth   = (scene.viewMatrix * vec4(inPosition, 1.0)).z;
   OUT.pos     = inPosition;
   OUT.normal  = inNormal;
   OUT.color   = inColor;
+  // All objects have the same number of vertices, and are stored in order.
+  outObjectID = uint(gl_VertexIndex) / scene.verticesPerObject;
 }
\ No newline at end of file
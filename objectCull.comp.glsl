@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Tests each object's bounding sphere against the view frustum, and appends a
+// VkDrawIndexedIndirectCommand for each visible object to the opaque or
+// transparent list of the draw command buffer. Each invocation handles one
+// object. Sample::cmdCullObjects resets both counts to 0 beforehand, and
+// draws use them with vkCmdDrawIndexedIndirectCountKHR.
+//
+// CULL_PASS selects which objects this handles; see CULL_PASS_ALL in
+// common.h. The CULL_PASS_OCCLUSION pass runs after the opaque draw, and also
+// drops transparent objects hidden behind opaque geometry.
+//
+// Each command draws the object's level of detail chosen by sphereLod.
+
+#include "common.h"
+
+#ifndef CULL_PASS
+#define CULL_PASS CULL_PASS_ALL
+#endif
+
+#if CULL_PASS == CULL_PASS_OCCLUSION
+#include "hiZ.glsl"
+#endif
+
+layout(local_size_x = CULL_WORKGROUP_SIZE) in;
+
+// The world-space center (xyz) and radius (w) of each object.
+layout(binding = IMG_OBJECT_BOUNDS, std430) restrict readonly buffer objectBoundsBuffer
+{
+  vec4 objectBounds[];
+};
+
+struct DrawIndexedCommand
+{
+  uint indexCount;
+  uint instanceCount;
+  uint firstIndex;
+  int  vertexOffset;
+  uint firstInstance;
+};
+
+// Opaque objects' commands start at commands[0], and transparent objects'
+// commands start at commands[objectBounds.length()].
+layout(binding = IMG_DRAW_COMMANDS, std430) restrict buffer drawCommandBuffer
+{
+  uint               opaqueCount;
+  uint               transparentCount;
+  uint               headerPadding[DRAW_COMMANDS_HEADER_UINTS - 2];
+  DrawIndexedCommand commands[];
+};
+
+// Returns whether a sphere is at least partially inside the frustum of
+// scene.projViewMatrix. The planes are combinations of the matrix's rows;
+// since Vulkan's clip-space depth ranges from 0 to w, the near plane is just
+// the third row.
+bool sphereInFrustum(vec4 sphere)
+{
+  const mat4 m = transpose(scene.projViewMatrix);  // m[i] is row i
+  vec4       planes[6];
+  planes[0] = m[3] + m[0];  // Left
+  planes[1] = m[3] - m[0];  // Right
+  planes[2] = m[3] + m[1];  // Top
+  planes[3] = m[3] - m[1];  // Bottom
+  planes[4] = m[2];         // Near
+  planes[5] = m[3] - m[2];  // Far
+
+  for(int i = 0; i < 6; i++)
+  {
+    if(dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w * length(planes[i].xyz))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+#if CULL_PASS == CULL_PASS_OCCLUSION
+// Returns whether a sphere is hidden behind the opaque geometry. We project
+// the corners of the sphere's bounding box to get a conservative rectangle of
+// pixels and the nearest depth it could have, then compare that depth to the
+// farthest depth in the Hi-Z texels covering the rectangle. We use the level
+// where the rectangle is at most a texel wide, so it touches at most 2x2
+// texels.
+bool sphereOccluded(vec4 sphere)
+{
+  vec2  minNdc  = vec2(1.0);
+  vec2  maxNdc  = vec2(-1.0);
+  float nearest = 1.0;
+  for(int i = 0; i < 8; i++)
+  {
+    const vec3 side   = vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) * 2.0 - 1.0;
+    const vec4 clip   = scene.projViewMatrix * vec4(sphere.xyz + sphere.w * side, 1.0);
+    if(clip.w <= 0.0)
+    {
+      // The box reaches behind the camera.
+      return false;
+    }
+    const vec3 ndc = clip.xyz / clip.w;
+    minNdc         = min(minNdc, ndc.xy);
+    maxNdc         = max(maxNdc, ndc.xy);
+    nearest        = min(nearest, ndc.z);
+  }
+
+  const vec2 imageSize = vec2(scene.colorSize);
+  const vec2 minPixel  = clamp((minNdc * 0.5 + 0.5) * imageSize, vec2(0.0), imageSize - 1.0);
+  const vec2 maxPixel  = clamp((maxNdc * 0.5 + 0.5) * imageSize, vec2(0.0), imageSize - 1.0);
+
+  // A texel of level L covers 2^(L+1) x 2^(L+1) pixels.
+  const float extent = max(max(maxPixel.x - minPixel.x, maxPixel.y - minPixel.y), 1.0);
+  const uint  level  = min(uint(max(ceil(log2(extent)) - 1.0, 0.0)), hiZNumLevels() - 1);
+
+  const ivec2 size     = hiZLevelSize(level);
+  const uint  offset   = hiZLevelOffset(level);
+  const ivec2 minTexel = min(ivec2(minPixel) >> (level + 1), size - 1);
+  const ivec2 maxTexel = min(ivec2(maxPixel) >> (level + 1), size - 1);
+  float       farthest = 0.0;
+  for(int y = minTexel.y; y <= maxTexel.y; y++)
+  {
+    for(int x = minTexel.x; x <= maxTexel.x; x++)
+    {
+      farthest = max(farthest, hiZ[offset + uint(y * size.x + x)]);
+    }
+  }
+  return nearest > farthest;
+}
+#endif
+
+// Returns the level of detail to draw a sphere with: the finest one whose
+// triangles are still large enough on screen (see SceneData::lodMinRadius),
+// so that distant spheres don't produce sub-pixel triangles. Spheres that
+// contain the camera, and all spheres without State::usesLod, use level 0.
+uint sphereLod(vec4 sphere)
+{
+  const vec3  camera   = -(transpose(mat3(scene.viewMatrix)) * scene.viewMatrix[3].xyz);
+  const float distance = length(sphere.xyz - camera);
+  if(distance <= sphere.w)
+  {
+    return 0;
+  }
+
+  const float angularRadius = sphere.w / distance;
+  uint        lod           = 0;
+  while(lod < MAX_LODS - 1 && angularRadius < scene.lodMinRadius[lod])
+  {
+    lod++;
+  }
+  return lod;
+}
+
+void main()
+{
+  const uint object     = gl_GlobalInvocationID.x;
+  const uint numObjects = uint(objectBounds.length());
+  if(object >= numObjects || !sphereInFrustum(objectBounds[object]))
+  {
+    return;
+  }
+#if CULL_PASS == CULL_PASS_OPAQUE
+  if(object < scene.transparentObjects)
+  {
+    return;
+  }
+#elif CULL_PASS == CULL_PASS_OCCLUSION
+  if(object >= scene.transparentObjects || sphereOccluded(objectBounds[object]))
+  {
+    return;
+  }
+#endif
+
+  const uint lod = sphereLod(objectBounds[object]);
+
+  DrawIndexedCommand command;
+  command.indexCount    = scene.lodIndexCount[lod];
+  command.instanceCount = 1;
+  command.firstIndex    = scene.lodFirstIndex[lod] + object * scene.lodIndexCount[lod];
+  command.vertexOffset  = int(object * scene.vertexOffsetPerObject);
+  command.firstInstance = 0;
+
+  if(object < scene.transparentObjects)
+  {
+    commands[numObjects + atomicAdd(transparentCount, 1u)] = command;
+  }
+  else
+  {
+    commands[atomicAdd(opaqueCount, 1u)] = command;
+  }
+}
@@ -23,22 +23,257 @@
 // render passes, descriptor sets, and A-buffers, but not swapchain creation.)
 
 #include "oit.h"
+#include <algorithm>
+#include <cstdio>
+#include <nvh/nvprint.hpp>
 #include <nvvk/error_vk.hpp>
 #include <nvvk/renderpasses_vk.hpp>
 
+// The maximum number of bands downgradeStateForMemory will split a frame into.
+static const uint32_t MAX_MEMORY_BANDS = 16;
+
+// Reduces the memory the frame images need for the given state by one step.
+// First stops overlapping frames, then renders in more bands (both of which
+// keep the image the same), then halves the A-buffer, then reduces the
+// antialiasing mode, and finally falls back to OIT_WEIGHTED. Returns false if
+// the state can't be reduced.
+static bool downgradeStateForMemory(State& state)
+{
+  if(state.frameResourceSets > 1)
+  {
+    state.frameResourceSets = 1;
+    return true;
+  }
+
+  if(state.algorithm != OIT_WEIGHTED && state.bands < MAX_MEMORY_BANDS)
+  {
+    state.bands = std::max(1u, state.bands) * 2;
+    return true;
+  }
+
+  switch(state.algorithm)
+  {
+    case OIT_WEIGHTED:
+      break;
+    case OIT_LINKEDLIST:
+      if(state.linkedListAllocatedPerElement > 1)
+      {
+        state.linkedListAllocatedPerElement /= 2;
+        return true;
+      }
+      break;
+    default:
+      if(state.oitLayers > 1)
+      {
+        state.oitLayers /= 2;
+        return true;
+      }
+      break;
+  }
+
+  switch(state.aaType)
+  {
+    case AA_SSAA_8X:
+      state.aaType = AA_SSAA_4X;
+      return true;
+    case AA_SSAA_4X:
+    case AA_MSAA_8X:
+      state.aaType = AA_MSAA_4X;
+      return true;
+    case AA_MSAA_4X:
+    case AA_SUPER_4X:
+      state.aaType = AA_NONE;
+      return true;
+    default:
+      break;
+  }
+
+  if(state.algorithm != OIT_WEIGHTED)
+  {
+    state.algorithm = OIT_WEIGHTED;
+    return true;
+  }
+
+  return false;
+}
+
+FrameImagePlan Sample::planFrameImages(const State& state) const
+{
+  State s = state;
+  s.recomputeAntialiasingSettings();
+  const ABufferRequirements req = s.getABufferRequirements();
+
+  const VkDeviceSize swapchainPixels =
+      static_cast<VkDeviceSize>(m_windowState.m_swapSize[0]) * static_cast<VkDeviceSize>(m_windowState.m_swapSize[1]);
+  const VkDeviceSize pixels    = swapchainPixels * s.supersample * s.supersample;
+  const VkDeviceSize samples   = pixels * s.msaa;
+  const VkDeviceSize auxLayers = (s.sampleShading ? s.msaa : 1);
+  // The A-buffer and auxiliary images only cover a single band.
+  const uint32_t     bufferWidth  = m_windowState.m_swapSize[0] * s.supersample;
+  const uint32_t     bufferHeight = m_windowState.m_swapSize[1] * s.supersample;
+  const VkDeviceSize bandPixels   = static_cast<VkDeviceSize>(bufferWidth) * s.bandHeight(bufferHeight);
+
+  FrameImagePlan plan;
+  plan.color   = samples * sizeof(uint32_t);          // VK_FORMAT_B8G8R8A8_SRGB
+  plan.depth   = samples * sizeof(float);             // Depends on findDepthFormat
+  if(s.usesOcclusionCulling())
+  {
+    plan.depth += State::hiZTexels(bufferWidth, bufferHeight) * sizeof(float);
+  }
+  if(s.usesSphereImpostors())
+  {
+    plan.depth += bandPixels * auxLayers * sizeof(float);
+  }
+  plan.resolve = swapchainPixels * sizeof(uint32_t) * 2;  // Same formats as m_colorImage and the swapchain
+
+  // Each frame-resource set has its own copy of the A-buffer, auxiliary
+  // images, and weighted images.
+  const VkDeviceSize sets = std::max(1u, std::min(s.frameResourceSets, MAX_FRAME_RESOURCE_SETS));
+
+  plan.aBufferEntries = s.aBufferPixels(bufferWidth, s.bandHeight(bufferHeight)) * req.elementsPerPixel;
+  plan.aBuffer        = plan.aBufferEntries * req.strideBytes * sets;
+
+  const VkDeviceSize auxImageBytes = bandPixels * auxLayers * sizeof(uint32_t);
+  plan.aux += (req.allocAux ? auxImageBytes : 0);
+  plan.aux += (req.allocAuxSpin ? auxImageBytes : 0);
+  plan.aux += (req.allocAuxDepth ? auxImageBytes : 0);
+  plan.aux += (req.allocAuxOpacity ? auxImageBytes : 0);
+  plan.aux += (req.allocCounter ? sizeof(uint32_t) : 0);
+  plan.aux *= sets;
+
+  if(s.algorithm == OIT_WEIGHTED)
+  {
+    // RGBA16F color and R16F reveal
+    plan.weighted = samples * (4 * sizeof(uint16_t) + sizeof(uint16_t)) * sets;
+  }
+
+  // Texel buffer views are limited by maxTexelBufferElements, and storage
+  // buffer descriptors by maxStorageBufferRange. Buffer device addresses
+  // don't have these limits, but OIT_LINKEDLIST always uses 32-bit offsets.
+  const VkPhysicalDeviceLimits& limits = m_context.m_physicalInfo.properties10.limits;
+  if(s.algorithm == OIT_LINKEDLIST && plan.aBufferEntries > UINT32_MAX)
+  {
+    plan.exceedsDeviceLimits = true;
+  }
+  else if(s.aBufferDeviceAddress)
+  {
+    plan.exceedsDeviceLimits = false;
+  }
+  else if(s.algorithm == OIT_LOOP64)
+  {
+    plan.exceedsDeviceLimits = (plan.aBufferEntries * req.strideBytes > limits.maxStorageBufferRange);
+  }
+  else
+  {
+    plan.exceedsDeviceLimits = (plan.aBufferEntries > limits.maxTexelBufferElements);
+  }
+
+  return plan;
+}
+
+bool Sample::supportsABufferDeviceAddress() const
+{
+  // 64-bit indices need shaderInt64.
+  return m_context.hasDeviceExtension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)
+         && (m_context.m_physicalInfo.features10.shaderInt64 == VK_TRUE);
+}
+
+bool Sample::supportsFrustumCulling() const
+{
+  return m_context.hasDeviceExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+}
+
+bool Sample::supportsAsyncSceneUpload() const
+{
+  return m_context.hasDeviceExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+}
+
+VkDeviceSize Sample::getFrameImageMemoryBudget() const
+{
+  VkDeviceSize budget = 0;
+  VkDeviceSize usage  = 0;
+  getDeviceLocalMemoryBudget(m_context.m_physicalDevice, m_context.hasDeviceExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME),
+                             budget, usage);
+
+  // The current frame images are freed before the new ones are allocated.
+  // We only use three quarters of the remaining memory, so that we leave
+  // some room for other applications and for fragmentation.
+  const VkDeviceSize available = (budget > usage ? budget - usage : 0);
+  return m_frameImagePlan.totalBytes() + (available / 4) * 3;
+}
+
+void Sample::fitStateToMemoryBudget()
+{
+  FrameImagePlan plan = planFrameImages(m_state);
+
+  // If the new resources aren't larger than the current ones, they fit.
+  if(!plan.exceedsDeviceLimits && plan.totalBytes() <= m_frameImagePlan.totalBytes())
+  {
+    return;
+  }
+
+  const VkDeviceSize budget = getFrameImageMemoryBudget();
+  m_frameImageBudget        = budget;
+  if(!plan.exceedsDeviceLimits && plan.totalBytes() <= budget)
+  {
+    return;
+  }
+
+  // If the A-buffer is only too large for a descriptor, we can keep the
+  // requested settings by using 64-bit addressing instead.
+  if(plan.exceedsDeviceLimits && !m_state.aBufferDeviceAddress && supportsABufferDeviceAddress())
+  {
+    m_state.aBufferDeviceAddress = true;
+    plan                         = planFrameImages(m_state);
+    if(!plan.exceedsDeviceLimits && plan.totalBytes() <= budget)
+    {
+      m_frameImagePlanMessage = "The A-buffer exceeds descriptor limits, so it now uses buffer device addresses.";
+      LOGI("%s\n", m_frameImagePlanMessage.c_str());
+      return;
+    }
+  }
+
+  const State        requested      = m_state;
+  const VkDeviceSize requestedBytes = plan.totalBytes();
+  while((plan.exceedsDeviceLimits || plan.totalBytes() > budget) && downgradeStateForMemory(m_state))
+  {
+    m_state.recomputeAntialiasingSettings();
+    plan = planFrameImages(m_state);
+  }
+
+  char message[256];
+  snprintf(message, sizeof(message), "Requested settings need %.1f MB%s, but the budget is %.1f MB; reduced them to use %.1f MB.",
+           static_cast<double>(requestedBytes) / (1024.0 * 1024.0),
+           (planFrameImages(requested).exceedsDeviceLimits ? " and exceed device limits" : ""),
+           static_cast<double>(budget) / (1024.0 * 1024.0), static_cast<double>(plan.totalBytes()) / (1024.0 * 1024.0));
+  m_frameImagePlanMessage = message;
+  LOGW("%s\n", message);
+}
+
 void Sample::destroyFrameImages()
 {
   m_colorImage.destroy(m_context, m_allocatorDma);
   m_depthImage.destroy(m_context, m_allocatorDma);
-  m_oitABuffer.destroy(m_context, m_allocatorDma);
-  m_oitAuxImage.destroy(m_context, m_allocatorDma);
-  m_oitAuxSpinImage.destroy(m_context, m_allocatorDma);
-  m_oitAuxDepthImage.destroy(m_context, m_allocatorDma);
-  m_oitCounterImage.destroy(m_context, m_allocatorDma);
-  m_oitWeightedColorImage.destroy(m_context, m_allocatorDma);
-  m_oitWeightedRevealImage.destroy(m_context, m_allocatorDma);
+  m_allocatorDma.destroy(m_hiZBuffer);
+  m_allocatorDma.destroy(m_opaqueDepthBuffer);
+  for(OitFrameResources& frame : m_oitFrames)
+  {
+    frame.aBuffer.destroy(m_context, m_allocatorDma);
+    frame.auxImage.destroy(m_context, m_allocatorDma);
+    frame.auxSpinImage.destroy(m_context, m_allocatorDma);
+    frame.auxDepthImage.destroy(m_context, m_allocatorDma);
+    frame.auxOpacityImage.destroy(m_context, m_allocatorDma);
+    frame.counterImage.destroy(m_context, m_allocatorDma);
+    frame.weightedColorImage.destroy(m_context, m_allocatorDma);
+    frame.weightedRevealImage.destroy(m_context, m_allocatorDma);
+    frame.tileMask.destroy(m_context, m_allocatorDma);
+    frame.tileList.destroy(m_context, m_allocatorDma);
+    frame.aBufferAddress = uvec2(0, 0);
+  }
+  m_oitFrameIndex = 0;
   m_downsampleImage.destroy(m_context, m_allocatorDma);
   m_guiCompositeImage.destroy(m_context, m_allocatorDma);
+  m_frameImagePlan = FrameImagePlan();
 }
 
 void Sample::createFrameImages(VkCommandBuffer cmdBuffer)
@@ -50,6 +285,11 @@ void Sample::createFrameImages(VkCommandBuffer cmdBuffer)
   // We implement supersample anti-aliasing by rendering to a larger texture.
   const int bufferWidth  = swapchainWidth * m_state.supersample;
   const int bufferHeight = swapchainHeight * m_state.supersample;
+  // The A-buffer and auxiliary images only need to cover a single band.
+  const int bandHeight = static_cast<int>(m_state.bandHeight(bufferHeight));
+  // Track how much memory we're using, so that fitStateToMemoryBudget can
+  // take into account that these will be freed on the next reallocation.
+  m_frameImagePlan = planFrameImages(m_state);
 
   // Offscreen color and depth buffer
   {
@@ -62,10 +302,32 @@ void Sample::createFrameImages(VkCommandBuffer cmdBuffer)
     // Depth image
     VkFormat depthFormat = nvvk::findDepthFormat(m_context.m_physicalDevice);
 
+    // Occlusion culling reads it to build the Hi-Z pyramid, and sphere
+    // impostors copy it to m_opaqueDepthBuffer.
+    VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if(m_state.usesOcclusionCulling() || m_state.usesSphereImpostors())
+    {
+      depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
     m_depthImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT, depthFormat,
-                        bufferWidth, bufferHeight, 1, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, m_state.msaa);
+                        bufferWidth, bufferHeight, 1, depthUsage, m_state.msaa);
     m_depthImage.setName(m_debug, "m_depthImage");
 
+    if(m_state.usesOcclusionCulling())
+    {
+      const VkDeviceSize hiZBufferSize = State::hiZTexels(bufferWidth, bufferHeight) * sizeof(float);
+      m_hiZBuffer = m_allocatorDma.createBuffer(hiZBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+      m_debug.setObjectName(m_hiZBuffer.buffer, "m_hiZBuffer");
+    }
+
+    if(m_state.usesSphereImpostors())
+    {
+      const VkDeviceSize opaqueDepthBufferSize = static_cast<VkDeviceSize>(bufferWidth) * static_cast<VkDeviceSize>(bandHeight)
+                                                 * (m_state.sampleShading ? m_state.msaa : 1) * sizeof(float);
+      m_opaqueDepthBuffer = m_allocatorDma.createBuffer(opaqueDepthBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+      m_debug.setObjectName(m_opaqueDepthBuffer.buffer, "m_opaqueDepthBuffer");
+    }
+
     // Intermediate storage for resolve - 1spp, swapchain sized, with the same format as the color image.
     m_downsampleImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
                              m_colorImage.c_format, swapchainWidth, swapchainHeight, 1,
@@ -87,145 +349,150 @@ void Sample::createFrameImages(VkCommandBuffer cmdBuffer)
 
   // A-buffers
 
-  // Compute which buffers we need to allocate and their sizes
-  VkDeviceSize aBufferElementsPerSample = 1;
-  VkDeviceSize aBufferStrideBytes       = 0;
-  VkFormat     aBufferFormat            = VK_FORMAT_UNDEFINED;
-
-  bool allocCounter  = false;
-  bool allocAux      = false;
-  bool allocAuxSpin  = false;
-  bool allocAuxDepth = false;
+  // Compute which buffers we need to allocate and their sizes. The
+  // requirements are shared with estimateABufferBytes, so that the auto-tuner
+  // sees the same sizes we allocate here.
+  const ABufferRequirements req = m_state.getABufferRequirements();
 
-  // Mode  Coverage  Sample
-  // 1x    False     False
-  // MSAA  True      False
-  // SSAA  False     True
-  const bool coverageShading = m_state.coverageShading();
-  const bool sampleShading   = m_state.sampleShading;
+  const bool         sampleShading  = m_state.sampleShading;
+  const VkDeviceSize aBufferEntries = m_state.aBufferPixels(bufferWidth, bandHeight) * req.elementsPerPixel;
 
   switch(m_state.algorithm)
   {
-    case OIT_SIMPLE:
-      allocAux                                 = true;
-      aBufferElementsPerSample                 = m_state.oitLayers;
-      aBufferStrideBytes                       = coverageShading ? sizeof(uvec4) : sizeof(uvec2);
-      aBufferFormat                            = coverageShading ? VK_FORMAT_R32G32B32A32_UINT : VK_FORMAT_R32G32_UINT;
-      m_sceneUbo.linkedListAllocatedPerElement = m_state.oitLayers;
-      break;
-    case OIT_INTERLOCK:
-    case OIT_SPINLOCK:
-      allocAux                                 = true;
-      allocAuxSpin                             = (m_state.algorithm == OIT_SPINLOCK);
-      allocAuxDepth                            = true;
-      aBufferElementsPerSample                 = m_state.oitLayers;
-      aBufferStrideBytes                       = coverageShading ? sizeof(uvec4) : sizeof(uvec2);
-      aBufferFormat                            = coverageShading ? VK_FORMAT_R32G32B32A32_UINT : VK_FORMAT_R32G32_UINT;
-      m_sceneUbo.linkedListAllocatedPerElement = m_state.oitLayers;
-      break;
     case OIT_LINKEDLIST:
-      allocAux                                 = true;
-      allocCounter                             = true;
-      aBufferElementsPerSample                 = m_state.linkedListAllocatedPerElement;
-      aBufferStrideBytes                       = sizeof(uvec4);
-      aBufferFormat                            = VK_FORMAT_R32G32B32A32_UINT;
-      m_sceneUbo.linkedListAllocatedPerElement = m_state.linkedListAllocatedPerElement * bufferWidth * bufferHeight;
-      break;
-    case OIT_LOOP:
-      allocAux                                 = true;
-      aBufferElementsPerSample                 = static_cast<VkDeviceSize>(m_state.oitLayers) * 2;
-      aBufferStrideBytes                       = sizeof(uint);
-      aBufferFormat                            = VK_FORMAT_R32_UINT;
-      m_sceneUbo.linkedListAllocatedPerElement = m_state.oitLayers;
-      break;
-    case OIT_LOOP64:
-      allocAux                                 = true;
-      aBufferElementsPerSample                 = m_state.oitLayers;
-      aBufferStrideBytes                       = sizeof(uint64_t);
-      aBufferFormat                            = VK_FORMAT_R32G32_UINT;
-      m_sceneUbo.linkedListAllocatedPerElement = m_state.oitLayers;
-      break;
-    case OIT_WEIGHTED:
-      // Don't create anything other than the special textures below
+      // The linked list uses 32-bit offsets (and a 32-bit counter), so it
+      // can't address more than 2^32-1 elements. With epoch tags, list heads
+      // only have room for 24-bit offsets.
+      m_sceneUbo.linkedListAllocatedPerElement = static_cast<uint32_t>(
+          std::min(aBufferEntries, VkDeviceSize(m_state.usesEpochTags() ? EPOCH_VALUE_MASK : UINT32_MAX)));
       break;
     default:
-      assert(!"createABuffers: Textures for algorithm not implemented!");
+      m_sceneUbo.linkedListAllocatedPerElement = m_state.oitLayers * (sampleShading ? m_state.msaa : 1);
+      break;
   }
 
-  if(sampleShading)
+  // The sizes and usages of the A-buffer and auxiliary images
+  // Reference: https://antiagainst.github.io/post/hlsl-for-vulkan-resources/
+  const VkDeviceSize aBufferSize = aBufferEntries * req.strideBytes;
+  // TRANSFER_DST is needed for clearing the A-buffer using vkCmdFillBuffer.
+  // With aBufferDeviceAddress, shaders access it through its address, so
+  // we don't create a texel buffer view (which could exceed
+  // maxTexelBufferElements).
+  VkBufferUsageFlags aBufferUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  if(m_state.aBufferDeviceAddress)
   {
-    aBufferElementsPerSample *= m_state.msaa;
-    m_sceneUbo.linkedListAllocatedPerElement *= m_state.msaa;
+    aBufferUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
   }
-
-  // Reference: https://antiagainst.github.io/post/hlsl-for-vulkan-resources/
-  const VkDeviceSize aBufferSize = static_cast<VkDeviceSize>(bufferWidth) * static_cast<VkDeviceSize>(bufferHeight)
-                                   * aBufferElementsPerSample * aBufferStrideBytes;
-  if(aBufferSize != 0)
+  else
   {
-    const VkBufferUsageFlagBits aBufferUsage =
-        (m_state.algorithm == OIT_LOOP64 ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT);
-    m_oitABuffer.create(m_context, m_allocatorDma, aBufferSize, aBufferUsage, aBufferFormat);
-    m_oitABuffer.setName(m_debug, "m_oitABuffer");
+    aBufferUsage |= (m_state.algorithm == OIT_LOOP64 ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT);
   }
 
-  // Auxiliary images
   // The ways that auxiliary images can be used
-  const VkImageUsageFlags auxUsages = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  // (TRANSFER_SRC is used by cmdSampleDepthComplexity to read back fragment counts.)
+  const VkImageUsageFlags auxUsages = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
   // The ways that auxiliary images can be accessed
   const VkAccessFlags auxAccesses = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
   // if `sampleShading`, then each auxiliary image is actually a texture array:
   const uint32_t auxLayers = (sampleShading ? m_state.msaa : 1);
 
-  if(allocAux)
+  // The tile mask and tile list cover a band in TILE_SIZE x TILE_SIZE tiles.
+  // They're small, so we always create them, even if the tiled composite
+  // isn't used; this way, their descriptors are always valid.
+  m_sceneUbo.tiles = ivec2((bufferWidth + TILE_SIZE - 1) / TILE_SIZE, (bandHeight + TILE_SIZE - 1) / TILE_SIZE);
+  const VkDeviceSize numTiles     = static_cast<VkDeviceSize>(m_sceneUbo.tiles.x) * static_cast<VkDeviceSize>(m_sceneUbo.tiles.y);
+  const VkDeviceSize tileMaskSize = ((numTiles + 31) / 32) * sizeof(uint32_t);
+  const VkDeviceSize tileListSize = sizeof(VkDrawIndirectCommand) + numTiles * sizeof(uint32_t);
+
+  // Create a copy of each resource per frame-resource set, so that
+  // consecutive frames don't clear resources the previous frame is still using.
+  for(uint32_t set = 0; set < m_state.frameResourceSets; set++)
   {
-    m_oitAuxImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_FORMAT_R32_UINT,
-                         bufferWidth, bufferHeight, auxLayers, auxUsages);
-    m_oitAuxImage.setName(m_debug, "m_oitAuxImage");
-    m_oitAuxImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
-  }
+    OitFrameResources& frame = m_oitFrames[set];
 
-  if(allocAuxSpin)
-  {
-    m_oitAuxSpinImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_FORMAT_R32_UINT,
-                             bufferWidth, bufferHeight, auxLayers, auxUsages);
-    m_oitAuxSpinImage.setName(m_debug, "m_oitAuxSpinImage");
-    m_oitAuxSpinImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
-  }
+    if(aBufferSize != 0)
+    {
+      frame.aBuffer.create(m_context, m_allocatorDma, aBufferSize, aBufferUsage, req.format);
+      frame.aBuffer.setName(m_debug, "m_oitFrames[].aBuffer");
 
-  if(allocAuxDepth)
-  {
-    m_oitAuxDepthImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
-                              VK_FORMAT_R32_UINT, bufferWidth, bufferHeight, auxLayers, auxUsages);
-    m_oitAuxDepthImage.setName(m_debug, "m_oitAuxDepthImage");
-    m_oitAuxDepthImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
-  }
+      if(m_state.aBufferDeviceAddress)
+      {
+        VkBufferDeviceAddressInfo addressInfo = nvvk::make<VkBufferDeviceAddressInfo>();
+        addressInfo.buffer                    = frame.aBuffer.buffer.buffer;
+        const VkDeviceAddress address         = vkGetBufferDeviceAddressKHR(m_context, &addressInfo);
+        frame.aBufferAddress                  = uvec2(static_cast<uint32_t>(address), static_cast<uint32_t>(address >> 32));
+      }
+    }
 
-  if(allocCounter)
-  {
-    // Here, a counter is really a 1x1x1 image.
-    m_oitCounterImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_FORMAT_R32_UINT,
-                             1, 1, 1, auxUsages);
-    m_oitCounterImage.setName(m_debug, "m_oitCounter");
-    m_oitCounterImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
-  }
+    // Auxiliary images
+    if(req.allocAux)
+    {
+      frame.auxImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_FORMAT_R32_UINT,
+                            bufferWidth, bandHeight, auxLayers, auxUsages);
+      frame.auxImage.setName(m_debug, "m_oitFrames[].auxImage");
+      frame.auxImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
+    }
 
-  if(m_state.algorithm == OIT_WEIGHTED)
-  {
-    // Weighted, Blended OIT's color and reveal textures will be used both as
-    // color attachments and as storage images (i.e. accessed via imageLoad).
-    // We'll handle their transitions inside of drawTransparentWeighted.
-    const VkImageUsageFlags weightedUsages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
-    m_oitWeightedColorImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
-                                   m_oitWeightedColorFormat, bufferWidth, bufferHeight, 1, weightedUsages, m_state.msaa);
-    m_oitWeightedRevealImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
-                                    m_oitWeightedRevealFormat, bufferWidth, bufferHeight, 1, weightedUsages, m_state.msaa);
-    m_oitWeightedColorImage.setName(m_debug, "m_oitWeightedColorImage");
-    m_oitWeightedRevealImage.setName(m_debug, "m_oitWeightedRevealImage");
-    // Transition both of them to color attachments, which is the way they'll first be used:
-    // (see m_renderPassWeighted for reference)
-    m_oitWeightedColorImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
-    m_oitWeightedRevealImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+    if(req.allocAuxSpin)
+    {
+      frame.auxSpinImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_FORMAT_R32_UINT,
+                                bufferWidth, bandHeight, auxLayers, auxUsages);
+      frame.auxSpinImage.setName(m_debug, "m_oitFrames[].auxSpinImage");
+      frame.auxSpinImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
+    }
+
+    if(req.allocAuxDepth)
+    {
+      frame.auxDepthImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
+                                 VK_FORMAT_R32_UINT, bufferWidth, bandHeight, auxLayers, auxUsages);
+      frame.auxDepthImage.setName(m_debug, "m_oitFrames[].auxDepthImage");
+      frame.auxDepthImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
+    }
+
+    if(req.allocAuxOpacity)
+    {
+      frame.auxOpacityImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
+                                   VK_FORMAT_R32_UINT, bufferWidth, bandHeight, auxLayers, auxUsages);
+      frame.auxOpacityImage.setName(m_debug, "m_oitFrames[].auxOpacityImage");
+      frame.auxOpacityImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
+    }
+
+    if(req.allocCounter)
+    {
+      // Here, a counter is really a 1x1x1 image.
+      frame.counterImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_FORMAT_R32_UINT,
+                                1, 1, 1, auxUsages);
+      frame.counterImage.setName(m_debug, "m_oitFrames[].counterImage");
+      frame.counterImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, auxAccesses);
+    }
+
+    if(m_state.algorithm == OIT_WEIGHTED)
+    {
+      // Weighted, Blended OIT's color and reveal textures will be used both as
+      // color attachments and as storage images (i.e. accessed via imageLoad).
+      // We'll handle their transitions inside of drawTransparentWeighted.
+      const VkImageUsageFlags weightedUsages = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+      frame.weightedColorImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
+                                      m_oitWeightedColorFormat, bufferWidth, bufferHeight, 1, weightedUsages, m_state.msaa);
+      frame.weightedRevealImage.create(m_context, m_allocatorDma, VK_IMAGE_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT,
+                                       m_oitWeightedRevealFormat, bufferWidth, bufferHeight, 1, weightedUsages, m_state.msaa);
+      frame.weightedColorImage.setName(m_debug, "m_oitFrames[].weightedColorImage");
+      frame.weightedRevealImage.setName(m_debug, "m_oitFrames[].weightedRevealImage");
+      // Transition both of them to color attachments, which is the way they'll first be used:
+      // (see m_renderPassWeighted for reference)
+      frame.weightedColorImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+      frame.weightedRevealImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+    }
+
+    // TRANSFER_DST is needed for clearing them with vkCmdFillBuffer and
+    // vkCmdUpdateBuffer, and INDIRECT for drawing the tile list.
+    frame.tileMask.create(m_context, m_allocatorDma, tileMaskSize,
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_FORMAT_UNDEFINED);
+    frame.tileMask.setName(m_debug, "m_oitFrames[].tileMask");
+    frame.tileList.create(m_context, m_allocatorDma, tileListSize,
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                          VK_FORMAT_UNDEFINED);
+    frame.tileList.setName(m_debug, "m_oitFrames[].tileList");
   }
 }
 
@@ -257,9 +524,12 @@ void Sample::createDescriptorSets()
   // Descriptors get assigned to a triplet (descriptor set index,
   // binding index, array index). So we have to let the descriptor
   // set container know that the size of the array of each of these is 1.
-  m_descriptorInfo.addBinding(UBO_SCENE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+  m_descriptorInfo.addBinding(UBO_SCENE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
   // OIT_LOOP64 uses a storage buffer A-buffer, while all other algorithms use a storage texel buffer A-buffer.
-  if(m_state.algorithm == OIT_LOOP64)
+  // With aBufferDeviceAddress, shaders don't use this binding; it's left as
+  // an (unwritten) storage buffer.
+  if(m_state.algorithm == OIT_LOOP64 || m_state.aBufferDeviceAddress)
   {
     m_descriptorInfo.addBinding(IMG_ABUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
   }
@@ -270,14 +540,46 @@ void Sample::createDescriptorSets()
   m_descriptorInfo.addBinding(IMG_AUX, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
   m_descriptorInfo.addBinding(IMG_AUXSPIN, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
   m_descriptorInfo.addBinding(IMG_AUXDEPTH, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+  m_descriptorInfo.addBinding(IMG_AUXOPACITY, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
   m_descriptorInfo.addBinding(IMG_COUNTER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
   // For more information about the Weighted, Blended Order-Independent Transparency configuration,
   // see how the render pass is created.
   m_descriptorInfo.addBinding(IMG_WEIGHTED_COLOR, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
   m_descriptorInfo.addBinding(IMG_WEIGHTED_REVEAL, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-
-  // We'll create one descriptor set per swapchain image.
-  const uint32_t totalDescriptorSets = m_swapChain.getImageCount();
+  // The tiled composite's tile mask is written by color passes and read by
+  // oitTileClassify.comp.glsl, which writes the tile list that
+  // tileComposite.vert.glsl reads.
+  m_descriptorInfo.addBinding(IMG_TILE_MASK, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                              VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+  m_descriptorInfo.addBinding(IMG_TILE_LIST, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+  // The scene's per-object colors, which deferred shading reads, and which
+  // replace vertex colors with compressed vertices.
+  m_descriptorInfo.addBinding(IMG_MATERIALS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+  // The vertex pre-transform reads the vertex buffer and writes the
+  // transformed vertices, which preTransformed.vert.glsl reads. With
+  // compressed vertices, object.vert.glsl also reads the vertex buffer.
+  m_descriptorInfo.addBinding(IMG_SCENE_VERTICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+  m_descriptorInfo.addBinding(IMG_TRANSFORMED, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+  // Frustum culling reads the objects' bounds and writes their draw commands.
+  // Sphere impostors also read the bounds when drawing.
+  m_descriptorInfo.addBinding(IMG_OBJECT_BOUNDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                              VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+  m_descriptorInfo.addBinding(IMG_DRAW_COMMANDS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  // Occlusion culling builds the Hi-Z pyramid from the depth image, and reads
+  // it. Sphere impostors copy the depth image to a buffer that their fragment
+  // shaders read.
+  m_descriptorInfo.addBinding(IMG_SCENE_DEPTH, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  m_descriptorInfo.addBinding(IMG_HIZ, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+  m_descriptorInfo.addBinding(IMG_OPAQUE_DEPTH, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                              VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+
+  // We'll create one descriptor set per swapchain image per frame-resource
+  // set; see getCurrentDescriptorSet.
+  const uint32_t totalDescriptorSets = m_swapChain.getImageCount() * m_state.frameResourceSets;
 
   // Create the layout
   m_descriptorInfo.initLayout();
@@ -295,17 +597,22 @@ void Sample::createDescriptorSets()
   }
 #endif
 
-  // Create the pipeline layout. This application doesn't use any push constants,
-  // so the function is relatively simple.
-  m_descriptorInfo.initPipeLayout(0, nullptr, 0);
+  // Create the pipeline layout. The push constants describe the band being
+  // rendered (see PushConstants in common.h); tileComposite.vert.glsl uses
+  // them as well, and hiZBuild.comp.glsl reads the level to build.
+  VkPushConstantRange pushConstantRange = {};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset              = 0;
+  pushConstantRange.size                = sizeof(PushConstants);
+  m_descriptorInfo.initPipeLayout(1, &pushConstantRange, 0);
 }
 
 void Sample::updateAllDescriptorSets()
 {
   std::vector<VkWriteDescriptorSet> updates;
 
-  // We create one descriptor set per swapchain image.
-  const uint32_t totalDescriptorSets = m_swapChain.getImageCount();
+  // We create one descriptor set per swapchain image per frame-resource set.
+  const uint32_t swapchainImages = m_swapChain.getImageCount();
 
   // Information about the buffer and image descriptors we'll use.
   // When constructing VkWriteDescriptorSet objects, we'll take references
@@ -313,91 +620,208 @@ void Sample::updateAllDescriptorSets()
 
   // UBO_SCENE
   std::vector<VkDescriptorBufferInfo> uboBufferInfo;
-  uboBufferInfo.resize(totalDescriptorSets);
-  for(uint32_t ring = 0; ring < totalDescriptorSets; ring++)
+  uboBufferInfo.resize(swapchainImages);
+  for(uint32_t ring = 0; ring < swapchainImages; ring++)
   {
     uboBufferInfo[ring].buffer = m_uniformBuffers[ring].buffer;
     uboBufferInfo[ring].offset = 0;
     uboBufferInfo[ring].range  = sizeof(SceneData);
   }
 
-  // Auxiliary images (note that their image views may be nullptr - this is fixed later):
-  VkDescriptorImageInfo oitAuxInfo = {};
-  oitAuxInfo.imageLayout           = VK_IMAGE_LAYOUT_GENERAL;  // For read and write in shader
-  oitAuxInfo.imageView             = m_oitAuxImage.view;
-  oitAuxInfo.sampler               = m_pointSampler;
+  // IMG_MATERIALS
+  VkDescriptorBufferInfo materialBufferInfo = {};
+  materialBufferInfo.buffer                 = m_materialBuffer.buffer;
+  materialBufferInfo.offset                 = 0;
+  materialBufferInfo.range                  = VK_WHOLE_SIZE;
+
+  // IMG_SCENE_VERTICES and IMG_TRANSFORMED
+  VkDescriptorBufferInfo sceneVerticesInfo = {};
+  sceneVerticesInfo.buffer                 = m_vertexBuffer.buffer;
+  sceneVerticesInfo.offset                 = 0;
+  sceneVerticesInfo.range                  = VK_WHOLE_SIZE;
+  VkDescriptorBufferInfo transformedInfo   = {};
+  transformedInfo.buffer                   = m_transformedBuffer.buffer;
+  transformedInfo.offset                   = 0;
+  transformedInfo.range                    = VK_WHOLE_SIZE;
+
+  // IMG_OBJECT_BOUNDS and IMG_DRAW_COMMANDS
+  VkDescriptorBufferInfo objectBoundsInfo = {};
+  objectBoundsInfo.buffer                 = m_objectBoundsBuffer.buffer;
+  objectBoundsInfo.offset                 = 0;
+  objectBoundsInfo.range                  = VK_WHOLE_SIZE;
+  VkDescriptorBufferInfo drawCommandsInfo = {};
+  drawCommandsInfo.buffer                 = m_drawCommandBuffer.buffer;
+  drawCommandsInfo.offset                 = 0;
+  drawCommandsInfo.range                  = VK_WHOLE_SIZE;
+
+  // IMG_SCENE_DEPTH, IMG_HIZ, and IMG_OPAQUE_DEPTH
+  VkDescriptorImageInfo sceneDepthInfo   = {};
+  sceneDepthInfo.imageLayout             = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  sceneDepthInfo.imageView               = m_depthImage.view;
+  sceneDepthInfo.sampler                 = VK_NULL_HANDLE;
+  VkDescriptorBufferInfo hiZInfo         = {};
+  hiZInfo.buffer                         = m_hiZBuffer.buffer;
+  hiZInfo.offset                         = 0;
+  hiZInfo.range                          = VK_WHOLE_SIZE;
+  VkDescriptorBufferInfo opaqueDepthInfo = {};
+  opaqueDepthInfo.buffer                 = m_opaqueDepthBuffer.buffer;
+  opaqueDepthInfo.offset                 = 0;
+  opaqueDepthInfo.range                  = VK_WHOLE_SIZE;
+
+  // The images of each frame-resource set
+  struct FrameDescriptorInfo
+  {
+    VkDescriptorImageInfo  aux;
+    VkDescriptorImageInfo  auxSpin;
+    VkDescriptorImageInfo  auxDepth;
+    VkDescriptorImageInfo  auxOpacity;
+    VkDescriptorImageInfo  counter;
+    VkDescriptorImageInfo  weightedColor;
+    VkDescriptorImageInfo  weightedReveal;
+    VkDescriptorBufferInfo aBuffer;
+    VkDescriptorBufferInfo tileMask;
+    VkDescriptorBufferInfo tileList;
+  };
+  std::array<FrameDescriptorInfo, MAX_FRAME_RESOURCE_SETS> frameInfos;
+
+  for(uint32_t set = 0; set < m_state.frameResourceSets; set++)
+  {
+    const OitFrameResources& frame = m_oitFrames[set];
+    FrameDescriptorInfo&     info  = frameInfos[set];
+
+    // Auxiliary images (note that their image views may be nullptr - this is fixed later):
+    info.aux             = {};
+    info.aux.imageLayout = VK_IMAGE_LAYOUT_GENERAL;  // For read and write in shader
+    info.aux.imageView   = frame.auxImage.view;
+    info.aux.sampler     = m_pointSampler;
 
-  VkDescriptorImageInfo oitAuxSpinInfo = oitAuxInfo;
-  oitAuxSpinInfo.imageView             = m_oitAuxSpinImage.view;
+    info.auxSpin           = info.aux;
+    info.auxSpin.imageView = frame.auxSpinImage.view;
 
-  VkDescriptorImageInfo oitAuxDepthInfo = oitAuxInfo;
-  oitAuxDepthInfo.imageView             = m_oitAuxDepthImage.view;
+    info.auxDepth           = info.aux;
+    info.auxDepth.imageView = frame.auxDepthImage.view;
 
-  VkDescriptorImageInfo oitCounterInfo = oitAuxInfo;
-  oitCounterInfo.imageView             = m_oitCounterImage.view;
+    info.auxOpacity           = info.aux;
+    info.auxOpacity.imageView = frame.auxOpacityImage.view;
 
-  VkDescriptorImageInfo oitWeightedColorInfo = {};
-  oitWeightedColorInfo.imageLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  oitWeightedColorInfo.imageView             = m_oitWeightedColorImage.view;
-  oitWeightedColorInfo.sampler               = VK_NULL_HANDLE;
+    info.counter           = info.aux;
+    info.counter.imageView = frame.counterImage.view;
 
-  VkDescriptorImageInfo oitWeightedRevealInfo = oitWeightedColorInfo;
-  oitWeightedRevealInfo.imageView             = m_oitWeightedRevealImage.view;
+    info.weightedColor             = {};
+    info.weightedColor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    info.weightedColor.imageView   = frame.weightedColorImage.view;
+    info.weightedColor.sampler     = VK_NULL_HANDLE;
 
-  // IMG_ABUFFER (when used as a storage buffer instead of a storage texel buffer)
-  VkDescriptorBufferInfo oitABufferInfo = {};
-  oitABufferInfo.buffer                 = m_oitABuffer.buffer.buffer;
-  oitABufferInfo.offset                 = 0;
-  oitABufferInfo.range                  = VK_WHOLE_SIZE;
+    info.weightedReveal           = info.weightedColor;
+    info.weightedReveal.imageView = frame.weightedRevealImage.view;
+
+    // IMG_ABUFFER (when used as a storage buffer instead of a storage texel buffer)
+    info.aBuffer        = {};
+    info.aBuffer.buffer = frame.aBuffer.buffer.buffer;
+    info.aBuffer.offset = 0;
+    info.aBuffer.range  = VK_WHOLE_SIZE;
+
+    // IMG_TILE_MASK and IMG_TILE_LIST
+    info.tileMask        = {};
+    info.tileMask.buffer = frame.tileMask.buffer.buffer;
+    info.tileMask.offset = 0;
+    info.tileMask.range  = VK_WHOLE_SIZE;
+
+    info.tileList        = info.tileMask;
+    info.tileList.buffer = frame.tileList.buffer.buffer;
+  }
 
   // Descriptor sets without the color buffer bound to the shader stage
-  for(uint32_t ring = 0; ring < totalDescriptorSets; ring++)
+  for(uint32_t set = 0; set < m_state.frameResourceSets; set++)
   {
-    updates.push_back(m_descriptorInfo.makeWrite(ring, UBO_SCENE, &uboBufferInfo[ring]));
+    const OitFrameResources&   frame = m_oitFrames[set];
+    const FrameDescriptorInfo& info  = frameInfos[set];
 
-    if(m_state.algorithm == OIT_LOOP64)
-    {
-      // IMG_ABUFFER is a storage buffer
-      updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_ABUFFER, &oitABufferInfo));
-    }
-    else
+    for(uint32_t ring = 0; ring < swapchainImages; ring++)
     {
-      // IMG_ABUFFER is a storage texel buffer (which is a kind of buffer in
-      // Vulkan, but a kind of texture in OpenGL).
-      if(m_oitABuffer.view != nullptr)
+      const uint32_t descriptorSet = set * swapchainImages + ring;
+
+      updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, UBO_SCENE, &uboBufferInfo[ring]));
+
+      if(m_state.aBufferDeviceAddress)
       {
-        updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_ABUFFER, &m_oitABuffer.view));
+        // Shaders access the A-buffer through m_sceneUbo.aBufferAddress.
+      }
+      else if(m_state.algorithm == OIT_LOOP64)
+      {
+        // IMG_ABUFFER is a storage buffer
+        if(info.aBuffer.buffer != nullptr)
+        {
+          updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_ABUFFER, &info.aBuffer));
+        }
+      }
+      else
+      {
+        // IMG_ABUFFER is a storage texel buffer (which is a kind of buffer in
+        // Vulkan, but a kind of texture in OpenGL).
+        if(frame.aBuffer.view != nullptr)
+        {
+          updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_ABUFFER, &frame.aBuffer.view));
+        }
       }
-    }
 
-    if(oitAuxInfo.imageView != nullptr)
-    {
-      updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_AUX, &oitAuxInfo));
-    }
+      if(info.aux.imageView != nullptr)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_AUX, &info.aux));
+      }
 
-    if(oitAuxSpinInfo.imageView != nullptr)
-    {
-      updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_AUXSPIN, &oitAuxSpinInfo));
-    }
+      if(info.auxSpin.imageView != nullptr)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_AUXSPIN, &info.auxSpin));
+      }
 
-    if(oitAuxDepthInfo.imageView != nullptr)
-    {
-      updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_AUXDEPTH, &oitAuxDepthInfo));
-    }
+      if(info.auxDepth.imageView != nullptr)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_AUXDEPTH, &info.auxDepth));
+      }
 
-    if(oitCounterInfo.imageView != nullptr)
-    {
-      updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_COUNTER, &oitCounterInfo));
-    }
+      if(info.auxOpacity.imageView != nullptr)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_AUXOPACITY, &info.auxOpacity));
+      }
 
-    if(oitWeightedColorInfo.imageView != nullptr)
-    {
-      updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_WEIGHTED_COLOR, &oitWeightedColorInfo));
-    }
+      if(info.counter.imageView != nullptr)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_COUNTER, &info.counter));
+      }
 
-    if(oitWeightedRevealInfo.imageView != nullptr)
-    {
-      updates.push_back(m_descriptorInfo.makeWrite(ring, IMG_WEIGHTED_REVEAL, &oitWeightedRevealInfo));
+      if(info.weightedColor.imageView != nullptr)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_WEIGHTED_COLOR, &info.weightedColor));
+      }
+
+      if(info.weightedReveal.imageView != nullptr)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_WEIGHTED_REVEAL, &info.weightedReveal));
+      }
+
+      updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_TILE_MASK, &info.tileMask));
+      updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_TILE_LIST, &info.tileList));
+      updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_MATERIALS, &materialBufferInfo));
+      updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_OBJECT_BOUNDS, &objectBoundsInfo));
+      updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_DRAW_COMMANDS, &drawCommandsInfo));
+      updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_SCENE_VERTICES, &sceneVerticesInfo));
+      if(m_transformedBuffer.buffer != VK_NULL_HANDLE)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_TRANSFORMED, &transformedInfo));
+      }
+      if((m_hiZBuffer.buffer != VK_NULL_HANDLE) || (m_opaqueDepthBuffer.buffer != VK_NULL_HANDLE))
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_SCENE_DEPTH, &sceneDepthInfo));
+      }
+      if(m_hiZBuffer.buffer != VK_NULL_HANDLE)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_HIZ, &hiZInfo));
+      }
+      if(m_opaqueDepthBuffer.buffer != VK_NULL_HANDLE)
+      {
+        updates.push_back(m_descriptorInfo.makeWrite(descriptorSet, IMG_OPAQUE_DEPTH, &opaqueDepthInfo));
+      }
     }
   }
 
@@ -405,6 +829,11 @@ void Sample::updateAllDescriptorSets()
   vkUpdateDescriptorSets(m_context, static_cast<uint32_t>(updates.size()), updates.data(), 0, nullptr);
 }
 
+VkDescriptorSet Sample::getCurrentDescriptorSet()
+{
+  return m_descriptorInfo.getSet(m_oitFrameIndex * m_swapChain.getImageCount() + m_swapChain.getActiveImageIndex());
+}
+
 void Sample::destroyGUIRenderPass()
 {
   if(m_renderPassGUI != nullptr)
@@ -463,6 +892,12 @@ void Sample::destroyNonGUIRenderPasses()
     m_renderPassColorDepthClear = nullptr;
   }
 
+  if(m_renderPassColorDepthLoad != nullptr)
+  {
+    vkDestroyRenderPass(m_context, m_renderPassColorDepthLoad, NULL);
+    m_renderPassColorDepthLoad = nullptr;
+  }
+
   if(m_renderPassWeighted != nullptr)
   {
     vkDestroyRenderPass(m_context, m_renderPassWeighted, NULL);
@@ -537,6 +972,16 @@ void Sample::createNonGUIRenderPasses()
 
     NVVK_CHECK(vkCreateRenderPass(m_context, &rpInfo, NULL, &m_renderPassColorDepthClear));
     m_debug.setObjectName(m_renderPassColorDepthClear, "m_renderPassColorDepthClear");
+
+    // m_renderPassColorDepthLoad
+    // The same render pass, but keeping the contents of m_colorImage and
+    // m_depthImage. The tiled composite uses this to resume rendering after
+    // building the tile list. It's compatible with m_renderPassColorDepthClear,
+    // so it uses the same framebuffer and pipelines.
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    NVVK_CHECK(vkCreateRenderPass(m_context, &rpInfo, NULL, &m_renderPassColorDepthLoad));
+    m_debug.setObjectName(m_renderPassColorDepthLoad, "m_renderPassColorDepthLoad");
   }
 
   // m_renderPassWeighted
@@ -653,11 +1098,14 @@ void Sample::updateShaderDefinitions()
 {
   m_shaderModuleManager.m_prepend = nvh::ShaderFileManager::format(
       "#extension GL_GOOGLE_cpp_style_line_directive : enable\n"
-      "#define OIT_LAYERS %d\n"
-      "#define OIT_TAILBLEND %d\n"
       "#define OIT_MSAA %d\n"
-      "#define OIT_SAMPLE_SHADING %d\n",
-      m_state.oitLayers, m_state.tailBlend ? 1 : 0, m_state.msaa, m_state.sampleShading ? 1 : 0);
+      "#define OIT_SAMPLE_SHADING %d\n"
+      "#define OIT_ABUFFER_BDA %d\n"
+      "#define OIT_HYBRID_SAMPLES %d\n"
+      "#define OIT_SPHERE_IMPOSTORS %d\n"
+      "#define OIT_COMPRESSED_VERTICES %d\n",
+      m_state.msaa, m_state.sampleShading ? 1 : 0, m_state.aBufferDeviceAddress ? 1 : 0, m_state.hybridSamples ? 1 : 0,
+      m_state.usesSphereImpostors() ? 1 : 0, m_state.usesCompressedVertices() ? 1 : 0);
 }
 
 void Sample::createOrReloadShaderModules()
@@ -676,6 +1124,25 @@ void Sample::createOrReloadShaderModules()
   // Scene (standard mesh rendering) and full-screen triangle vertex shaders
   createOrReloadShaderModule(m_shaderSceneVert, VK_SHADER_STAGE_VERTEX_BIT, "object.vert.glsl");
   createOrReloadShaderModule(m_shaderFullScreenTriangleVert, VK_SHADER_STAGE_VERTEX_BIT, "fullScreenTriangle.vert.glsl");
+  // Tiled composite
+  createOrReloadShaderModule(m_shaderTileCompositeVert, VK_SHADER_STAGE_VERTEX_BIT, "tileComposite.vert.glsl");
+  createOrReloadShaderModule(m_shaderTileClassifyComp, VK_SHADER_STAGE_COMPUTE_BIT, "oitTileClassify.comp.glsl");
+  // Vertex pre-transform
+  createOrReloadShaderModule(m_shaderPreTransformComp, VK_SHADER_STAGE_COMPUTE_BIT, "preTransform.comp.glsl");
+  createOrReloadShaderModule(m_shaderPreTransformedVert, VK_SHADER_STAGE_VERTEX_BIT, "preTransformed.vert.glsl");
+  // Frustum culling
+  // With occlusion culling, the transparent objects are culled in a separate
+  // pass after the opaque draw.
+  const std::string defineCullPass =
+      (m_state.usesOcclusionCulling() ? "#define CULL_PASS CULL_PASS_OPAQUE\n" : "#define CULL_PASS CULL_PASS_ALL\n");
+  createOrReloadShaderModule(m_shaderObjectCullComp, VK_SHADER_STAGE_COMPUTE_BIT, "objectCull.comp.glsl", defineCullPass);
+  // Occlusion culling
+  createOrReloadShaderModule(m_shaderOcclusionCullComp, VK_SHADER_STAGE_COMPUTE_BIT, "objectCull.comp.glsl",
+                             "#define CULL_PASS CULL_PASS_OCCLUSION\n");
+  createOrReloadShaderModule(m_shaderHiZBuildComp, VK_SHADER_STAGE_COMPUTE_BIT, "hiZBuild.comp.glsl");
+  // Sphere impostors
+  createOrReloadShaderModule(m_shaderSphereImpostorVert, VK_SHADER_STAGE_VERTEX_BIT, "sphereImpostor.vert.glsl");
+  createOrReloadShaderModule(m_shaderOpaqueDepthCopyComp, VK_SHADER_STAGE_COMPUTE_BIT, "opaqueDepthCopy.comp.glsl");
   // Opaque pass
   createOrReloadShaderModule(m_shaderOpaqueFrag, VK_SHADER_STAGE_FRAGMENT_BIT, "opaque.frag.glsl");
 
@@ -747,68 +1214,144 @@ void Sample::destroyGraphicsPipelines()
   destroyGraphicsPipeline(m_pipelineSpinlockComposite);
   destroyGraphicsPipeline(m_pipelineWeightedColor);
   destroyGraphicsPipeline(m_pipelineWeightedComposite);
+  destroyGraphicsPipeline(m_pipelineTileClassify);  // vkDestroyPipeline also destroys compute pipelines
+  destroyGraphicsPipeline(m_pipelinePreTransform);
+  destroyGraphicsPipeline(m_pipelineObjectCull);
+  destroyGraphicsPipeline(m_pipelineOcclusionCull);
+  destroyGraphicsPipeline(m_pipelineHiZBuild);
+  destroyGraphicsPipeline(m_pipelineOpaqueDepthCopy);
 }
 
 void Sample::createGraphicsPipelines()
 {
   destroyGraphicsPipelines();
 
+  // With sphere impostors, every pass that draws the scene expands each
+  // object's vertices into camera-facing quads.
+  const nvvk::ShaderModuleID sceneVert = (m_state.usesSphereImpostors() ? m_shaderSphereImpostorVert : m_shaderSceneVert);
+
+  // With compressed vertices, object.vert.glsl fetches its vertices itself.
+  const bool sceneVertexInput = !m_state.usesCompressedVertices();
+
   // We always need the opaque pipeline:
   m_pipelineOpaque =
-      createGraphicsPipeline(m_shaderSceneVert, m_shaderOpaqueFrag, BlendMode::NONE, true, false, m_renderPassColorDepthClear);
+      createGraphicsPipeline(sceneVert, m_shaderOpaqueFrag, BlendMode::NONE, sceneVertexInput, false, m_renderPassColorDepthClear);
 
   const bool transparentDoubleSided = true;  // Iff transparent objects are double-sided
 
+  // With the tiled composite, composite passes draw the tile list instead of
+  // a full-screen triangle.
+  const nvvk::ShaderModuleID compositeVert =
+      (m_state.usesTiledComposite() ? m_shaderTileCompositeVert : m_shaderFullScreenTriangleVert);
+  if(m_state.usesTiledComposite())
+  {
+    VkComputePipelineCreateInfo pipelineInfo = nvvk::make<VkComputePipelineCreateInfo>();
+    pipelineInfo.stage                       = nvvk::make<VkPipelineShaderStageCreateInfo>();
+    pipelineInfo.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module                = m_shaderModuleManager.get(m_shaderTileClassifyComp);
+    pipelineInfo.stage.pName                 = "main";
+    pipelineInfo.layout                      = m_descriptorInfo.getPipeLayout();
+    NVVK_CHECK(vkCreateComputePipelines(m_context, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipelineTileClassify));
+  }
+
+  // With the vertex pre-transform, passes that draw the transparent objects
+  // read their transformed vertices instead of the vertex buffer.
+  const nvvk::ShaderModuleID transparentVert        = (m_state.preTransform ? m_shaderPreTransformedVert : sceneVert);
+  const bool                 transparentVertexInput = !m_state.preTransform && sceneVertexInput;
+  if(m_state.preTransform)
+  {
+    VkComputePipelineCreateInfo pipelineInfo = nvvk::make<VkComputePipelineCreateInfo>();
+    pipelineInfo.stage                       = nvvk::make<VkPipelineShaderStageCreateInfo>();
+    pipelineInfo.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module                = m_shaderModuleManager.get(m_shaderPreTransformComp);
+    pipelineInfo.stage.pName                 = "main";
+    pipelineInfo.layout                      = m_descriptorInfo.getPipeLayout();
+    NVVK_CHECK(vkCreateComputePipelines(m_context, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipelinePreTransform));
+  }
+  if(m_state.frustumCulling)
+  {
+    VkComputePipelineCreateInfo pipelineInfo = nvvk::make<VkComputePipelineCreateInfo>();
+    pipelineInfo.stage                       = nvvk::make<VkPipelineShaderStageCreateInfo>();
+    pipelineInfo.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module                = m_shaderModuleManager.get(m_shaderObjectCullComp);
+    pipelineInfo.stage.pName                 = "main";
+    pipelineInfo.layout                      = m_descriptorInfo.getPipeLayout();
+    NVVK_CHECK(vkCreateComputePipelines(m_context, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipelineObjectCull));
+  }
+  if(m_state.usesOcclusionCulling())
+  {
+    VkComputePipelineCreateInfo pipelineInfo = nvvk::make<VkComputePipelineCreateInfo>();
+    pipelineInfo.stage                       = nvvk::make<VkPipelineShaderStageCreateInfo>();
+    pipelineInfo.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module                = m_shaderModuleManager.get(m_shaderOcclusionCullComp);
+    pipelineInfo.stage.pName                 = "main";
+    pipelineInfo.layout                      = m_descriptorInfo.getPipeLayout();
+    NVVK_CHECK(vkCreateComputePipelines(m_context, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipelineOcclusionCull));
+
+    pipelineInfo.stage.module = m_shaderModuleManager.get(m_shaderHiZBuildComp);
+    NVVK_CHECK(vkCreateComputePipelines(m_context, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipelineHiZBuild));
+  }
+  if(m_state.usesSphereImpostors())
+  {
+    VkComputePipelineCreateInfo pipelineInfo = nvvk::make<VkComputePipelineCreateInfo>();
+    pipelineInfo.stage                       = nvvk::make<VkPipelineShaderStageCreateInfo>();
+    pipelineInfo.stage.stage                 = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module                = m_shaderModuleManager.get(m_shaderOpaqueDepthCopyComp);
+    pipelineInfo.stage.pName                 = "main";
+    pipelineInfo.layout                      = m_descriptorInfo.getPipeLayout();
+    NVVK_CHECK(vkCreateComputePipelines(m_context, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipelineOpaqueDepthCopy));
+  }
+
   // Switch off between algorithms:
   switch(m_state.algorithm)
   {
     case OIT_SIMPLE:
-      m_pipelineSimpleColor = createGraphicsPipeline(m_shaderSceneVert, m_shaderSimpleColorFrag, BlendMode::PREMULTIPLIED,
-                                                     true, transparentDoubleSided, m_renderPassColorDepthClear);
+      m_pipelineSimpleColor = createGraphicsPipeline(transparentVert, m_shaderSimpleColorFrag, BlendMode::PREMULTIPLIED,
+                                                     transparentVertexInput, transparentDoubleSided, m_renderPassColorDepthClear);
       m_pipelineSimpleComposite =
-          createGraphicsPipeline(m_shaderFullScreenTriangleVert, m_shaderSimpleCompositeFrag, BlendMode::PREMULTIPLIED,
+          createGraphicsPipeline(compositeVert, m_shaderSimpleCompositeFrag, BlendMode::PREMULTIPLIED,
                                  false, transparentDoubleSided, m_renderPassColorDepthClear);
       break;
     case OIT_LINKEDLIST:
-      m_pipelineLinkedListColor = createGraphicsPipeline(m_shaderSceneVert, m_shaderLinkedListColorFrag, BlendMode::PREMULTIPLIED,
-                                                         true, transparentDoubleSided, m_renderPassColorDepthClear);
+      m_pipelineLinkedListColor = createGraphicsPipeline(transparentVert, m_shaderLinkedListColorFrag, BlendMode::PREMULTIPLIED,
+                                                         transparentVertexInput, transparentDoubleSided, m_renderPassColorDepthClear);
       m_pipelineLinkedListComposite =
-          createGraphicsPipeline(m_shaderFullScreenTriangleVert, m_shaderLinkedListCompositeFrag,
+          createGraphicsPipeline(compositeVert, m_shaderLinkedListCompositeFrag,
                                  BlendMode::PREMULTIPLIED, false, transparentDoubleSided, m_renderPassColorDepthClear);
       break;
     case OIT_LOOP:
-      m_pipelineLoopDepth = createGraphicsPipeline(m_shaderSceneVert, m_shaderLoopDepthFrag, BlendMode::PREMULTIPLIED,
-                                                   true, transparentDoubleSided, m_renderPassColorDepthClear);
-      m_pipelineLoopColor = createGraphicsPipeline(m_shaderSceneVert, m_shaderLoopColorFrag, BlendMode::PREMULTIPLIED,
-                                                   true, transparentDoubleSided, m_renderPassColorDepthClear);
+      m_pipelineLoopDepth = createGraphicsPipeline(transparentVert, m_shaderLoopDepthFrag, BlendMode::PREMULTIPLIED,
+                                                   transparentVertexInput, transparentDoubleSided, m_renderPassColorDepthClear);
+      m_pipelineLoopColor = createGraphicsPipeline(transparentVert, m_shaderLoopColorFrag, BlendMode::PREMULTIPLIED,
+                                                   transparentVertexInput, transparentDoubleSided, m_renderPassColorDepthClear);
       m_pipelineLoopComposite =
-          createGraphicsPipeline(m_shaderFullScreenTriangleVert, m_shaderLoopCompositeFrag, BlendMode::PREMULTIPLIED,
+          createGraphicsPipeline(compositeVert, m_shaderLoopCompositeFrag, BlendMode::PREMULTIPLIED,
                                  false, transparentDoubleSided, m_renderPassColorDepthClear);
       break;
     case OIT_LOOP64:
-      m_pipelineLoop64Color = createGraphicsPipeline(m_shaderSceneVert, m_shaderLoop64ColorFrag, BlendMode::PREMULTIPLIED,
-                                                     true, transparentDoubleSided, m_renderPassColorDepthClear);
+      m_pipelineLoop64Color = createGraphicsPipeline(transparentVert, m_shaderLoop64ColorFrag, BlendMode::PREMULTIPLIED,
+                                                     transparentVertexInput, transparentDoubleSided, m_renderPassColorDepthClear);
       m_pipelineLoop64Composite =
-          createGraphicsPipeline(m_shaderFullScreenTriangleVert, m_shaderLoop64CompositeFrag, BlendMode::PREMULTIPLIED,
+          createGraphicsPipeline(compositeVert, m_shaderLoop64CompositeFrag, BlendMode::PREMULTIPLIED,
                                  false, transparentDoubleSided, m_renderPassColorDepthClear);
       break;
     case OIT_INTERLOCK:
-      m_pipelineInterlockColor = createGraphicsPipeline(m_shaderSceneVert, m_shaderInterlockColorFrag, BlendMode::PREMULTIPLIED,
-                                                        true, transparentDoubleSided, m_renderPassColorDepthClear);
+      m_pipelineInterlockColor = createGraphicsPipeline(transparentVert, m_shaderInterlockColorFrag, BlendMode::PREMULTIPLIED,
+                                                        transparentVertexInput, transparentDoubleSided, m_renderPassColorDepthClear);
       m_pipelineInterlockComposite =
-          createGraphicsPipeline(m_shaderFullScreenTriangleVert, m_shaderInterlockCompositeFrag,
+          createGraphicsPipeline(compositeVert, m_shaderInterlockCompositeFrag,
                                  BlendMode::PREMULTIPLIED, false, transparentDoubleSided, m_renderPassColorDepthClear);
       break;
     case OIT_SPINLOCK:
-      m_pipelineSpinlockColor = createGraphicsPipeline(m_shaderSceneVert, m_shaderSpinlockColorFrag, BlendMode::PREMULTIPLIED,
-                                                       true, transparentDoubleSided, m_renderPassColorDepthClear);
+      m_pipelineSpinlockColor = createGraphicsPipeline(transparentVert, m_shaderSpinlockColorFrag, BlendMode::PREMULTIPLIED,
+                                                       transparentVertexInput, transparentDoubleSided, m_renderPassColorDepthClear);
       m_pipelineSpinlockComposite =
-          createGraphicsPipeline(m_shaderFullScreenTriangleVert, m_shaderSpinlockCompositeFrag,
+          createGraphicsPipeline(compositeVert, m_shaderSpinlockCompositeFrag,
                                  BlendMode::PREMULTIPLIED, false, transparentDoubleSided, m_renderPassColorDepthClear);
       break;
     case OIT_WEIGHTED:
-      m_pipelineWeightedColor = createGraphicsPipeline(m_shaderSceneVert, m_shaderWeightedColorFrag, BlendMode::WEIGHTED_COLOR,
-                                                       true, transparentDoubleSided, m_renderPassWeighted, 0);
+      m_pipelineWeightedColor = createGraphicsPipeline(transparentVert, m_shaderWeightedColorFrag, BlendMode::WEIGHTED_COLOR,
+                                                       transparentVertexInput, transparentDoubleSided, m_renderPassWeighted, 0);
       m_pipelineWeightedComposite =
           createGraphicsPipeline(m_shaderFullScreenTriangleVert, m_shaderWeightedCompositeFrag,
                                  BlendMode::WEIGHTED_COMPOSITE, false, transparentDoubleSided, m_renderPassWeighted, 1);
@@ -22,7 +22,15 @@
 // Contains the declaration of the main sample class.
 // Its functions are defined in oit.cpp (resource creation for OIT
 // specifically), oitRender.cpp (main command buffer rendering, without GUI),
-// oitGui.cpp (GUI), and main.cpp (other resource creation and main()).
+// oitGui.cpp (GUI), oitAutoTune.cpp (automatic selection of settings),
+// oitStatistics.cpp (pipeline and shader statistics), and main.cpp (other
+// resource creation and main()).
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <future>
+#include <vector>
 
 #include <imgui/imgui_helper.h>
 
@@ -41,6 +49,7 @@
 #include <nvvk/swapchain_vk.hpp>
 
 #include "common.h"
+#include "trace_vk.h"
 #include "utilities_vk.h"
 
 // An enumeration of each of the enumerations used in the GUI. We use this in
@@ -50,6 +59,8 @@ enum GuiEnums : uint32_t
   GUI_ALGORITHM,
   GUI_OITSAMPLES,
   GUI_AA,
+  GUI_COLOR_ENCODING,
+  GUI_ABUFFER_LAYOUT,
 };
 
 // A simple enumeration for a few blending modes.
@@ -63,6 +74,63 @@ enum class BlendMode
   WEIGHTED_COMPOSITE,  // No depth writing; (c, r) ov (d, s) = (c(1-r) + rd, (1-r) + rs)
 };
 
+// Describes the A-buffer and auxiliary images that an algorithm needs, so that
+// their sizes can be computed without allocating them.
+struct ABufferRequirements
+{
+  VkDeviceSize elementsPerPixel = 0;  // Includes the factor of msaa when using sample shading.
+  VkDeviceSize strideBytes      = 0;
+  VkFormat     format           = VK_FORMAT_UNDEFINED;
+  bool         allocCounter     = false;
+  bool         allocAux         = false;
+  bool         allocAuxSpin     = false;
+  bool         allocAuxDepth    = false;
+  bool         allocAuxOpacity  = false;
+};
+
+// The number of bytes each image and buffer created by createFrameImages uses
+// for a given State, computed without allocating anything. These are nominal
+// sizes; the driver may add some padding for alignment.
+struct FrameImagePlan
+{
+  VkDeviceSize color          = 0;  // m_colorImage
+  VkDeviceSize depth          = 0;  // m_depthImage (assuming 32 bits per sample), m_hiZBuffer, and m_opaqueDepthBuffer
+  VkDeviceSize resolve        = 0;  // m_downsampleImage and m_guiCompositeImage
+  VkDeviceSize aBuffer        = 0;  // OitFrameResources::aBuffer, summed over all frame-resource sets
+  VkDeviceSize aux            = 0;  // The auxiliary images and counters, summed over all frame-resource sets
+  VkDeviceSize weighted       = 0;  // The weighted color and reveal images, summed over all frame-resource sets
+  VkDeviceSize aBufferEntries = 0;  // The number of texels (or 64-bit values, for OIT_LOOP64) in each A-buffer
+  bool exceedsDeviceLimits    = false;  // If true, the A-buffer is too large to be viewed by a single descriptor
+
+  // The bytes used by resources that depend on the algorithm.
+  VkDeviceSize algorithmBytes() const { return aBuffer + aux + weighted; }
+  VkDeviceSize totalBytes() const { return color + depth + resolve + algorithmBytes(); }
+};
+
+// The maximum value of State::frameResourceSets. More sets than frames in
+// flight wouldn't let any more frames overlap.
+static const uint32_t MAX_FRAME_RESOURCE_SETS = nvvk::DEFAULT_RING_SIZE;
+
+// The A-buffer, auxiliary images, and weighted images used to render a frame
+// (i.e. all of the IMG_* resources referenced in common.h), along with the
+// objects that refer to them. Frame N uses set N % State::frameResourceSets.
+struct OitFrameResources
+{
+  BufferAndView aBuffer;
+  ImageAndView  auxImage;
+  ImageAndView  auxSpinImage;
+  ImageAndView  auxDepthImage;
+  ImageAndView  auxOpacityImage;  // Only allocated when State::usesOpacityCulling
+  ImageAndView  counterImage;
+  ImageAndView  weightedColorImage;
+  ImageAndView  weightedRevealImage;
+  BufferAndView tileMask;  // One bit per TILE_SIZE x TILE_SIZE tile of a band, set by color passes
+  BufferAndView tileList;  // A VkDrawIndirectCommand followed by the indices of the marked tiles
+  VkFramebuffer weightedFramebuffer = nullptr;
+  uvec2         aBufferAddress      = uvec2(0, 0);  // Copied to SceneData::aBufferAddress when this set is used
+  uint32_t      epoch               = 0;  // The epoch of the last pass with State::epochTags, or 0 if these need to be cleared
+};
+
 // Contains the current settings of the rendering algorithm.
 // These are initially set to one of the best-looking settings.
 struct State
@@ -72,18 +140,208 @@ struct State
   uint32_t linkedListAllocatedPerElement = 10;
   uint32_t percentTransparent            = 100;
   bool     tailBlend                     = true;
+  bool     earlyDepth                    = true;  // USE_EARLYDEPTH in the shaders
   uint32_t numObjects                    = 1024;
   uint32_t subdiv                        = 16;
   float    scaleMin                      = 0.1f;
   float    scaleWidth                    = 0.9f;
   uint32_t aaType                        = AA_NONE;
   bool     drawUI                        = true;
+  bool     aBufferDeviceAddress          = false;                // Access the A-buffer through its device address
+  uint32_t bands                         = 1;                    // Horizontal bands to render in; see Sample::render
+  bool     epochTags                     = false;                // Tag aux values with an epoch instead of clearing
+  uint32_t frameResourceSets             = 1;                    // OitFrameResources sets; at most MAX_FRAME_RESOURCE_SETS
+  bool     tiledComposite                = false;                // Composite only touched tiles; see cmdBeginComposite
+  bool     deferredShading               = false;                // Shade fragments when compositing; see packFragmentColor
+  bool     opacityEarlyOut               = false;                // Stop compositing once opacity saturates
+  bool     opacityCulling                = false;                // Cull fragments behind saturated opacity
+  uint32_t colorEncoding                 = COLOR_ENCODING_SRGB;  // A COLOR_ENCODING_* value; unused by deferredShading
+  bool     hybridSampleStorage           = false;                // Store SSAA fragments per pixel except at edges
+  bool     preTransform                  = false;                // Transform transparent vertices once per frame
+  bool     frustumCulling                = false;                // Draw only objects in the view frustum
+  bool     occlusionCulling              = false;                // Also cull transparent objects behind opaque ones
+  bool     sphereImpostors               = false;                // Ray-cast spheres on camera-facing quads
+  bool     lod                           = false;                // Draw distant spheres coarser; see sphereLod
+  float    lodTriangleSize               = 4.0f;                 // Shortest on-screen triangle edge in pixels
+  bool     compressedVertices            = false;                // Store CompressedVertex values; see sceneVertex.glsl
+  bool     shortIndices                  = false;                // Use 16-bit per-object indices with vertexOffset
+  bool     asyncSceneUpload              = false;                // Upload new scenes in the background
+  // The ABUFFER_LAYOUT_* value of each algorithm; see aBufferLayout.
+  std::array<uint32_t, NUM_ALGORITHMS> aBufferLayouts = {ABUFFER_LAYOUT_LAYER_MAJOR, ABUFFER_LAYOUT_LAYER_MAJOR,
+                                                         ABUFFER_LAYOUT_LAYER_MAJOR, ABUFFER_LAYOUT_LAYER_MAJOR,
+                                                         ABUFFER_LAYOUT_LAYER_MAJOR, ABUFFER_LAYOUT_LAYER_MAJOR,
+                                                         ABUFFER_LAYOUT_LAYER_MAJOR};
+
+  // If autoTune is true, Sample::autoTuneState chooses algorithm, oitLayers,
+  // and linkedListAllocatedPerElement to fit these budgets.
+  bool     autoTune               = false;
+  float    autoTuneTargetMs       = 8.0f;  // GPU time budget for clearing, drawing, and compositing.
+  uint32_t autoTuneMemoryBudgetMB = 0;     // 0 means to use the budget reported by VK_EXT_memory_budget.
 
   // These are implicitly set by aaType:
   int  msaa          = 1;      // Number of MSAA samples used for color + depth buffers.
   bool sampleShading = false;  // If true, uses an array in the A-buffer per sample instead of per-pixel.
+  bool hybridSamples = false;  // If true, sample shading was replaced by hybridSampleStorage.
   int  supersample   = 1;
-  bool coverageShading() { return ((msaa > 1) && (!sampleShading)); }
+  bool coverageShading() const { return ((msaa > 1) && (!sampleShading)); }
+
+  // Returns the height of each band (except possibly the last, which may be
+  // shorter) when rendering a frame of the given height.
+  uint32_t bandHeight(uint32_t frameHeight) const
+  {
+    const uint32_t numBands = ((algorithm == OIT_WEIGHTED) ? 1 : std::max(1u, std::min(bands, frameHeight)));
+    return (frameHeight + numBands - 1) / numBands;
+  }
+
+  // Returns whether the current algorithm uses epoch tags. OIT_LOOP64 stores
+  // coverage masks where the tags would go with MSAA pixel shading.
+  bool usesEpochTags() const
+  {
+    return epochTags && (algorithm != OIT_LOOP) && (algorithm != OIT_WEIGHTED)
+           && !((algorithm == OIT_LOOP64) && coverageShading());
+  }
+
+  // Returns whether the current algorithm uses the tiled composite.
+  bool usesTiledComposite() const { return tiledComposite && (algorithm != OIT_WEIGHTED); }
+
+  // Returns whether the current algorithm uses deferred shading.
+  bool usesDeferredShading() const { return deferredShading && (algorithm != OIT_WEIGHTED); }
+
+  // Returns whether the current algorithm stops compositing at the opacity threshold.
+  bool usesOpacityEarlyOut() const { return opacityEarlyOut && (algorithm != OIT_WEIGHTED); }
+
+  // Returns whether the current algorithm culls fragments behind the opacity
+  // threshold. OIT_LOOP's depth and color passes must see the same fragments.
+  bool usesOpacityCulling() const { return opacityCulling && (algorithm != OIT_LOOP) && (algorithm != OIT_WEIGHTED); }
+
+  // Returns whether occlusion culling is used. With several bands, the depth
+  // buffer only holds the current band after the opaque draw, so we can't
+  // build a Hi-Z pyramid of the whole frame.
+  bool usesOcclusionCulling() const
+  {
+    return occlusionCulling && frustumCulling && ((bands <= 1) || (algorithm == OIT_WEIGHTED));
+  }
+
+  // Returns whether sphere impostors are used. With MSAA pixel shading (and
+  // hybridSamples, which shades most fragments once per pixel), a fragment's
+  // coverage mask is that of the quad rather than of the sphere, so impostors
+  // would store the wrong coverage.
+  bool usesSphereImpostors() const { return sphereImpostors && !coverageShading() && !hybridSamples; }
+
+  // Returns whether levels of detail are used. Choosing a level per object
+  // needs the per-object draw commands of frustum culling; impostors have
+  // no triangles to simplify.
+  bool usesLod() const { return lod && frustumCulling && !usesSphereImpostors(); }
+
+  // Returns whether the vertex buffer is compressed. Impostor vertices hold
+  // quad corners rather than positions and normals.
+  bool usesCompressedVertices() const { return compressedVertices && !usesSphereImpostors(); }
+
+  // Returns whether 16-bit indices are requested. Drawing a range of objects
+  // without culling is a single draw, which can only have one vertexOffset.
+  // (initScene still falls back to 32-bit indices if an object has more than
+  // 65536 vertices; see Sample::m_indexType.)
+  bool usesShortIndices() const { return shortIndices && frustumCulling; }
+
+  // Returns the number of floats in the Hi-Z pyramid (see hiZ.glsl) for a
+  // depth buffer of the given size.
+  static VkDeviceSize hiZTexels(uint32_t width, uint32_t height)
+  {
+    VkDeviceSize texels = 0;
+    do
+    {
+      width  = std::max(1u, (width + 1) / 2);
+      height = std::max(1u, (height + 1) / 2);
+      texels += static_cast<VkDeviceSize>(width) * static_cast<VkDeviceSize>(height);
+    } while(width > 1 || height > 1);
+    return texels;
+  }
+
+  // Returns the A-buffer layout the current algorithm uses. OIT_LINKEDLIST
+  // and OIT_WEIGHTED don't have fixed layers, so they ignore aBufferLayouts.
+  uint32_t aBufferLayout() const
+  {
+    if((algorithm == OIT_LINKEDLIST) || (algorithm == OIT_WEIGHTED))
+    {
+      return ABUFFER_LAYOUT_LAYER_MAJOR;
+    }
+    return aBufferLayouts[algorithm];
+  }
+
+  // Returns the number of pixels the A-buffer holds for a band of the given
+  // size. The tiled layout pads the band to whole tiles.
+  VkDeviceSize aBufferPixels(uint32_t width, uint32_t height) const
+  {
+    if(aBufferLayout() == ABUFFER_LAYOUT_TILED)
+    {
+      width  = (width + ABUFFER_TILE_SIZE - 1) / ABUFFER_TILE_SIZE * ABUFFER_TILE_SIZE;
+      height = (height + ABUFFER_TILE_SIZE - 1) / ABUFFER_TILE_SIZE * ABUFFER_TILE_SIZE;
+    }
+    return static_cast<VkDeviceSize>(width) * static_cast<VkDeviceSize>(height);
+  }
+
+  // Returns which A-buffer resources the current algorithm uses, and how large
+  // each A-buffer element is. Requires recomputeAntialiasingSettings to have
+  // been called.
+  ABufferRequirements getABufferRequirements() const
+  {
+    ABufferRequirements req;
+    // Mode  Coverage  Sample
+    // 1x    False     False
+    // MSAA  True      False
+    // SSAA  False     True
+    switch(algorithm)
+    {
+      case OIT_SIMPLE:
+        req.allocAux         = true;
+        req.elementsPerPixel = oitLayers;
+        req.strideBytes      = coverageShading() ? sizeof(uvec4) : sizeof(uvec2);
+        req.format           = coverageShading() ? VK_FORMAT_R32G32B32A32_UINT : VK_FORMAT_R32G32_UINT;
+        break;
+      case OIT_INTERLOCK:
+      case OIT_SPINLOCK:
+        req.allocAux         = true;
+        req.allocAuxSpin     = (algorithm == OIT_SPINLOCK);
+        req.allocAuxDepth    = true;
+        req.elementsPerPixel = oitLayers;
+        req.strideBytes      = coverageShading() ? sizeof(uvec4) : sizeof(uvec2);
+        req.format           = coverageShading() ? VK_FORMAT_R32G32B32A32_UINT : VK_FORMAT_R32G32_UINT;
+        break;
+      case OIT_LINKEDLIST:
+        req.allocAux         = true;
+        req.allocCounter     = true;
+        req.elementsPerPixel = linkedListAllocatedPerElement;
+        req.strideBytes      = sizeof(uvec4);
+        req.format           = VK_FORMAT_R32G32B32A32_UINT;
+        break;
+      case OIT_LOOP:
+        req.allocAux         = true;
+        // Depths and colors, plus coverage masks with MSAA pixel shading
+        req.elementsPerPixel = static_cast<VkDeviceSize>(oitLayers) * (coverageShading() ? 3 : 2);
+        req.strideBytes      = sizeof(uint);
+        req.format           = VK_FORMAT_R32_UINT;
+        break;
+      case OIT_LOOP64:
+        req.allocAux         = true;
+        req.elementsPerPixel = oitLayers;
+        req.strideBytes      = sizeof(uint64_t);
+        req.format           = VK_FORMAT_R32G32_UINT;
+        break;
+      case OIT_WEIGHTED:
+        // Doesn't use an A-buffer
+        break;
+      default:
+        assert(!"getABufferRequirements: Algorithm not implemented!");
+    }
+
+    req.allocAuxOpacity = usesOpacityCulling();
+
+    if(sampleShading)
+    {
+      req.elementsPerPixel *= msaa;
+    }
+    return req;
+  }
 
   void recomputeAntialiasingSettings()
   {
@@ -116,9 +374,186 @@ struct State
         assert(!"Antialiasing mode not implemented!");
         break;
     }
+
+    // Hybrid sample storage (see isEdgeFragment) uses the same resources as
+    // MSAA pixel shading, which divides the A-buffer's size by about msaa/2.
+    // Only OIT_SIMPLE and OIT_LINKEDLIST implement it.
+    hybridSamples = sampleShading && hybridSampleStorage && ((algorithm == OIT_SIMPLE) || (algorithm == OIT_LINKEDLIST));
+    if(hybridSamples)
+    {
+      sampleShading = false;
+    }
   }
 };
 
+// Measurements and hysteresis counters for Sample::autoTuneState.
+struct AutoTuner
+{
+  // Depth complexity is sampled on a grid of GRID x GRID pixels and sorted
+  // into buckets 0, 1, 2-3, 4-7, 8-15, 16-31, and 32+.
+  static const uint32_t GRID              = 16;
+  static const uint32_t HISTOGRAM_BUCKETS = 7;
+
+  // A readback buffer for each frame in flight, with the frame and algorithm
+  // that were used to fill it.
+  struct Readback
+  {
+    nvvk::Buffer buffer;
+    uint32_t     frame     = 0;
+    uint32_t     algorithm = OIT_WEIGHTED;
+    VkDeviceSize samples   = 0;  // The number of pixels or samples covered by the A-buffer.
+    uint32_t     epoch     = 0;  // The epoch the counts are tagged with, or 0 if they aren't tagged.
+    bool         pending   = false;
+  };
+  std::vector<Readback> readbacks;
+
+  bool     active        = false;         // Whether autoTuneState ran on the last frame
+  uint32_t baseAlgorithm = OIT_SPINLOCK;  // The A-buffer algorithm to return to after falling back to OIT_WEIGHTED
+
+  // Depth complexity statistics
+  bool     histogramValid = false;
+  uint32_t histogram[HISTOGRAM_BUCKETS] = {};
+  uint32_t p95DepthComplexity           = 0;     // 95th percentile over covered pixels
+  float    meanDepthComplexity          = 0.0f;  // Mean over all pixels
+
+  // Hysteresis
+  uint32_t lastChangeFrame     = 0;
+  uint32_t nextEvaluationFrame = 0;
+  uint32_t overBudgetStreak    = 0;
+  uint32_t underBudgetStreak   = 0;
+  double   lastGpuMs           = 0.0;
+};
+
+// The passes we count primitives and fragment shader invocations of using
+// pipeline statistics queries. Not every algorithm uses every pass.
+enum StatisticsPass : uint32_t
+{
+  STATISTICS_PASS_OPAQUE,
+  STATISTICS_PASS_DEPTH,  // Only used by OIT_LOOP
+  STATISTICS_PASS_COLOR,
+  STATISTICS_PASS_COMPOSITE,
+  NUM_STATISTICS_PASSES
+};
+
+// Pipeline statistics for each pass, and shader statistics reported by the
+// driver through VK_KHR_pipeline_executable_properties for each pipeline.
+struct ShaderStatistics
+{
+  // The maximum number of bands we record queries for; matches the GUI's
+  // limit on State::bands.
+  static const uint32_t MAX_BANDS = 64;
+
+  // Pipeline statistics of one pass, summed over all bands.
+  struct Pass
+  {
+    bool     valid                     = false;
+    uint64_t inputAssemblyPrimitives   = 0;
+    uint64_t fragmentShaderInvocations = 0;
+  };
+
+  // A statistic of a pipeline executable, with its value formatted as a
+  // JSON number or boolean.
+  struct Statistic
+  {
+    std::string name;
+    std::string description;
+    std::string value;
+  };
+
+  // The fragment shader executable of a pipeline.
+  struct Executable
+  {
+    const char*            pipelineName = nullptr;
+    std::string            name;
+    uint32_t               subgroupSize = 0;
+    std::vector<Statistic> statistics;
+  };
+
+  VkQueryPool           queryPool = VK_NULL_HANDLE;  // NUM_STATISTICS_PASSES queries per band per frame in flight
+  std::vector<uint32_t> cycleBands;                  // How many bands each frame in flight recorded queries for
+  uint32_t              currentQuery = ~0u;          // The query of pass 0 of the current band, or ~0u if not recording
+
+  Pass                    passes[NUM_STATISTICS_PASSES];
+  std::vector<Executable> executables;
+};
+
+// The buffers that hold a scene's geometry, as indices into
+// SceneGeometry::contents and SceneUpload::buffers.
+enum SceneBuffer : uint32_t
+{
+  SCENE_BUFFER_VERTICES,
+  SCENE_BUFFER_INDICES,
+  SCENE_BUFFER_MATERIALS,
+  SCENE_BUFFER_OBJECT_BOUNDS,
+  NUM_SCENE_BUFFERS
+};
+
+// A scene computed on the CPU by generateScene: the contents of its buffers,
+// and the values that describe their layout. This doesn't refer to any Vulkan
+// objects, so it can be generated on a worker thread.
+struct SceneGeometry
+{
+  // Bytes to upload to one of the scene's buffers.
+  struct Contents
+  {
+    const void*  data = nullptr;
+    VkDeviceSize size = 0;
+  };
+
+  std::vector<Vertex>           vertices;
+  std::vector<CompressedVertex> compressedVertices;  // Only with State::usesCompressedVertices
+  std::vector<nvmath::vec3ui>   triangles;
+  std::vector<uint16_t>         shortIndices;  // Only if indexType is VK_INDEX_TYPE_UINT16
+  std::vector<nvmath::vec4>     materials;     // The color of each object
+  std::vector<nvmath::vec4>     objectBounds;  // The bounding sphere of each object (center and radius)
+
+  VkIndexType                    indexType             = VK_INDEX_TYPE_UINT32;
+  uint32_t                       subdiv                = 0;  // The State::subdiv it was generated with
+  uint32_t                       objectTriangleIndices = 0;  // See Sample::m_objectTriangleIndices
+  uint32_t                       sceneTriangleIndices  = 0;  // See Sample::m_sceneTriangleIndices
+  uint32_t                       verticesPerObject     = 0;  // See SceneData::verticesPerObject
+  uint32_t                       vertexOffsetPerObject = 0;  // See SceneData::vertexOffsetPerObject
+  std::array<uint32_t, MAX_LODS> lodFirstIndex         = {};
+  std::array<uint32_t, MAX_LODS> lodIndexCount         = {};
+
+  // Returns what to upload to each buffer, indexed by SceneBuffer.
+  std::array<Contents, NUM_SCENE_BUFFERS> contents() const;
+};
+
+// Staging buffers are this large, so scene uploads copy at most this many
+// bytes per transfer submission.
+static const VkDeviceSize SCENE_UPLOAD_CHUNK_SIZE = 4 << 20;
+// The number of staging buffers scene uploads cycle through, which bounds how
+// many transfer submissions can be in flight.
+static const uint32_t SCENE_UPLOAD_CHUNKS = 4;
+
+// A scene being generated on a worker thread and then uploaded on the
+// transfer queue, while the current scene keeps rendering; see
+// Sample::startSceneUpload.
+struct SceneUpload
+{
+  // Scene generation. cancel is read by the worker thread.
+  bool                       active = false;  // If true, an upload is in progress
+  std::future<SceneGeometry> future;          // Valid until the worker thread has been waited on
+  std::atomic<bool>          cancel{false};
+  SceneGeometry              geometry;
+
+  // The new scene's buffers, and how much of their contents has been
+  // submitted for copying.
+  std::array<nvvk::Buffer, NUM_SCENE_BUFFERS> buffers;
+  uint32_t                                    nextBuffer = 0;  // The SceneBuffer being copied
+  VkDeviceSize                                nextOffset = 0;  // The offset in it to copy next
+
+  // Transfer resources, which persist across uploads. Each transfer
+  // submission copies through staging buffer N % SCENE_UPLOAD_CHUNKS and
+  // signals timeline value N + 1 when done.
+  VkSemaphore                                      timeline       = VK_NULL_HANDLE;
+  uint64_t                                         timelineValue  = 0;  // The value signaled by the last submission
+  VkCommandPool                                    commandPool    = VK_NULL_HANDLE;
+  std::array<VkCommandBuffer, SCENE_UPLOAD_CHUNKS> commandBuffers = {};
+  std::array<nvvk::Buffer, SCENE_UPLOAD_CHUNKS>    stagingBuffers;
+};
+
 class Sample : public nvvk::AppWindowProfilerVK
 {
 public:
@@ -135,27 +570,40 @@ public:
   VkViewport    m_viewportGUI               = {};
   VkRect2D      m_scissorGUI                = {};
   VkFramebuffer m_mainColorDepthFramebuffer = nullptr;
-  VkFramebuffer m_weightedFramebuffer       = nullptr;
   VkFramebuffer m_guiFramebuffer            = nullptr;
+  VkRect2D      m_bandRect                  = {};  // The band of m_colorImage being rendered
   ImageAndView  m_depthImage;
   ImageAndView  m_colorImage;
-  BufferAndView m_oitABuffer;
-  ImageAndView  m_oitAuxImage;
-  ImageAndView  m_oitAuxSpinImage;
-  ImageAndView  m_oitAuxDepthImage;
-  ImageAndView  m_oitCounterImage;
-  ImageAndView  m_oitWeightedColorImage;
-  ImageAndView  m_oitWeightedRevealImage;
+  // Only the first m_state.frameResourceSets of these are allocated.
+  std::array<OitFrameResources, MAX_FRAME_RESOURCE_SETS> m_oitFrames;
+  uint32_t m_oitFrameIndex = 0;  // The index of the set in m_oitFrames used by the frame being recorded
   ImageAndView m_downsampleImage;  // A 1spp image with the same format as m_colorImage used for resolving m_colorImage.
   ImageAndView m_guiCompositeImage;  // A 1spp image with the same format as the swapchain.
   VkSampler    m_pointSampler = nullptr;
   nvvk::Buffer m_vertexBuffer;
   nvvk::Buffer m_indexBuffer;
+  VkIndexType  m_indexType = VK_INDEX_TYPE_UINT32;  // VK_INDEX_TYPE_UINT16 if m_indexBuffer holds per-object indices
+  nvvk::Buffer m_materialBuffer;  // The color of each object, for deferred shading
+  nvvk::Buffer m_transformedBuffer;  // A TransformedVertex per vertex; only allocated with State::preTransform
+  nvvk::Buffer m_objectBoundsBuffer;  // The bounding sphere of each object, for frustum culling
+  nvvk::Buffer m_drawCommandBuffer;   // The visible objects' draw commands; see objectCull.comp.glsl
+  nvvk::Buffer m_hiZBuffer;  // The Hi-Z pyramid; only allocated with State::usesOcclusionCulling
+  nvvk::Buffer m_opaqueDepthBuffer;  // A copy of a band of m_depthImage; only allocated with State::usesSphereImpostors
+  SceneUpload  m_sceneUpload;  // The scene being generated and uploaded with State::asyncSceneUpload, if any
   // Shaders
   nvvk::ShaderModuleManager m_shaderModuleManager;
   nvvk::ShaderModuleID      m_shaderSceneVert;
   nvvk::ShaderModuleID      m_shaderOpaqueFrag;
   nvvk::ShaderModuleID      m_shaderFullScreenTriangleVert;
+  nvvk::ShaderModuleID      m_shaderTileCompositeVert;
+  nvvk::ShaderModuleID      m_shaderTileClassifyComp;
+  nvvk::ShaderModuleID      m_shaderPreTransformComp;
+  nvvk::ShaderModuleID      m_shaderPreTransformedVert;
+  nvvk::ShaderModuleID      m_shaderObjectCullComp;
+  nvvk::ShaderModuleID      m_shaderOcclusionCullComp;
+  nvvk::ShaderModuleID      m_shaderHiZBuildComp;
+  nvvk::ShaderModuleID      m_shaderSphereImpostorVert;
+  nvvk::ShaderModuleID      m_shaderOpaqueDepthCopyComp;
   nvvk::ShaderModuleID      m_shaderSimpleColorFrag;
   nvvk::ShaderModuleID      m_shaderSimpleCompositeFrag;
   nvvk::ShaderModuleID      m_shaderLinkedListColorFrag;
@@ -177,6 +625,7 @@ public:
   nvvk::DescriptorSetContainer m_descriptorInfo;
   // Render passes
   VkRenderPass m_renderPassColorDepthClear = nullptr;
+  VkRenderPass m_renderPassColorDepthLoad  = nullptr;
   VkRenderPass m_renderPassWeighted        = nullptr;
   VkRenderPass m_renderPassGUI             = nullptr;
   // Graphics pipelines (organized by the algorithms that use them)
@@ -196,6 +645,13 @@ public:
   VkPipeline m_pipelineSpinlockComposite   = nullptr;
   VkPipeline m_pipelineWeightedColor       = nullptr;
   VkPipeline m_pipelineWeightedComposite   = nullptr;
+  // Compute pipelines
+  VkPipeline m_pipelineTileClassify    = nullptr;
+  VkPipeline m_pipelinePreTransform    = nullptr;
+  VkPipeline m_pipelineObjectCull      = nullptr;
+  VkPipeline m_pipelineOcclusionCull   = nullptr;
+  VkPipeline m_pipelineHiZBuild        = nullptr;
+  VkPipeline m_pipelineOpaqueDepthCopy = nullptr;
 
   // GUI-specific variables
   ImGuiH::Registry m_imGuiRegistry;  // Helper class that tracks IDs for dear imgui
@@ -209,6 +665,12 @@ public:
   SceneData          m_sceneUbo;           // Uniform Buffer Object for the scene, depends on m_cameraControl.
   uint32_t           m_objectTriangleIndices = 0;  // The number of indices used in each sphere. (All objects have the same number of indices.)
   uint32_t           m_sceneTriangleIndices = 0;  // The total number of indices in the scene.
+  uint32_t           m_sceneSubdiv = 0;  // The State::subdiv the current scene was generated with
+  AutoTuner          m_autoTuner;                 // Statistics for choosing settings when m_state.autoTune is set.
+  ShaderStatistics   m_shaderStatistics;          // Pipeline and shader statistics shown in the GUI
+  FrameImagePlan     m_frameImagePlan;            // The sizes of the current frame images
+  VkDeviceSize       m_frameImageBudget = 0;      // The last memory budget computed by fitStateToMemoryBudget
+  std::string        m_frameImagePlanMessage;     // Describes the last downgrade made by fitStateToMemoryBudget
 
   // We make these constants so that we can create their render passes without
   // creating the images yet.
@@ -218,6 +680,15 @@ public:
 
   uint32_t m_frame = 0;
 
+  // Written to the working directory by the GUI
+  const char* const STATISTICS_REPORT_FILENAME = "oit_statistics.json";
+
+  // Tracing
+  const char* const TRACE_FILENAME = "oit_trace.json";  // Written to the working directory
+  TraceRecorder     m_trace;                             // Records CPU and GPU zones when the user starts a trace
+  int               m_traceFrames   = 120;               // How many frames the next trace records
+  uint32_t          m_traceEndFrame = 0;                 // The value of m_frame at which the current trace stops
+
 public:
   Sample()
       : AppWindowProfilerVK(false)
@@ -245,15 +716,16 @@ public:
   bool begin() override;
 
   // Immediately creates and executes a command buffer that updates the state
-  // of the renderer. Usually called from cmdUpdateRendererFromState. Should
-  // usually be only called when m_state != m_lastState.
+  // of the renderer. Usually called from cmdUpdateRendererFromState. Only
+  // submits and waits for the device to be idle if something changed.
   void updateRendererImmediate(bool swapchainSizeChanged, bool forceRebuildAll);
 
   // Compares m_state to m_lastState. If m_state changed, then
   // it updates the parts of the rendering system that need to change, such
   // as by reloading shaders and by regenerating internal buffers.
   // It also essentially tracks which objects depend on which parameters.
-  void cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchainSizeChanged, bool forceRebuildAll);
+  // Returns whether anything changed.
+  bool cmdUpdateRendererFromState(VkCommandBuffer cmdBuffer, bool swapchainSizeChanged, bool forceRebuildAll);
 
   // Tear down the sample, essentially by running creation in reverse
   void end() override;
@@ -276,25 +748,103 @@ public:
   void destroyScene();
 
   // Recomputes the geometry used for the scene (which is a single mesh, described by
-  // m_bufferVertices and m_bufferIndices). Then adds upload instructions to the command buffer.
+  // m_bufferVertices and m_bufferIndices), and synchronously uploads it.
+  // Cancels any asynchronous upload in progress.
   // Device must not be using resource when called.
   void initScene(VkCommandBuffer commandBuffer);
 
+  // Creates the (empty) vertex, index, material, and object bounds buffers
+  // for a scene, indexed by SceneBuffer.
+  void createSceneBuffers(const SceneGeometry& geometry, std::array<nvvk::Buffer, NUM_SCENE_BUFFERS>& buffers);
+
+  // Destroys the current scene, and replaces it with the given geometry, whose
+  // contents have already been uploaded to the given buffers. Takes ownership
+  // of the buffers, and creates the scene's other buffers.
+  // Device must not be using resource when called.
+  void adoptScene(const SceneGeometry& geometry, std::array<nvvk::Buffer, NUM_SCENE_BUFFERS>& buffers);
+
+  // Returns whether the device supports uploading scenes asynchronously
+  // (State::asyncSceneUpload).
+  bool supportsAsyncSceneUpload() const;
+
+  // Creates the timeline semaphore, command buffers, and staging buffers for
+  // asynchronous scene uploads, if supported. Called once.
+  void createSceneUploadResources();
+
+  // Cancels any upload in progress and destroys the scene upload resources.
+  void destroySceneUploadResources();
+
+  // Starts generating a scene for m_state on a worker thread, cancelling
+  // any upload in progress. The current scene keeps rendering until
+  // updateSceneUpload returns true. With State::asyncSceneUpload, this is
+  // used when only the number, size, or subdivision level of the objects
+  // changed.
+  void startSceneUpload();
+
+  // Stops the upload in progress, if any, waiting for the worker thread and
+  // the transfer queue, and destroys the buffers it created.
+  void cancelSceneUpload();
+
+  // Called once per frame. Once the worker thread is done, creates the new
+  // scene's buffers and copies as many chunks to them as there are free
+  // staging buffers. Returns true once all copies have completed; then, the
+  // caller must wait for the device to be idle and call finishSceneUpload.
+  bool updateSceneUpload();
+
+  // Replaces the current scene with the uploaded one. If the transfer queue
+  // is from a different family, adds barriers to cmdBuffer to acquire the
+  // buffers on the graphics queue.
+  // Device must not be using resource when called.
+  void finishSceneUpload(VkCommandBuffer cmdBuffer);
+
+  // Returns whether the device supports accessing the A-buffer through its
+  // buffer device address with 64-bit indices (State::aBufferDeviceAddress).
+  bool supportsABufferDeviceAddress() const;
+
+  // Returns whether the device supports drawing a GPU-computed number of
+  // objects (State::frustumCulling).
+  bool supportsFrustumCulling() const;
+
   // Device must not be using resource when called.
   void destroyFrameImages();
 
+  // Computes how much memory createFrameImages would allocate for the given
+  // state at the current swapchain size, and whether the A-buffer fits within
+  // the device's descriptor limits.
+  FrameImagePlan planFrameImages(const State& state) const;
+
+  // Returns how many bytes of device-local memory the frame images can use:
+  // what they currently use, plus most of the remaining heap budget reported
+  // by VK_EXT_memory_budget (or the heap sizes, if it's not supported).
+  VkDeviceSize getFrameImageMemoryBudget() const;
+
+  // If the frame images for m_state would not fit in memory or exceed device
+  // limits, downgrades m_state step by step (frame-resource sets, bands,
+  // A-buffer size, then antialiasing, then falling back to OIT_WEIGHTED) until they fit, and
+  // describes what it did in m_frameImagePlanMessage. If the A-buffer only
+  // exceeds descriptor limits, this first tries switching to
+  // State::aBufferDeviceAddress.
+  // Called from cmdUpdateRendererFromState before anything is reallocated.
+  void fitStateToMemoryBudget();
+
   // Creates the intermediate buffers used for order-independent transparency -
-  // these are all of the IMG_* textures referenced in common.h. Unlike static
-  // textures, their contents are recomputed each frame.
+  // these are all of the IMG_* textures referenced in common.h, once per
+  // frame-resource set. Unlike static textures, their contents are recomputed
+  // each frame.
   // Device must not be using resource when called.
   void createFrameImages(VkCommandBuffer cmdBuffer);
 
+  // Returns the frame-resource set used by the frame being recorded.
+  OitFrameResources& currentOitFrame() { return m_oitFrames[m_oitFrameIndex]; }
+
   // Device must not be using resource when called.
   void destroyDescriptorSets();
 
   // This needs to be recreated whenever the algorithm changes to or from
-  // OIT_LOOP64, as that algorithm uses a different descriptor type for
-  // the A-buffer.
+  // OIT_LOOP64, or State::aBufferDeviceAddress changes, as these use a
+  // different descriptor type for the A-buffer. It also needs to be recreated
+  // when State::frameResourceSets changes, since there's a descriptor set per
+  // swapchain image per frame-resource set.
   // Device must not be using resource when called.
   void createDescriptorSets();
 
@@ -302,6 +852,10 @@ public:
   // cause VkCmdBindDescriptorSets to bind all of the textures we need at once.
   void updateAllDescriptorSets();
 
+  // Returns the descriptor set for the current swapchain image and
+  // frame-resource set.
+  VkDescriptorSet getCurrentDescriptorSet();
+
   // Device must not be using resource when called.
   void destroyGUIRenderPass();
 
@@ -320,7 +874,18 @@ public:
   // Device must not be using resource when called.
   void createFramebuffers();
 
+  // Device must not be using resource when called.
+  void destroyAutoTuneResources();
+
+  // Creates a small host-visible readback buffer per frame in flight for
+  // sampling depth complexity. This function is intended to only be called once.
+  void createAutoTuneResources();
+
   // Updates global shader define; all shaders have to be recompiled after setting this.
+  // OIT_LAYERS, OIT_TAILBLEND, USE_EARLYDEPTH, OIT_EPOCH_TAGS,
+  // OIT_TILED_COMPOSITE, OIT_DEFERRED_SHADING, OIT_OPACITY_EARLY_OUT,
+  // OIT_OPACITY_CULLING, OIT_COLOR_ENCODING, and OIT_ABUFFER_LAYOUT are
+  // specialization constants instead, which createGraphicsPipeline sets.
   void updateShaderDefinitions();
 
   // Helper function to add new shader module to m_shadermoduleManager if
@@ -348,7 +913,12 @@ public:
   void destroyGraphicsPipelines();
 
   // Destroys all graphics pipelines, and creates only the graphics pipeline
-  // objects we need for a given algorithm.
+  // objects we need for a given algorithm, as well as m_pipelineTileClassify
+  // if the tiled composite is used, m_pipelinePreTransform if
+  // State::preTransform is, m_pipelineObjectCull if State::frustumCulling
+  // is, m_pipelineOcclusionCull and m_pipelineHiZBuild if
+  // State::usesOcclusionCulling is, and m_pipelineOpaqueDepthCopy if
+  // State::usesSphereImpostors is.
   // Device must not be using resource when called.
   void createGraphicsPipelines();
 
@@ -388,6 +958,10 @@ public:
   // m_oitAuxImage: 1200 x 1024, 2 layers.
   void DoObjectSizeText(ImageAndView iv, const char* name);
 
+  // If bytes is nonzero, draws ImGui text like
+  // A-buffer: 64.0 MB
+  void DoPlanSizeText(VkDeviceSize bytes, const char* name);
+
   // Displays the Dear ImGui interface.
   // This interface includes tooltips for each of the elements, and also shows
   // or hides fields based on the current OIT algorithm.
@@ -411,15 +985,124 @@ public:
   // Main loop
   void think(double time) override;
 
-  // Renders the scene including transparency to m_colorImage.
+  /////////////////////////////////////////////////////////////////////////////
+  // Auto-tuning                                                             //
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Returns the number of bytes of device-local memory the frame images would
+  // use with the given state. Only includes resources that depend on the
+  // algorithm (i.e. the A-buffer, auxiliary images, and weighted targets).
+  // Returns VK_WHOLE_SIZE if the A-buffer would exceed device limits.
+  VkDeviceSize estimateABufferBytes(const State& state) const;
+
+  // Returns how many bytes of device-local memory transparency resources can
+  // use: either m_state.autoTuneMemoryBudgetMB, or what's left of
+  // getFrameImageMemoryBudget after the color and depth images.
+  VkDeviceSize getABufferMemoryBudget() const;
+
+  // Returns the averaged GPU time in milliseconds of the clear and main
+  // sections of the current algorithm, or 0 if not available yet.
+  double getTransparencyGpuMilliseconds();
+
+  // If m_state.autoTune is set, adds commands to copy a sparse grid of
+  // per-pixel fragment counts (or the linked-list counter) to this frame's
+  // readback buffer. Must be called outside of a render pass.
+  void cmdSampleDepthComplexity(VkCommandBuffer cmdBuffer);
+
+  // Reads the readback buffer of the current ring cycle, if its frame has
+  // finished, and updates the depth complexity statistics in m_autoTuner.
+  void collectDepthComplexity();
+
+  // If m_state.autoTune is set, modifies m_state.algorithm, oitLayers, and
+  // linkedListAllocatedPerElement based on GPU timings, depth complexity, and
+  // memory budget. Changes are rate-limited so that cmdUpdateRendererFromState
+  // doesn't rebuild resources every frame. Call before updateRendererImmediate.
+  void autoTuneState();
+
+  // Renders the scene including transparency to m_colorImage. If
+  // m_state.bands > 1, this renders each band in turn with a scissor
+  // rectangle, clearing and reusing an A-buffer that only covers one band.
+  // This bounds A-buffer memory at very high resolutions, at the cost of a
+  // geometry pass per band. OIT_WEIGHTED always uses one band.
   void render(VkCommandBuffer& cmdBuffer);
 
+  // Clears the A-buffer and auxiliary images of the current algorithm.
+  // With State::usesEpochTags, this instead advances the current
+  // frame-resource set's epoch, and only clears when the epoch wraps around
+  // after EPOCH_MAX passes. Auxiliary values (and OIT_LOOP64's A-buffer)
+  // tagged with any other epoch read as cleared.
+  // Must be called outside of a render pass.
+  void clearTransparent(VkCommandBuffer& cmdBuffer);
+
+  // Runs preTransform.comp.glsl on the vertices of the first numObjects
+  // objects, and makes the results visible to vertex shaders. This saves
+  // vertex work when the transparent objects are drawn several times per
+  // frame, such as with OIT_LOOP or bands.
+  // Must be called outside of a render pass.
+  void cmdPreTransform(VkCommandBuffer& cmdBuffer, int numObjects);
+
+  // With State::frustumCulling, resets the draw command counts and runs
+  // objectCull.comp.glsl, which writes the draw commands of the visible
+  // objects, splitting them at SceneData::transparentObjects. Draws then use
+  // vkCmdDrawIndexedIndirectCountKHR.
+  // Must be called outside of a render pass.
+  void cmdCullObjects(VkCommandBuffer& cmdBuffer);
+
+  // Called after the opaque draw, ends the main render pass and makes
+  // m_depthImage readable by compute shaders through IMG_SCENE_DEPTH.
+  void cmdSuspendForOpaqueDepth(VkCommandBuffer& cmdBuffer);
+
+  // Undoes cmdSuspendForOpaqueDepth, resuming the render pass (without
+  // clearing) over m_bandRect.
+  void cmdResumeAfterOpaqueDepth(VkCommandBuffer& cmdBuffer);
+
+  // With State::usesOcclusionCulling, cmdCullObjects only writes the opaque
+  // objects' draw commands. Between cmdSuspendForOpaqueDepth and
+  // cmdResumeAfterOpaqueDepth, this builds the hierarchical-Z (Hi-Z) pyramid
+  // from m_depthImage and writes the draw commands of the first numObjects
+  // objects that are visible and not occluded.
+  void cmdOcclusionCull(VkCommandBuffer& cmdBuffer, int numObjects);
+
+  // With State::usesSphereImpostors, copies the current band of m_depthImage
+  // to m_opaqueDepthBuffer and makes it visible to fragment shaders. Must be
+  // called between cmdSuspendForOpaqueDepth and cmdResumeAfterOpaqueDepth.
+  void cmdCopyOpaqueDepth(VkCommandBuffer& cmdBuffer);
+
+  // Returns the number of objects drawn with the transparent passes. These
+  // are the first objects in the scene; the rest are opaque.
+  int getNumTransparentObjects() const;
+
+  // Clears the tile mask and resets the tile list's draw command.
+  // Must be called outside of a render pass.
+  void clearTiles(VkCommandBuffer& cmdBuffer);
+
+  // Resets the opacity bounds in IMG_AUXOPACITY to "nothing seen yet". These
+  // aren't epoch-tagged, so this happens every pass.
+  // Must be called outside of a render pass.
+  void clearOpacity(VkCommandBuffer& cmdBuffer);
+
+  // Called by the drawTransparent* functions between their color and
+  // composite passes. With the tiled composite, this ends the main render
+  // pass, builds the tile list from the tile mask, and resumes the render
+  // pass (without clearing) over m_bandRect. Otherwise, it does nothing.
+  // The tiled composite saves composite work in sparse scenes, at the cost
+  // of splitting the main render pass.
+  void cmdBeginComposite(VkCommandBuffer& cmdBuffer);
+
+  // Draws the composite pass with the bound pipeline: quads over the tiles in
+  // the tile list with the tiled composite, or a full-screen triangle.
+  void cmdDrawComposite(VkCommandBuffer& cmdBuffer);
+
   // Adds calls to bind vertex and index buffers and draw numObjects objects, starting
   // with firstObject. (In this sample, an object is a single sphere).
   // Assumes that a render pass has already been started, and that the bound pipeline
   // state object is compatible with the given vertex layout.
   void drawSceneObjects(VkCommandBuffer& cmdBuffer, int firstObject, int numObjects);
 
+  // Draws the first numObjects objects with the bound pipeline, or with
+  // State::frustumCulling, the visible ones among them.
+  void cmdDrawTransparentObjects(VkCommandBuffer& cmdBuffer, int numObjects);
+
   void clearTransparentSimple(VkCommandBuffer& cmdBuffer);
 
   // Draws the first numObjects objects using a simple OIT method.
@@ -427,7 +1110,8 @@ public:
   // index and vertex buffers for the mesh and descriptors are already good to go.
   void drawTransparentSimple(VkCommandBuffer& cmdBuffer, int numObjects);
 
-  void clearTransparentLinkedList(VkCommandBuffer& cmdBuffer);
+  // If clearHeads is false, only resets the atomic counter.
+  void clearTransparentLinkedList(VkCommandBuffer& cmdBuffer, bool clearHeads);
 
   // Draws the first numObjects objects using an OIT method where each fragment
   // has a linked list of fragments (using the A-buffer as a large pool of memory).
@@ -467,4 +1151,45 @@ public:
   // targets, which we implement using a render pass (see the creation of the
   // render pass for more information as to how that's set up).
   void drawTransparentWeighted(VkCommandBuffer& cmdBuffer, int numObjects);
+
+  /////////////////////////////////////////////////////////////////////////////
+  // Statistics                                                              //
+  /////////////////////////////////////////////////////////////////////////////
+
+  // Returns whether the device supports pipeline statistics queries.
+  bool supportsPipelineStatistics() const;
+
+  // Returns whether pipelines can be created with
+  // VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR.
+  bool supportsPipelineExecutableStatistics() const;
+
+  // Device must not be using resource when called.
+  void destroyStatisticsResources();
+
+  // Creates the pipeline statistics query pool, if supported. This function
+  // is intended to only be called once.
+  void createStatisticsResources();
+
+  // Reads the fragment shader statistics of each pipeline in use into
+  // m_shaderStatistics.executables. Call after createGraphicsPipelines.
+  void updateExecutableStatistics();
+
+  // Resets the current frame's pipeline statistics queries. Must be called
+  // outside of a render pass, before any other statistics commands.
+  void cmdResetPassStatistics(VkCommandBuffer cmdBuffer);
+
+  // Selects the queries that the following passes are counted in.
+  void setStatisticsBand(uint32_t band);
+
+  // Begins and ends counting a pass of the current band.
+  void cmdBeginPassStatistics(VkCommandBuffer cmdBuffer, StatisticsPass pass);
+  void cmdEndPassStatistics(VkCommandBuffer cmdBuffer, StatisticsPass pass);
+
+  // Reads the pipeline statistics of the current ring cycle, if its frame has
+  // finished, into m_shaderStatistics.passes.
+  void collectPassStatistics();
+
+  // Writes the current state, pass statistics, and shader statistics to a
+  // JSON file. Returns false if the file couldn't be written.
+  bool writeStatisticsReport(const char* filename) const;
 };
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Declares the A-buffer and functions for accessing it, so that the algorithm
+// shaders don't need to know how it's bound.
+//
+// By default, the A-buffer is a storage texel buffer (or, for OIT_LOOP64, a
+// storage buffer) indexed using 32-bit ints. This is limited by
+// maxTexelBufferElements, and indices overflow at very large resolutions and
+// layer counts. If OIT_ABUFFER_BDA is 1, we instead access the A-buffer
+// through its buffer device address (scene.aBufferAddress), and compute
+// indices using 64-bit integers.
+//
+// Before including this file, define
+//   ABUFFER_COMPONENTS: 1, 2, or 4 for elements of that many 32-bit uints,
+//     or 64 for elements that are a single uint64_t (used by OIT_LOOP64).
+//   ABUFFER_READONLY (optional): if defined, the A-buffer is restrict readonly;
+//     otherwise, it's coherent, and abufferStore and abufferAtomicMin exist.
+// This also requires coord and sampleID, from oitColorDepthDefines.glsl or
+// oitCompositeDefines.glsl.
+//
+// abufferLoad returns a uvec4 (with unused components set to 0), or a
+// uint64_t if ABUFFER_COMPONENTS is 64.
+
+#if OIT_ABUFFER_BDA
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+#define ABufferIndex uint64_t
+#else  // #if OIT_ABUFFER_BDA
+#define ABufferIndex int
+#endif  // #if OIT_ABUFFER_BDA
+
+#if ABUFFER_COMPONENTS == 64
+#extension GL_ARB_gpu_shader_int64 : require  // For uint64_t
+#define ABufferElement uint64_t
+#define ABufferValue uint64_t
+#define ABUFFER_STRIDE 8
+#define abufferToValue(e) (e)
+#define abufferFromValue(v) (v)
+#elif ABUFFER_COMPONENTS == 4
+#define ABufferElement uvec4
+#define ABufferValue uvec4
+#define ABUFFER_STRIDE 16
+#define ABUFFER_FORMAT rgba32ui
+#define abufferToValue(e) (e)
+#define abufferFromValue(v) (v)
+#elif ABUFFER_COMPONENTS == 2
+#define ABufferElement uvec2
+#define ABufferValue uvec4
+#define ABUFFER_STRIDE 8
+#define ABUFFER_FORMAT rg32ui
+#define abufferToValue(e) uvec4((e), 0, 0)
+#define abufferFromValue(v) (v).xy
+#else  // ABUFFER_COMPONENTS == 1
+#define ABufferElement uint
+#define ABufferValue uvec4
+#define ABUFFER_STRIDE 4
+#define ABUFFER_FORMAT r32ui
+#define abufferToValue(e) uvec4((e), 0, 0, 0)
+#define abufferFromValue(v) (v).x
+#endif  // ABUFFER_COMPONENTS
+
+#ifdef ABUFFER_READONLY
+#define ABUFFER_QUALIFIERS restrict readonly
+#else  // #ifdef ABUFFER_READONLY
+#define ABUFFER_QUALIFIERS coherent
+#endif  // #ifdef ABUFFER_READONLY
+
+#if OIT_ABUFFER_BDA
+
+// A reference to a single A-buffer element.
+layout(buffer_reference, std430, buffer_reference_align = ABUFFER_STRIDE) ABUFFER_QUALIFIERS buffer ABufferRef
+{
+  ABufferElement value;
+};
+
+ABufferRef abufferRef(ABufferIndex i)
+{
+  return ABufferRef(packUint2x32(scene.aBufferAddress) + i * uint64_t(ABUFFER_STRIDE));
+}
+
+ABufferValue abufferLoad(ABufferIndex i)
+{
+  return abufferToValue(abufferRef(i).value);
+}
+
+#ifndef ABUFFER_READONLY
+void abufferStore(ABufferIndex i, ABufferValue v)
+{
+  abufferRef(i).value = abufferFromValue(v);
+}
+
+#if ABUFFER_COMPONENTS == 1 || ABUFFER_COMPONENTS == 64
+ABufferElement abufferAtomicMin(ABufferIndex i, ABufferElement v)
+{
+  return atomicMin(abufferRef(i).value, v);
+}
+#endif  // #if ABUFFER_COMPONENTS == 1 || ABUFFER_COMPONENTS == 64
+#endif  // #ifndef ABUFFER_READONLY
+
+#elif ABUFFER_COMPONENTS == 64
+
+// OIT_LOOP64 binds the A-buffer as a storage buffer instead of a storage
+// texel buffer, since there are no 64-bit texel formats with atomics.
+layout(binding = IMG_ABUFFER, std430) ABUFFER_QUALIFIERS buffer ssboAbuffer
+{
+  uint64_t abuffer[];
+};
+
+ABufferValue abufferLoad(ABufferIndex i)
+{
+  return abuffer[i];
+}
+
+#ifndef ABUFFER_READONLY
+void abufferStore(ABufferIndex i, ABufferValue v)
+{
+  abuffer[i] = v;
+}
+
+ABufferElement abufferAtomicMin(ABufferIndex i, ABufferElement v)
+{
+  return atomicMin(abuffer[i], v);
+}
+#endif  // #ifndef ABUFFER_READONLY
+
+#else  // Storage texel buffer
+
+// A uimageBuffer is an unsigned storage texel buffer.
+layout(binding = IMG_ABUFFER, ABUFFER_FORMAT) uniform ABUFFER_QUALIFIERS uimageBuffer imgAbuffer;
+
+ABufferValue abufferLoad(ABufferIndex i)
+{
+  return imageLoad(imgAbuffer, i);
+}
+
+#ifndef ABUFFER_READONLY
+void abufferStore(ABufferIndex i, ABufferValue v)
+{
+  imageStore(imgAbuffer, i, v);
+}
+
+#if ABUFFER_COMPONENTS == 1
+ABufferElement abufferAtomicMin(ABufferIndex i, ABufferElement v)
+{
+  return imageAtomicMin(imgAbuffer, i, v);
+}
+#endif  // #if ABUFFER_COMPONENTS == 1
+#endif  // #ifndef ABUFFER_READONLY
+
+#endif  // #if OIT_ABUFFER_BDA
+
+// The number of A-buffer arrays per pixel.
+#if OIT_SAMPLE_SHADING
+#define ABUFFER_SAMPLES OIT_MSAA
+#else
+#define ABUFFER_SAMPLES 1
+#endif
+
+// Returns the offset between consecutive layers of the same pixel or sample.
+// This depends on OIT_ABUFFER_LAYOUT:
+// - ABUFFER_LAYOUT_LAYER_MAJOR stores layer 0 of every pixel, then layer 1,
+//   and so on. Neighboring pixels' accesses to the same layer are coalesced,
+//   but each of a pixel's layers is in a different cache line.
+// - ABUFFER_LAYOUT_INTERLEAVED stores all of a pixel's layers next to each
+//   other, so loops over one pixel's layers touch few cache lines.
+// - ABUFFER_LAYOUT_TILED stores ABUFFER_TILE_SIZE x ABUFFER_TILE_SIZE blocks
+//   of pixels one after another, and is layer-major within each block, so
+//   that both a warp's accesses and a pixel's layers stay close together.
+ABufferIndex abufferLayer(int layer)
+{
+  if(OIT_ABUFFER_LAYOUT == ABUFFER_LAYOUT_INTERLEAVED)
+  {
+    return ABufferIndex(layer);
+  }
+  else if(OIT_ABUFFER_LAYOUT == ABUFFER_LAYOUT_TILED)
+  {
+    return ABufferIndex(layer) * ABufferIndex(ABUFFER_TILE_SIZE * ABUFFER_TILE_SIZE);
+  }
+  return ABufferIndex(layer) * ABufferIndex(scene.viewport.z);
+}
+
+// Returns the Morton (Z-order) index of a position within a tile.
+uint abufferMorton(uvec2 p)
+{
+  p = (p | (p << 2)) & 0x33u;
+  p = (p | (p << 1)) & 0x55u;
+  return p.x | (p.y << 1);
+}
+
+// Returns the index of the first layer of the current pixel or sample, when
+// each sample uses layersPerSample layers.
+ABufferIndex abufferListPos(int layersPerSample)
+{
+  if(OIT_ABUFFER_LAYOUT == ABUFFER_LAYOUT_INTERLEAVED)
+  {
+    const ABufferIndex pixel = ABufferIndex(coord.y) * ABufferIndex(scene.viewport.x) + ABufferIndex(coord.x);
+    return (pixel * ABufferIndex(ABUFFER_SAMPLES) + ABufferIndex(sampleID)) * ABufferIndex(layersPerSample);
+  }
+  else if(OIT_ABUFFER_LAYOUT == ABUFFER_LAYOUT_TILED)
+  {
+    // The A-buffer is padded to a whole number of tiles; see State::aBufferPixels.
+    const uvec2        p            = uvec2(coord.xy);
+    const ABufferIndex tilesPerRow  = ABufferIndex((scene.viewport.x + ABUFFER_TILE_SIZE - 1) / ABUFFER_TILE_SIZE);
+    const ABufferIndex tile         = ABufferIndex(p.y / ABUFFER_TILE_SIZE) * tilesPerRow + ABufferIndex(p.x / ABUFFER_TILE_SIZE);
+    const ABufferIndex tileElements = ABufferIndex(ABUFFER_TILE_SIZE * ABUFFER_TILE_SIZE * ABUFFER_SAMPLES * layersPerSample);
+    return tile * tileElements + abufferLayer(layersPerSample * sampleID) + ABufferIndex(abufferMorton(p % ABUFFER_TILE_SIZE));
+  }
+  const ABufferIndex pixel = ABufferIndex(coord.y) * ABufferIndex(scene.viewport.x) + ABufferIndex(coord.x);
+  return abufferLayer(layersPerSample * sampleID) + pixel;
+}
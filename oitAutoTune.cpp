@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// This file contains the auto-tuner, which picks the algorithm, the number of
+// OIT layers, and the linked-list allocation size from GPU timings, the depth
+// complexity of the scene, and the memory budget.
+//
+// The depth complexity comes from the per-pixel fragment counts that some of
+// the algorithms already write to the aux image: OIT_SIMPLE counts all
+// fragments, and OIT_SPINLOCK and OIT_INTERLOCK count the fragments that pass
+// the opaque depth test. We copy a sparse grid of these counts to the CPU each
+// frame, which costs almost nothing compared to reading the whole image.
+// OIT_LINKEDLIST instead gives us the total number of fragments through its
+// atomic counter, which is enough to size its allocation.
+
+#include "oit.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <nvh/nvprint.hpp>
+
+// How many frames to wait after a change before evaluating again, so that the
+// profiler's averages only contain frames rendered with the new settings.
+static const uint32_t AUTOTUNE_COOLDOWN_FRAMES = 60;
+// How many frames to wait between evaluations.
+static const uint32_t AUTOTUNE_EVALUATION_INTERVAL = 30;
+// How many consecutive evaluations have to be over or under budget before we
+// change anything. This keeps a single slow frame from changing settings.
+static const uint32_t AUTOTUNE_STREAK = 3;
+// We only increase quality if we're using less than this fraction of the time
+// budget; otherwise, we'd likely go over budget and switch right back.
+static const double AUTOTUNE_UNDER_BUDGET_FRACTION = 0.6;
+// The range of oitLayers values the auto-tuner will choose from. These match
+// the values in the GUI_OITSAMPLES combo box.
+static const uint32_t AUTOTUNE_MIN_LAYERS = 2;
+static const uint32_t AUTOTUNE_MAX_LAYERS = 32;
+// The range of linkedListAllocatedPerElement values; matches the GUI.
+static const uint32_t AUTOTUNE_MAX_LINKED_LIST_ALLOCATION = 128;
+
+// Returns the smallest power of 2 that is greater than or equal to x.
+static uint32_t nextPowerOfTwo(uint32_t x)
+{
+  uint32_t result = 1;
+  while(result < x)
+  {
+    result *= 2;
+  }
+  return result;
+}
+
+// Reduces the cost of the given state by one step: halves the number of
+// layers (or the linked-list allocation), and then falls back to OIT_WEIGHTED.
+// Returns false if there's nothing left to reduce.
+static bool autoTuneStepDown(State& state)
+{
+  switch(state.algorithm)
+  {
+    case OIT_WEIGHTED:
+      return false;
+    case OIT_LINKEDLIST:
+      if(state.linkedListAllocatedPerElement > 1)
+      {
+        state.linkedListAllocatedPerElement = std::max(1u, state.linkedListAllocatedPerElement / 2);
+        return true;
+      }
+      break;
+    default:
+      if(state.oitLayers > AUTOTUNE_MIN_LAYERS)
+      {
+        state.oitLayers /= 2;
+        return true;
+      }
+      break;
+  }
+
+  state.algorithm = OIT_WEIGHTED;
+  return true;
+}
+
+// Increases the quality of the given state by one step: returns from
+// OIT_WEIGHTED to the base algorithm, and then doubles the number of layers
+// until it covers the 95th percentile of depth complexity.
+// Returns false if the state is already good enough.
+static bool autoTuneStepUp(State& state, const AutoTuner& tuner)
+{
+  if(state.algorithm == OIT_WEIGHTED)
+  {
+    state.algorithm = tuner.baseAlgorithm;
+    return true;
+  }
+
+  if(state.algorithm == OIT_LINKEDLIST || !tuner.histogramValid)
+  {
+    // The linked-list allocation is sized from the mean depth complexity instead.
+    return false;
+  }
+
+  const uint32_t targetLayers = std::min(nextPowerOfTwo(std::max(1u, tuner.p95DepthComplexity)), AUTOTUNE_MAX_LAYERS);
+  if(state.oitLayers < targetLayers)
+  {
+    state.oitLayers *= 2;
+    return true;
+  }
+  return false;
+}
+
+void Sample::destroyAutoTuneResources()
+{
+  for(AutoTuner::Readback& readback : m_autoTuner.readbacks)
+  {
+    m_allocatorDma.destroy(readback.buffer);
+  }
+  m_autoTuner.readbacks.clear();
+}
+
+void Sample::createAutoTuneResources()
+{
+  destroyAutoTuneResources();
+
+  // One readback buffer per frame in flight, so that we never read a buffer
+  // the GPU might still be writing to.
+  const VkDeviceSize bufferSize = AutoTuner::GRID * AutoTuner::GRID * sizeof(uint32_t);
+  m_autoTuner.readbacks.resize(nvvk::DEFAULT_RING_SIZE);
+  for(AutoTuner::Readback& readback : m_autoTuner.readbacks)
+  {
+    readback.buffer = m_allocatorDma.createBuffer(bufferSize,                        // Buffer size
+                                                  VK_BUFFER_USAGE_TRANSFER_DST_BIT,  // Usage
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT  // Memory flags
+    );
+    m_debug.setObjectName(readback.buffer.buffer, "m_autoTuner.readbacks");
+  }
+}
+
+VkDeviceSize Sample::estimateABufferBytes(const State& state) const
+{
+  const FrameImagePlan plan = planFrameImages(state);
+  return (plan.exceedsDeviceLimits ? VK_WHOLE_SIZE : plan.algorithmBytes());
+}
+
+VkDeviceSize Sample::getABufferMemoryBudget() const
+{
+  if(m_state.autoTuneMemoryBudgetMB != 0)
+  {
+    return static_cast<VkDeviceSize>(m_state.autoTuneMemoryBudgetMB) << 20;
+  }
+
+  // The color, depth, and resolve images don't depend on the algorithm.
+  const FrameImagePlan plan        = planFrameImages(m_state);
+  const VkDeviceSize   fixedBytes  = plan.totalBytes() - plan.algorithmBytes();
+  const VkDeviceSize   frameBudget = getFrameImageMemoryBudget();
+  return (frameBudget > fixedBytes ? frameBudget - fixedBytes : 0);
+}
+
+double Sample::getTransparencyGpuMilliseconds()
+{
+  const char* clearSection = nullptr;
+  switch(m_state.algorithm)
+  {
+    case OIT_SIMPLE:
+      clearSection = "ClearSimple";
+      break;
+    case OIT_LINKEDLIST:
+      clearSection = "ClearLinkedList";
+      break;
+    case OIT_LOOP:
+      clearSection = "ClearLoop";
+      break;
+    case OIT_LOOP64:
+      clearSection = "ClearLoop64";
+      break;
+    case OIT_INTERLOCK:
+    case OIT_SPINLOCK:
+      clearSection = "ClearLock";
+      break;
+    default:
+      break;
+  }
+
+  // Timer averages are in microseconds.
+  nvh::Profiler::TimerInfo info;
+  if(!m_profilerVK.getTimerInfo("Main", info))
+  {
+    return 0.0;
+  }
+  double microseconds = info.gpu.average;
+
+  if(clearSection != nullptr && m_profilerVK.getTimerInfo(clearSection, info))
+  {
+    microseconds += info.gpu.average;
+  }
+
+  return microseconds / 1000.0;
+}
+
+void Sample::cmdSampleDepthComplexity(VkCommandBuffer cmdBuffer)
+{
+  if(!m_state.autoTune || m_autoTuner.readbacks.empty())
+  {
+    return;
+  }
+
+  AutoTuner::Readback& readback = m_autoTuner.readbacks[m_ringFences.getCycleIndex()];
+  readback.pending              = false;
+
+  // Find the image to read from, and which texels to read.
+  // When rendering in bands, these only contain the last band's fragments.
+  std::vector<VkBufferImageCopy> regions;
+  const ImageAndView*            source = nullptr;
+  switch(m_state.algorithm)
+  {
+    case OIT_SIMPLE:
+    case OIT_INTERLOCK:
+    case OIT_SPINLOCK:
+      source = &currentOitFrame().auxImage;
+      // Sample the centers of a GRID x GRID grid of cells from the first layer
+      for(uint32_t y = 0; y < AutoTuner::GRID; y++)
+      {
+        for(uint32_t x = 0; x < AutoTuner::GRID; x++)
+        {
+          VkBufferImageCopy region               = {};
+          region.bufferOffset                    = (y * AutoTuner::GRID + x) * sizeof(uint32_t);
+          region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+          region.imageSubresource.layerCount     = 1;
+          region.imageOffset.x                   = static_cast<int32_t>(((2 * x + 1) * source->c_width) / (2 * AutoTuner::GRID));
+          region.imageOffset.y                   = static_cast<int32_t>(((2 * y + 1) * source->c_height) / (2 * AutoTuner::GRID));
+          region.imageExtent                     = {1, 1, 1};
+          regions.push_back(region);
+        }
+      }
+      break;
+    case OIT_LINKEDLIST:
+    {
+      // The counter contains the total number of fragments, including those that didn't fit.
+      source                             = &currentOitFrame().counterImage;
+      VkBufferImageCopy region           = {};
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.layerCount = 1;
+      region.imageExtent                 = {1, 1, 1};
+      regions.push_back(region);
+      break;
+    }
+    default:
+      // OIT_LOOP and OIT_LOOP64 don't count fragments, and OIT_WEIGHTED has
+      // no per-pixel storage. Keep the statistics from the last algorithm.
+      return;
+  }
+
+  if(source->view == nullptr)
+  {
+    return;
+  }
+
+  // Make sure the fragment shader writes complete before copying.
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,  //
+                         1, &barrier,                                                                        //
+                         0, VK_NULL_HANDLE,                                                                  //
+                         0, VK_NULL_HANDLE);
+  }
+
+  vkCmdCopyImageToBuffer(cmdBuffer, source->image.image, VK_IMAGE_LAYOUT_GENERAL, readback.buffer.buffer,
+                         static_cast<uint32_t>(regions.size()), regions.data());
+
+  // Make the copy visible to the host, and make sure next frame's clear
+  // doesn't overwrite the source before the copy reads it.
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,  //
+                         1, &barrier,                                                                                           //
+                         0, VK_NULL_HANDLE,                                                                                     //
+                         0, VK_NULL_HANDLE);
+  }
+
+  const ImageAndView& auxImage = currentOitFrame().auxImage;
+
+  readback.frame     = m_frame;
+  readback.algorithm = m_state.algorithm;
+  readback.samples   = static_cast<VkDeviceSize>(auxImage.c_width) * auxImage.c_height * auxImage.c_layers;
+  readback.epoch     = (m_state.usesEpochTags() && m_state.algorithm != OIT_LINKEDLIST) ? currentOitFrame().epoch : 0;
+  readback.pending   = true;
+}
+
+void Sample::collectDepthComplexity()
+{
+  if(m_autoTuner.readbacks.empty())
+  {
+    return;
+  }
+
+  // setCycleAndWait has waited for the fence of this cycle, so the frame that
+  // filled this buffer has finished.
+  AutoTuner::Readback& readback = m_autoTuner.readbacks[m_ringFences.getCycleIndex()];
+  if(!readback.pending)
+  {
+    return;
+  }
+  readback.pending = false;
+
+  const uint32_t* counts = static_cast<const uint32_t*>(m_allocatorDma.map(readback.buffer));
+
+  if(readback.algorithm == OIT_LINKEDLIST)
+  {
+    // We only know the total, so we can compute the mean but not the histogram.
+    if(readback.samples != 0)
+    {
+      m_autoTuner.meanDepthComplexity = static_cast<float>(static_cast<double>(counts[0]) / static_cast<double>(readback.samples));
+    }
+  }
+  else
+  {
+    const uint32_t numSamples = AutoTuner::GRID * AutoTuner::GRID;
+
+    std::vector<uint32_t> covered;
+    covered.reserve(numSamples);
+    uint64_t total = 0;
+    std::fill(std::begin(m_autoTuner.histogram), std::end(m_autoTuner.histogram), 0);
+
+    for(uint32_t i = 0; i < numSamples; i++)
+    {
+      uint32_t count = counts[i];
+      if(readback.epoch != 0)
+      {
+        // Counts from earlier epochs are really 0.
+        count = ((count >> EPOCH_SHIFT) == readback.epoch) ? (count & EPOCH_VALUE_MASK) : 0;
+      }
+      total += count;
+
+      // Bucket 0 holds 0, bucket b > 0 holds [2^(b-1), 2^b), and the last bucket holds the rest.
+      uint32_t bucket = 0;
+      if(count > 0)
+      {
+        covered.push_back(count);
+        bucket = 1;
+        while(bucket < AutoTuner::HISTOGRAM_BUCKETS - 1 && (count >> bucket) != 0)
+        {
+          bucket++;
+        }
+      }
+      m_autoTuner.histogram[bucket]++;
+    }
+
+    m_autoTuner.meanDepthComplexity = static_cast<float>(total) / static_cast<float>(numSamples);
+    m_autoTuner.p95DepthComplexity  = 0;
+    if(!covered.empty())
+    {
+      const size_t p95Index = (covered.size() * 95 + 99) / 100 - 1;
+      std::nth_element(covered.begin(), covered.begin() + p95Index, covered.end());
+      m_autoTuner.p95DepthComplexity = covered[p95Index];
+    }
+    m_autoTuner.histogramValid = true;
+  }
+
+  m_allocatorDma.unmap(readback.buffer);
+}
+
+void Sample::autoTuneState()
+{
+  AutoTuner& tuner = m_autoTuner;
+
+  if(!m_state.autoTune)
+  {
+    tuner.active = false;
+    return;
+  }
+
+  const bool userChangedAlgorithm = (m_state.algorithm != m_lastState.algorithm);
+  if(!tuner.active || userChangedAlgorithm)
+  {
+    // Auto-tuning was just enabled, or the user picked a different algorithm
+    // in the GUI: remember which A-buffer algorithm to return to, and start
+    // measuring from scratch.
+    if(m_state.algorithm != OIT_WEIGHTED)
+    {
+      tuner.baseAlgorithm = m_state.algorithm;
+    }
+    tuner.active              = true;
+    tuner.lastChangeFrame     = m_frame;
+    tuner.nextEvaluationFrame = m_frame + AUTOTUNE_COOLDOWN_FRAMES;
+    tuner.overBudgetStreak    = 0;
+    tuner.underBudgetStreak   = 0;
+    return;
+  }
+
+  if(m_frame < tuner.nextEvaluationFrame)
+  {
+    return;
+  }
+  tuner.nextEvaluationFrame = m_frame + AUTOTUNE_EVALUATION_INTERVAL;
+
+  const double gpuMs = getTransparencyGpuMilliseconds();
+  if(gpuMs <= 0.0)
+  {
+    return;
+  }
+  tuner.lastGpuMs = gpuMs;
+
+  const VkDeviceSize memoryBudget = getABufferMemoryBudget();
+  State              next         = m_state;
+
+  if(estimateABufferBytes(next) > memoryBudget)
+  {
+    // Out of memory: step down right away until we fit.
+    while(estimateABufferBytes(next) > memoryBudget && autoTuneStepDown(next))
+    {
+    }
+  }
+  else
+  {
+    if(gpuMs > m_state.autoTuneTargetMs)
+    {
+      tuner.overBudgetStreak++;
+      tuner.underBudgetStreak = 0;
+    }
+    else if(gpuMs < m_state.autoTuneTargetMs * AUTOTUNE_UNDER_BUDGET_FRACTION)
+    {
+      tuner.underBudgetStreak++;
+      tuner.overBudgetStreak = 0;
+    }
+    else
+    {
+      tuner.overBudgetStreak  = 0;
+      tuner.underBudgetStreak = 0;
+    }
+
+    bool steppedDown = false;
+    if(tuner.overBudgetStreak >= AUTOTUNE_STREAK)
+    {
+      steppedDown = autoTuneStepDown(next);
+    }
+    else if(tuner.underBudgetStreak >= AUTOTUNE_STREAK)
+    {
+      State candidate = next;
+      if(autoTuneStepUp(candidate, tuner) && estimateABufferBytes(candidate) <= memoryBudget)
+      {
+        next = candidate;
+      }
+    }
+
+    // Size the linked-list allocation to the measured mean depth complexity
+    // plus some headroom, but only resize if it's off by more than 25%, since
+    // that reallocates the A-buffer. Growing it costs time like a step up, so
+    // it needs the same under-budget streak, and it's never done in an
+    // evaluation that just stepped down; otherwise the two would undo each
+    // other on every evaluation.
+    if(next.algorithm == OIT_LINKEDLIST && !steppedDown && tuner.overBudgetStreak == 0 && tuner.meanDepthComplexity > 0.0f)
+    {
+      const uint32_t desired =
+          std::min(std::max(1u, static_cast<uint32_t>(std::ceil(tuner.meanDepthComplexity * 1.5f))), AUTOTUNE_MAX_LINKED_LIST_ALLOCATION);
+      const uint32_t current = next.linkedListAllocatedPerElement;
+      const uint32_t difference = (desired > current ? desired - current : current - desired);
+      if(difference * 4 > current)
+      {
+        State candidate                         = next;
+        candidate.linkedListAllocatedPerElement = desired;
+        if(desired < current
+           || (tuner.underBudgetStreak >= AUTOTUNE_STREAK && estimateABufferBytes(candidate) <= memoryBudget))
+        {
+          next = candidate;
+        }
+      }
+    }
+  }
+
+  if(next.algorithm != m_state.algorithm || next.oitLayers != m_state.oitLayers
+     || next.linkedListAllocatedPerElement != m_state.linkedListAllocatedPerElement)
+  {
+    LOGI("auto-tune: %.2f ms; algorithm %u -> %u, layers %u -> %u, allocated per element %u -> %u\n", gpuMs,
+         m_state.algorithm, next.algorithm, m_state.oitLayers, next.oitLayers, m_state.linkedListAllocatedPerElement,
+         next.linkedListAllocatedPerElement);
+    m_state.algorithm                     = next.algorithm;
+    m_state.oitLayers                     = next.oitLayers;
+    m_state.linkedListAllocatedPerElement = next.linkedListAllocatedPerElement;
+
+    // Wait for the profiler to collect timings with the new settings.
+    tuner.lastChangeFrame     = m_frame;
+    tuner.nextEvaluationFrame = m_frame + AUTOTUNE_COOLDOWN_FRAMES;
+    tuner.overBudgetStreak    = 0;
+    tuner.underBudgetStreak   = 0;
+  }
+}
@@ -36,22 +36,130 @@
 #extension GL_ARB_post_depth_coverage : enable
 layout(post_depth_coverage) in;
 
-// If OIT_COVERAGE_SHADING is used, then the a-buffer uses three components;
-// otherwise, it uses two.
+// If OIT_COVERAGE_SHADING is used, then the a-buffer uses three components
+// (padded to four); otherwise, it uses two.
 #if OIT_COVERAGE_SHADING
 #define abufferType rgba32ui
+#define abufferComponents 4
 #define storeMask gl_SampleMaskIn[0]
 #else  // #if OIT_COVERAGE_SHADING
 #define abufferType rg32ui
+#define abufferComponents 2
 #define storeMask 0
 #endif  // #if OIT_COVERAGE_SHADING
 
+// coord indexes the A-buffer and auxiliary images, which only cover the
+// current band, so it's relative to the top of the band.
 #if OIT_SAMPLE_SHADING && OIT != OIT_WEIGHTED
 #define uimage2DUsed uimage2DArray
 #define sampleID gl_SampleID
-ivec3 coord = ivec3(gl_FragCoord.xy, gl_SampleID);
+ivec3 coord = ivec3(gl_FragCoord.x, int(gl_FragCoord.y) - pushConstants.bandOffsetY, gl_SampleID);
 #else  // #if OIT_SAMPLE_SHADING && OIT != OIT_WEIGHTED
 #define uimage2DUsed uimage2D
 #define sampleID 0
-ivec2 coord = ivec2(gl_FragCoord.xy);
-#endif  // #if OIT_SAMPLE_SHADING && OIT != OIT_WEIGHTED
\ No newline at end of file
+ivec2 coord = ivec2(gl_FragCoord.x, int(gl_FragCoord.y) - pushConstants.bandOffsetY);
+#endif  // #if OIT_SAMPLE_SHADING && OIT != OIT_WEIGHTED
+
+#if OIT_HYBRID_SAMPLES
+// With OIT_HYBRID_SAMPLES, SSAA stores fragments the way MSAA pixel shading
+// does (once per pixel, with a coverage mask), except that fragments that only
+// partially cover their pixel - usually at triangle edges - are shaded and
+// stored once per covered sample. Returns whether this is such a fragment.
+bool isEdgeFragment()
+{
+  return gl_SampleMaskIn[0] != (1 << OIT_MSAA) - 1;
+}
+
+// Evaluates the including shader's Interpolants IN at MSAA sample s.
+#define interpolantsAtSample(s)                                                                          \
+  Interpolants(interpolateAtSample(IN.pos, s), interpolateAtSample(IN.normal, s),                        \
+               interpolateAtSample(IN.color, s), interpolateAtSample(IN.depth, s))
+#endif  // #if OIT_HYBRID_SAMPLES
+
+// The index of the object this fragment belongs to; see object.vert.glsl.
+layout(location = OBJECT_ID_LOCATION) flat in uint inObjectID;
+
+// With OIT_OPACITY_CULLING, each texel stores a depth D (the upper 24 bits of
+// a depth's float bits, rounded up) and an upper bound T on the transmittance
+// (1 - opacity) of some of the fragments at or in front of D, in 8-bit fixed
+// point. Both only ever become more restrictive, so once T drops to
+// 1 - scene.opacityThreshold, fragments behind D are hidden; see
+// opacityCulled.
+layout(binding = IMG_AUXOPACITY, r32ui) uniform coherent uimage2DUsed imgAuxOpacity;
+
+// With OIT_OPACITY_CULLING, returns true if this fragment is behind enough
+// other fragments that it can be skipped. Otherwise, accounts for this
+// fragment's opacity and returns false. Fragments that only partially cover a
+// pixel with OIT_COVERAGE_SHADING aren't counted, so that the bound holds for
+// every sample.
+bool opacityCulled(float opacity)
+{
+  if(!OIT_OPACITY_CULLING)
+  {
+    return false;
+  }
+
+  const uint depthBits        = floatBitsToUint(FRAGMENT_DEPTH);
+  const uint depthFloor       = depthBits >> 8;
+  const uint depthCeil        = (depthBits + 255u) >> 8;
+  const uint minTransmittance = uint((1.0 - scene.opacityThreshold) * 255.0);
+
+  uint expected = imageLoad(imgAuxOpacity, coord).r;
+  while(true)
+  {
+    const uint savedDepth         = expected >> 8;
+    const uint savedTransmittance = expected & 0xFFu;
+    if(depthFloor > savedDepth && savedTransmittance <= minTransmittance)
+    {
+      return true;
+    }
+
+#if OIT_COVERAGE_SHADING
+    if(gl_SampleMaskIn[0] != (1 << OIT_MSAA) - 1)
+    {
+      return false;
+    }
+#endif
+
+    // Round the transmittance up, so that T stays an upper bound.
+    const uint newTransmittance = uint(ceil(float(savedTransmittance) * (1.0 - opacity)));
+    const uint desired          = (max(savedDepth, depthCeil) << 8) | newTransmittance;
+    if(desired == expected)
+    {
+      return false;
+    }
+    const uint actual = imageAtomicCompSwap(imgAuxOpacity, coord, expected, desired);
+    if(actual == expected)
+    {
+      return false;
+    }
+    expected = actual;
+  }
+  return false;
+}
+
+// The tile mask has one bit per TILE_SIZE x TILE_SIZE tile of the band; see
+// markTransparentTile.
+layout(binding = IMG_TILE_MASK, std430) coherent buffer tileMaskBuffer
+{
+  uint tileMask[];
+};
+
+// If OIT_TILED_COMPOSITE is true, marks the tile containing this fragment in
+// the tile mask, so that the composite pass draws it. Color passes call this
+// for every fragment they process.
+void markTransparentTile()
+{
+  if(OIT_TILED_COMPOSITE)
+  {
+    const ivec2 tile  = ivec2(coord.xy) / TILE_SIZE;
+    const uint  index = uint(tile.y * scene.tiles.x + tile.x);
+    const uint  bit   = 1u << (index % 32u);
+    // Most fragments land in tiles that are already marked, so only use an
+    // atomic if the bit isn't set yet.
+    if((tileMask[index / 32u] & bit) == 0)
+    {
+      atomicOr(tileMask[index / 32u], bit);
+    }
+  }
+}
@@ -21,26 +21,30 @@
 // Includes defines used for composite passes, as well as sorting functions
 // that depend upon these defines.
 
-// If OIT_COVERAGE_SHADING is used, then the a-buffer uses three components;
-// otherwise, it uses two.
+// If OIT_COVERAGE_SHADING is used, then the a-buffer uses three components
+// (padded to four); otherwise, it uses two.
 #if OIT_COVERAGE_SHADING
 #define abufferType rgba32ui
+#define abufferComponents 4
 #define loadType uvec3
 #define loadOp(a) (a).rgb
 #else  // #if OIT_COVERAGE_SHADING
 #define abufferType rg32ui
+#define abufferComponents 2
 #define loadType uvec2
 #define loadOp(a) (a).rg
 #endif  // #if OIT_COVERAGE_SHADING
 
+// coord indexes the A-buffer and auxiliary images, which only cover the
+// current band, so it's relative to the top of the band.
 #if OIT_SAMPLE_SHADING
 #define uimage2DUsed uimage2DArray
 #define sampleID gl_SampleID
-ivec3 coord = ivec3(gl_FragCoord.xy, gl_SampleID);
+ivec3 coord = ivec3(gl_FragCoord.x, int(gl_FragCoord.y) - pushConstants.bandOffsetY, gl_SampleID);
 #else  // #if OIT_SAMPLE_SHADING && OIT != OIT_WEIGHTED
 #define uimage2DUsed uimage2D
 #define sampleID 0
-ivec2 coord = ivec2(gl_FragCoord.xy);
+ivec2 coord = ivec2(gl_FragCoord.x, int(gl_FragCoord.y) - pushConstants.bandOffsetY);
 #endif  // #if OIT_SAMPLE_SHADING && OIT != OIT_WEIGHTED
 
 // These sorting routines depend on loadType, so we define them here.
@@ -50,7 +54,6 @@ ivec2 coord = ivec2(gl_FragCoord.xy);
 // (this is O(n^2)!)
 void bubbleSort(inout uvec2 array[OIT_LAYERS], int n)
 {
-#if OIT_LAYERS > 1
   for(int i = (n - 2); i >= 0; --i)
   {
     for(int j = 0; j <= i; ++j)
@@ -64,14 +67,12 @@ void bubbleSort(inout uvec2 array[OIT_LAYERS], int n)
       }
     }
   }
-#endif  // #if OIT_LAYERS > 1
 }
 
 // Also define a 3-component version of bubbleSort if OIT_MSAA is defined
 #if OIT_MSAA
 void bubbleSort(inout uvec3 array[OIT_LAYERS], int n)
 {
-#if OIT_LAYERS > 1
   for(int i = (n - 2); i >= 0; --i)
   {
     for(int j = 0; j <= i; ++j)
@@ -85,10 +86,49 @@ void bubbleSort(inout uvec3 array[OIT_LAYERS], int n)
       }
     }
   }
-#endif  // #if OIT_LAYERS > 1
 }
 #endif  // #if OIT_MSAA
 
+#if OIT_COVERAGE_SHADING
+// Returns the average of the colors of the OIT_MSAA samples, where each
+// sample's color is the result of blending the sorted fragments that cover it.
+// Samples covered by exactly the same fragments blend to the same color, so
+// instead of blending once per sample, this blends once per group of such
+// samples and weights the result by the group's size. In the common case
+// where every fragment covers the same samples, this is a single blend.
+vec4 blendCoverageGroups(const uvec3 array[OIT_LAYERS], int fragments)
+{
+  vec4 colorSum  = vec4(0);
+  uint remaining = (1u << OIT_MSAA) - 1u;  // Samples that haven't been blended yet
+
+  while(remaining != 0u)
+  {
+    const int s = findLSB(remaining);
+
+    // Find the remaining samples covered by exactly the same fragments as s.
+    uint group = remaining;
+    for(int i = 0; i < fragments; i++)
+    {
+      group &= (((array[i].b >> s) & 1u) != 0u) ? array[i].b : ~array[i].b;
+    }
+
+    vec4 sColor = vec4(0);
+    for(int i = 0; i < fragments && !opacitySaturated(sColor); i++)
+    {
+      if(((array[i].b >> s) & 1u) != 0u)
+      {
+        doBlendPacked(sColor, array[i].r);
+      }
+    }
+
+    colorSum += sColor * float(bitCount(group));
+    remaining &= ~group;
+  }
+
+  return colorSum / OIT_MSAA;
+}
+#endif  // #if OIT_COVERAGE_SHADING
+
 // Inserts a new item into array so that array remains sorted in increasing
 // order according to its second components.
 void insertionSort(inout loadType array[OIT_LAYERS], loadType newitem)
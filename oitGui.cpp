@@ -22,6 +22,8 @@
 
 #include "oit.h"
 
+#include <nvh/nvprint.hpp>
+
 // If the cursor was hovering over the last item, displays a tooltip.
 void Sample::LastItemTooltip(const char* text)
 {
@@ -58,6 +60,16 @@ void Sample::DoObjectSizeText(ImageAndView iv, const char* name)
   }
 }
 
+// If bytes is nonzero, draws ImGui text like
+// A-buffer: 64.0 MB
+void Sample::DoPlanSizeText(VkDeviceSize bytes, const char* name)
+{
+  if(bytes != 0)
+  {
+    ImGui::Text("%s: %.1f MB", name, static_cast<double>(bytes) / (1024.0 * 1024.0));
+  }
+}
+
 void Sample::DoGUI(int width, int height, double time)
 {
   ImGui::GetIO().DeltaTime = static_cast<float>(time - m_uiTime);
@@ -91,19 +103,22 @@ void Sample::DoGUI(int width, int height, double time)
         "then iterates over its linked list, sorts the frontmost OIT_LAYERS "
         "fragments by depth, and tail-blends the rest.";
     algorithmDescriptions[OIT_LOOP] =
-        "A three-shader A-buffer method that does not support MSAA. "
+        "A three-shader A-buffer method. "
         "Each sample first sorts the depths of its frontmost OIT_LAYERS "
         "fragments, which it can do in parallel using 32-bit atomics. "
         "Then it orders the colors of its fragments by matching them "
         "to their depths in this array, and tail-blends the rest. "
-        "The compositing shader then blends the sorted fragments together.";
+        "The compositing shader then blends the sorted fragments together. "
+        "With MSAA pixel shading, each layer also stores its coverage mask.";
     algorithmDescriptions[OIT_LOOP64] =
-        "A two-shader A-buffer method that does not support MSAA. "
+        "A two-shader A-buffer method. "
         "This algorithm only appears if your device supports 64-bit atomics. "
         "We can pack the 32-bit depth and 8-bit-per-channel color together "
         "into a 64-bit integer. Each sample then sorts the frontmost "
         "OIT_LAYERS fragments together in parallel using 64-bit atomics. "
-        "The compositing shader then blends the sorted fragments together.";
+        "The compositing shader then blends the sorted fragments together. "
+        "With MSAA pixel shading, the depth is reduced to 24 bits to make "
+        "room for the coverage mask.";
     algorithmDescriptions[OIT_INTERLOCK] =
         "A two-shader A-buffer method with a critical section. Instead of "
         "using spinlocks, we can use the GL_ARB_fragment_shader_interlock "
@@ -159,6 +174,85 @@ void Sample::DoGUI(int width, int height, double time)
           "transparency blending instead.");
     }
 
+    if(m_state.algorithm == OIT_LOOP || m_state.algorithm == OIT_LOOP64 || m_state.algorithm == OIT_SPINLOCK
+       || m_state.algorithm == OIT_INTERLOCK)
+    {
+      ImGui::Checkbox("Early depth test", &m_state.earlyDepth);
+      LastItemTooltip(
+          "Skips most of the work for fragments behind the frontmost OIT_LAYERS "
+          "fragments stored so far. This usually helps when using many layers.");
+    }
+
+    if(m_state.algorithm != OIT_LOOP && m_state.algorithm != OIT_WEIGHTED)
+    {
+      ImGui::Checkbox("Epoch-tagged clears", &m_state.epochTags);
+      LastItemTooltip(
+          "Tags per-pixel counters and list heads (and OIT_LOOP64's A-buffer) "
+          "with an epoch that advances every frame, and treats values from "
+          "earlier epochs as empty. This replaces the per-frame clears of the "
+          "auxiliary images with a clear every 255 frames, which saves "
+          "bandwidth at high sample counts. Depths used for the early depth "
+          "test are stored with 24 bits of precision, and linked lists are "
+          "limited to 2^24 elements.");
+    }
+
+    if(m_state.algorithm != OIT_WEIGHTED)
+    {
+      ImGui::Checkbox("Tiled composite", &m_state.tiledComposite);
+      LastItemTooltip(
+          "Color passes mark the 16x16 tiles that contain transparent "
+          "fragments, a compute shader gathers the marked tiles into an "
+          "indirect draw, and the composite pass only runs on those tiles "
+          "instead of on the whole screen. This helps with sparse scenes "
+          "and low percentages of transparent objects, at the cost of "
+          "splitting the main render pass.");
+
+      ImGui::Checkbox("Deferred shading", &m_state.deferredShading);
+      LastItemTooltip(
+          "Color passes store each fragment's object index and normal "
+          "instead of its shaded color, and fragments are only shaded once "
+          "they're composited or tail-blended. This saves shading work for "
+          "fragments that are evicted from or never make it into the "
+          "A-buffer.");
+
+      ImGui::Checkbox("Opacity early-out", &m_state.opacityEarlyOut);
+      LastItemTooltip(
+          "Composite passes stop blending sorted fragments once the "
+          "accumulated opacity reaches the opacity threshold, since anything "
+          "behind them changes the result by less than 1 - threshold. The "
+          "linked list composite also stops tail-blending once its tail "
+          "reaches the threshold.");
+
+      if(m_state.algorithm != OIT_LOOP)
+      {
+        ImGui::Checkbox("Opacity culling", &m_state.opacityCulling);
+        LastItemTooltip(
+            "Color passes track a conservative bound on each pixel's "
+            "accumulated opacity in an extra auxiliary image, and reject "
+            "fragments behind the point where it reaches the opacity "
+            "threshold before they touch the A-buffer. This costs an atomic "
+            "compare-and-swap per fragment.");
+      }
+
+      if(!m_state.deferredShading)
+      {
+        m_imGuiRegistry.enumCombobox(GUI_COLOR_ENCODING, "color encoding", &m_state.colorEncoding);
+        LastItemTooltip(
+            "How colors are stored in the A-buffer. srgb8 matches the color "
+            "buffer, but costs three pow()s per channel to decode, once per "
+            "fragment per sample in the composite pass. The lookup table "
+            "stores the same bits and decodes them with a 256-entry table. "
+            "Gamma 2 decodes by squaring and is close to sRGB. Linear rgb10a2 "
+            "has more color precision, but only 4 levels of opacity.");
+      }
+
+      if(m_state.opacityEarlyOut || m_state.opacityCulling)
+      {
+        ImGui::SliderFloat("Opacity threshold", &m_sceneUbo.opacityThreshold, 0.5f, 1.0f);
+        LastItemTooltip("The accumulated opacity beyond which fragments are skipped.");
+      }
+    }
+
     if(m_state.algorithm != OIT_WEIGHTED && m_state.algorithm != OIT_LINKEDLIST)
     {
       m_imGuiRegistry.enumCombobox(GUI_OITSAMPLES, "layers", &m_state.oitLayers);
@@ -166,6 +260,15 @@ void Sample::DoGUI(int width, int height, double time)
           "How many slots in the A-buffer to reserve for each pixel "
           "or sample. Each pixel or sample has its own space, and tail-blends "
           "its remaining fragments once it runs out of space.");
+
+      m_imGuiRegistry.enumCombobox(GUI_ABUFFER_LAYOUT, "A-buffer layout", &m_state.aBufferLayouts[m_state.algorithm]);
+      LastItemTooltip(
+          "How this algorithm arranges each pixel's layers in the A-buffer. "
+          "Layer-major keeps neighboring pixels' accesses to the same layer "
+          "together. Pixel-interleaved keeps each pixel's layers together. "
+          "Tiled is layer-major within 8x8 blocks of pixels, which keeps "
+          "both close together. Which is fastest depends on the algorithm "
+          "and the GPU, so each algorithm remembers its own choice.");
     }
 
     if(m_state.algorithm == OIT_LINKEDLIST)
@@ -177,6 +280,107 @@ void Sample::DoGUI(int width, int height, double time)
           "Once the A-buffer runs out of space, the remaining fragments are tail-blended.");
     }
 
+    if(m_state.algorithm != OIT_WEIGHTED && supportsABufferDeviceAddress())
+    {
+      ImGui::Checkbox("64-bit A-buffer addressing", &m_state.aBufferDeviceAddress);
+      LastItemTooltip(
+          "Accesses the A-buffer through its buffer device address using 64-bit "
+          "indices, instead of through a texel buffer or storage buffer descriptor. "
+          "This allows A-buffers larger than the device's descriptor limits, at "
+          "very high resolutions and layer counts. It's turned on automatically "
+          "when the A-buffer wouldn't fit otherwise.");
+    }
+
+    if(m_state.algorithm != OIT_WEIGHTED)
+    {
+      ImGuiH::InputIntClamped("Bands", &m_state.bands, 1, 64, 1, 4);
+      LastItemTooltip(
+          "Renders the frame in this many horizontal bands, reusing an A-buffer "
+          "that's only large enough for one band. This divides the A-buffer and "
+          "auxiliary image memory by the number of bands, at the cost of drawing "
+          "the scene once per band - useful for very high resolutions or "
+          "low-memory devices. The number of bands is increased automatically "
+          "when the frame images wouldn't fit in memory.");
+    }
+
+    ImGui::Checkbox("Sphere impostors", &m_state.sphereImpostors);
+    LastItemTooltip(
+        "Draws each object as two camera-facing quads instead of a sphere mesh, "
+        "and ray-casts the sphere in the fragment shaders to find its exact "
+        "front and back surfaces and their depths. Vertex work no longer "
+        "depends on the sphere's detail, so this scales to millions of "
+        "objects. Not used with MSAA pixel shading or hybrid sample storage, "
+        "and replaces pre-transformed vertices.");
+
+    ImGui::Checkbox("Pre-transform vertices", &m_state.preTransform);
+    LastItemTooltip(
+        "Transforms the transparent objects' vertices once per frame in a "
+        "compute pass, and has the passes that draw them read the results "
+        "instead of transforming them again. This helps when they're drawn "
+        "several times per frame, as with loop32's depth and color passes or "
+        "with several bands, at the cost of 64 bytes of memory per vertex.");
+
+    ImGui::Checkbox("Compressed vertices", &m_state.compressedVertices);
+    LastItemTooltip(
+        "Stores each vertex in 8 bytes instead of 40: its position as 16-bit "
+        "offsets from its object's bounding sphere, and its normal as two "
+        "8-bit octahedral coordinates, with the color taken from the object. "
+        "The vertex shaders then read and decode vertices from a storage "
+        "buffer instead of using vertex attributes. Not used with sphere "
+        "impostors.");
+
+    if(supportsFrustumCulling())
+    {
+      ImGui::Checkbox("Frustum culling", &m_state.frustumCulling);
+      LastItemTooltip(
+          "Tests each object's bounding sphere against the view frustum in a "
+          "compute pass, and only draws the visible ones, using indirect draws "
+          "whose count is computed on the GPU. This helps most when the camera "
+          "is zoomed in and most of the scene is off-screen.");
+
+      if(m_state.frustumCulling)
+      {
+        ImGui::Checkbox("Occlusion culling", &m_state.occlusionCulling);
+        LastItemTooltip(
+            "Also builds a hierarchical-Z pyramid from the depth buffer after "
+            "drawing the opaque objects, and skips transparent objects that are "
+            "entirely behind opaque geometry. Only used with a single band, "
+            "since otherwise the depth buffer only covers one band at a time.");
+
+        ImGui::Checkbox("16-bit indices", &m_state.shortIndices);
+        LastItemTooltip(
+            "Stores each object's indices relative to its first vertex, in 16 "
+            "bits instead of 32, and has each draw command offset them to the "
+            "object's vertices. This halves the index buffer's size and the "
+            "bandwidth of fetching indices.");
+
+        if(!m_state.usesSphereImpostors())
+        {
+          ImGui::Checkbox("Level of detail", &m_state.lod);
+          LastItemTooltip(
+              "Also builds coarser versions of each sphere, halving the "
+              "subdivision level up to three times, and draws each visible "
+              "object with the finest one whose triangles are still at least "
+              "the given size on screen. This keeps distant spheres from "
+              "producing sub-pixel triangles, at the cost of about a third "
+              "more vertices and indices.");
+          if(m_state.lod)
+          {
+            ImGui::SliderFloat("LOD triangle size", &m_state.lodTriangleSize, 1.0f, 32.0f, "%.1f px");
+            LastItemTooltip("The minimum on-screen length of a triangle edge, in pixels, when choosing a level of detail.");
+          }
+        }
+      }
+    }
+
+    ImGuiH::InputIntClamped("Frame-resource sets", &m_state.frameResourceSets, 1, MAX_FRAME_RESOURCE_SETS, 1, 1);
+    LastItemTooltip(
+        "How many copies of the A-buffer, auxiliary images, and weighted images "
+        "to allocate. Consecutive frames use different copies, so that one "
+        "frame's clear doesn't have to wait for the previous frame's composite "
+        "pass to finish. Multiplies the memory those use; reduced to 1 first "
+        "when the frame images wouldn't fit in memory.");
+
     // Anti-aliasing
     m_imGuiRegistry.enumCombobox(GUI_AA, "anti-aliasing", &m_state.aaType);
     const char* antialiasingDescriptions[NUM_AATYPES];
@@ -188,6 +392,48 @@ void Sample::DoGUI(int width, int height, double time)
     antialiasingDescriptions[AA_SUPER_4X] = "Renders at twice the resolution and height.";
     LastItemTooltip(antialiasingDescriptions[m_state.aaType]);
 
+    if((m_state.aaType == AA_SSAA_4X || m_state.aaType == AA_SSAA_8X)
+       && (m_state.algorithm == OIT_SIMPLE || m_state.algorithm == OIT_LINKEDLIST))
+    {
+      ImGui::Checkbox("Hybrid sample storage", &m_state.hybridSampleStorage);
+      LastItemTooltip(
+          "Stores fragments that fully cover their pixel once, with a "
+          "coverage mask, and only shades and stores fragments at triangle "
+          "edges once per covered sample. This makes the A-buffer about as "
+          "large as with per-pixel shading, at the cost of shading interior "
+          "fragments once per pixel.");
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Auto-tune");
+
+    ImGui::Checkbox("Auto-tune", &m_state.autoTune);
+    LastItemTooltip(
+        "Automatically chooses the number of layers, the linked-list "
+        "allocation size, and whether to fall back to weighted, blended OIT, "
+        "so that transparency fits within the GPU time and memory budgets. "
+        "Depth complexity is measured from a sparse grid of pixels when using "
+        "the simple, spinlock, or interlock algorithms.");
+    if(m_state.autoTune)
+    {
+      ImGui::SliderFloat("Target GPU ms", &m_state.autoTuneTargetMs, 0.5f, 33.0f);
+      LastItemTooltip("The GPU time budget for clearing, drawing, and compositing the scene.");
+      ImGuiH::InputIntClamped("Memory budget (MB)", &m_state.autoTuneMemoryBudgetMB, 0, 65536, 64, 1024);
+      LastItemTooltip(
+          "The maximum amount of device-local memory the A-buffer and auxiliary "
+          "images can use. 0 uses the budget reported by VK_EXT_memory_budget.");
+      ImGui::Text("GPU time: %.2f ms", m_autoTuner.lastGpuMs);
+      ImGui::Text("Mean depth complexity: %.2f", m_autoTuner.meanDepthComplexity);
+      if(m_autoTuner.histogramValid)
+      {
+        const uint32_t* h = m_autoTuner.histogram;
+        ImGui::Text("95th percentile: %u", m_autoTuner.p95DepthComplexity);
+        ImGui::Text("0: %u  1: %u  2-3: %u  4-7: %u", h[0], h[1], h[2], h[3]);
+        ImGui::Text("8-15: %u  16-31: %u  32+: %u", h[4], h[5], h[6]);
+        LastItemTooltip("A histogram of the number of fragments per pixel, over a grid of sampled pixels.");
+      }
+    }
+
     ImGui::Separator();
     ImGui::Text("Scene");
 
@@ -201,16 +447,119 @@ void Sample::DoGUI(int width, int height, double time)
     LastItemTooltip("The radius of the smallest spheres.");
     ImGui::SliderFloat("Scale width", &m_state.scaleWidth, 0, 4.0f);
     LastItemTooltip("How much the radii of the spheres can vary.");
+    if(supportsAsyncSceneUpload())
+    {
+      ImGui::Checkbox("Asynchronous upload", &m_state.asyncSceneUpload);
+      LastItemTooltip(
+          "When the settings above change, generates the new scene on a worker "
+          "thread and uploads it in chunks on the transfer queue, while the "
+          "current scene keeps rendering. Otherwise, the application stops "
+          "until the new scene has been generated and uploaded.");
+    }
+    if(m_sceneUpload.active)
+    {
+      ImGui::TextUnformatted(m_sceneUpload.future.valid() ? "Generating scene..." : "Uploading scene...");
+    }
 
     ImGui::Separator();
     ImGui::Text("Object Sizes");
-    DoObjectSizeText(m_oitABuffer, "A-buffer");
-    DoObjectSizeText(m_oitAuxImage, "Aux image");
-    DoObjectSizeText(m_oitAuxSpinImage, "Spinlock image");
-    DoObjectSizeText(m_oitAuxDepthImage, "Furthest depths");
-    DoObjectSizeText(m_oitCounterImage, "Atomic counter");
-    DoObjectSizeText(m_oitWeightedColorImage, "Weighted color");
-    DoObjectSizeText(m_oitWeightedRevealImage, "Reveal image");
+    // All frame-resource sets have the same sizes, so we only show the first.
+    const OitFrameResources& frame = m_oitFrames[0];
+    DoObjectSizeText(frame.aBuffer, "A-buffer");
+    DoObjectSizeText(frame.auxImage, "Aux image");
+    DoObjectSizeText(frame.auxSpinImage, "Spinlock image");
+    DoObjectSizeText(frame.auxDepthImage, "Furthest depths");
+    DoObjectSizeText(frame.counterImage, "Atomic counter");
+    DoObjectSizeText(frame.weightedColorImage, "Weighted color");
+    DoObjectSizeText(frame.weightedRevealImage, "Reveal image");
+    if(m_state.frameResourceSets > 1)
+    {
+      ImGui::Text("(x%u frame-resource sets)", m_state.frameResourceSets);
+    }
+
+    // Memory breakdown from the resource planner
+    DoPlanSizeText(m_frameImagePlan.color + m_frameImagePlan.depth, "Color + depth");
+    DoPlanSizeText(m_frameImagePlan.resolve, "Resolve + GUI");
+    DoPlanSizeText(m_frameImagePlan.aBuffer, "A-buffer");
+    DoPlanSizeText(m_frameImagePlan.aux, "Auxiliary images");
+    DoPlanSizeText(m_frameImagePlan.weighted, "Weighted targets");
+    DoPlanSizeText(m_frameImagePlan.totalBytes(), "Total");
+    LastItemTooltip(
+        "The memory used by the frame images, estimated before allocating them. "
+        "If a configuration would not fit in the memory budget reported by "
+        "VK_EXT_memory_budget, or would exceed the device's descriptor limits, "
+        "the A-buffer size, antialiasing mode, and algorithm are reduced until it fits.");
+    DoPlanSizeText(m_frameImageBudget, "Last budget");
+    if(!m_frameImagePlanMessage.empty())
+    {
+      ImGui::TextWrapped("%s", m_frameImagePlanMessage.c_str());
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Statistics");
+    {
+      const char* passNames[NUM_STATISTICS_PASSES] = {"Opaque", "Depth", "Color", "Composite"};
+      for(uint32_t pass = 0; pass < NUM_STATISTICS_PASSES; pass++)
+      {
+        const ShaderStatistics::Pass& statistics = m_shaderStatistics.passes[pass];
+        if(statistics.valid)
+        {
+          ImGui::Text("%s: %llu prims, %llu frags", passNames[pass],
+                      static_cast<unsigned long long>(statistics.inputAssemblyPrimitives),
+                      static_cast<unsigned long long>(statistics.fragmentShaderInvocations));
+        }
+      }
+      LastItemTooltip(
+          "Input assembly primitives and fragment shader invocations of each "
+          "pass, from pipeline statistics queries, summed over all bands.");
+    }
+    for(const ShaderStatistics::Executable& executable : m_shaderStatistics.executables)
+    {
+      if(ImGui::TreeNode(executable.pipelineName, "%s (subgroup size %u)", executable.pipelineName, executable.subgroupSize))
+      {
+        for(const ShaderStatistics::Statistic& statistic : executable.statistics)
+        {
+          ImGui::Text("%s: %s", statistic.name.c_str(), statistic.value.c_str());
+          LastItemTooltip(statistic.description.c_str());
+        }
+        ImGui::TreePop();
+      }
+    }
+    if(ImGui::Button("Write statistics report"))
+    {
+      if(writeStatisticsReport(STATISTICS_REPORT_FILENAME))
+      {
+        LOGI("Wrote statistics report to %s\n", STATISTICS_REPORT_FILENAME);
+      }
+      else
+      {
+        LOGW("Could not write statistics report to %s\n", STATISTICS_REPORT_FILENAME);
+      }
+    }
+    LastItemTooltip(
+        "Writes the current settings, pass statistics, and the statistics the "
+        "driver reports for each fragment shader (such as register counts and "
+        "spills) to oit_statistics.json.");
+
+    ImGui::Separator();
+    ImGui::Text("Tracing");
+    if(m_trace.isRecording())
+    {
+      ImGui::Text("Recording: %u frames left", m_traceEndFrame - std::min(m_traceEndFrame, m_frame));
+    }
+    else
+    {
+      ImGuiH::InputIntClamped("Frames to trace", &m_traceFrames, 1, 10000, 10, 100);
+      if(ImGui::Button("Record trace"))
+      {
+        m_trace.start();
+        m_traceEndFrame = m_frame + uint32_t(m_traceFrames);
+      }
+      LastItemTooltip(
+          "Records CPU zones for each phase of a frame and GPU timestamps for each "
+          "profiler section, and writes them to oit_trace.json. Open it in "
+          "chrome://tracing or ui.perfetto.dev to see how the CPU and GPU overlap.");
+    }
   }
   ImGui::End();
 }
\ No newline at end of file
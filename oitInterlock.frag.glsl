@@ -62,44 +62,66 @@ layout(pixel_interlock_unordered) in;
 #pragma error "OIT_INTERLOCK requires GL_NV_fragment_shader_interlock or GL_ARB_fragment_shader_interlock!"
 #endif  // #if GL_NV_fragment_shader_interlock || GL_ARB_fragment_shader_interlock
 
-layout(binding = IMG_ABUFFER, abufferType) uniform coherent uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS abufferComponents
+#include "oitABuffer.glsl"
+
 // Stores the number of fragments that have been processed by this pixel.
 layout(binding = IMG_AUX, r32ui) uniform coherent uimage2DUsed imgAux;
 // Stores the depth of the furthest fragment that was inserted into the A-buffer.
 layout(binding = IMG_AUXDEPTH, r32ui) uniform coherent uimage2DUsed imgDepth;
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0, index = 0) out vec4 outColor;
 
 void main()
 {
-  // Get the unpremultiplied linear-space RGBA color of this pixel
-  vec4 color = shading(IN);
-  // Convert to unpremultiplied sRGB for 8-bit storage
-  const vec4 sRGBColor = unPremultLinearToSRGB(color);
+  // Skip fragments hidden behind enough opacity - or, with
+  // OIT_SPHERE_IMPOSTORS, that miss their sphere. (We can't return before
+  // beginInvocationInterlock, so this only skips the critical section.)
+#if OIT_SPHERE_IMPOSTORS
+  const bool culled = !raycastImpostor(rasterIN, inObjectID, true, IN) || opacityCulled(materialOpacity(IN.color.a));
+#else
+  const bool culled = opacityCulled(materialOpacity(IN.color.a));
+#endif
+
+  // Let the composite pass know that this fragment's tile contains transparency.
+  markTransparentTile();
+
+  // Get the 32-bit color to store in the A-buffer. With OIT_DEFERRED_SHADING,
+  // this fragment is only shaded if it's composited or tail-blended.
+  const uint packedColor = packFragmentColor(IN, inObjectID);
+
+  // Which fragment to tail-blend, if any: this one, or one evicted from the
+  // A-buffer. Either is only shaded once we know it's tail-blended.
+  bool tailBlendSelf    = !culled;
+  bool tailBlendEvicted = false;
+  uint evictedColor     = 0;
 
   // Compute index in the A-buffer
-  const int viewSize = scene.viewport.z;
-  const int listPos  = viewSize * OIT_LAYERS * sampleID + (coord.y * scene.viewport.x + coord.x);
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
-  uvec4 storeValue = uvec4(packUnorm4x8(sRGBColor), floatBitsToUint(gl_FragCoord.z), storeMask, 0);
+  uvec4 storeValue = uvec4(packedColor, floatBitsToUint(FRAGMENT_DEPTH), storeMask, 0);
 
   // Critical section --
   beginInvocationInterlock();
-#if USE_EARLYDEPTH
-  uint oldDepth = imageLoad(imgDepth, coord).r;
-  if(storeValue.y <= oldDepth)
-#endif  // #if USE_EARLYDEPTH
+  if(!culled && (!USE_EARLYDEPTH || furthestDepthTest(storeValue.y, imageLoad(imgDepth, coord).r)))
   {
-    const uint oldCounter = imageLoad(imgAux, coord).r;
-    imageStore(imgAux, coord, uvec4(oldCounter + 1));
+    const uint oldCounter = epochLoad(imageLoad(imgAux, coord).r);
+    imageStore(imgAux, coord, uvec4(epochStore(oldCounter + 1)));
 
     if(oldCounter < OIT_LAYERS)
     {
-      imageStore(imgAbuffer, listPos + int(oldCounter) * viewSize, storeValue);
+      abufferStore(listPos + abufferLayer(int(oldCounter)), storeValue);
 
       // Inserted, so we won't tail-blend it:
-      color = vec4(0);
+      tailBlendSelf = false;
     }
     else
     {
@@ -109,7 +131,7 @@ void main()
 
       for(int i = 0; i < OIT_LAYERS; i++)
       {
-        const uint testDepth = imageLoad(imgAbuffer, listPos + i * viewSize).g;
+        const uint testDepth = abufferLoad(listPos + abufferLayer(i)).g;
         if(testDepth > maxDepth)
         {
           maxDepth = testDepth;
@@ -120,19 +142,28 @@ void main()
       if(maxDepth > storeValue.g)
       {
         // Replace the furthest fragment, tail-blending it, with this fragment.
-        color = unPremultSRGBToLinear(unpackUnorm4x8(imageLoad(imgAbuffer, listPos + furthest * viewSize).r));
-        imageStore(imgAbuffer, listPos + furthest * viewSize, storeValue);
-#if USE_EARLYDEPTH
-        imageStore(imgDepth, coord, uvec4(maxDepth));
-#endif  // #if USE_EARLYDEPTH
+        tailBlendSelf    = false;
+        tailBlendEvicted = true;
+        evictedColor     = abufferLoad(listPos + abufferLayer(furthest)).r;
+        abufferStore(listPos + abufferLayer(furthest), storeValue);
+        if(USE_EARLYDEPTH)
+        {
+          imageStore(imgDepth, coord, uvec4(furthestDepthStore(maxDepth)));
+        }
       }
     }
   }
   endInvocationInterlock();
 // -- End critical section
-#if OIT_TAILBLEND
-  outColor = vec4(color.rgb * color.a, color.a);  // Premultiply the color
-#endif                                            // #if OIT_TAILBLEND
+  if(OIT_TAILBLEND && (tailBlendSelf || tailBlendEvicted))
+  {
+    const vec4 color = tailBlendSelf ? shading(IN) : unpackFragmentColor(evictedColor);
+    outColor         = vec4(color.rgb * color.a, color.a);  // Premultiply the color
+  }
+  else
+  {
+    outColor = vec4(0);
+  }
 }
 
 #endif // #if PASS == PASS_COLOR
@@ -151,7 +182,10 @@ void main()
 
 // Stores up to OIT_LAYERS fragments per (MSAA) sample and their depths.
 // Im Vulkan, an imageBuffer maps to a Storage Texel Buffer.
-layout(binding = IMG_ABUFFER, abufferType) uniform restrict readonly uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS abufferComponents
+#define ABUFFER_READONLY
+#include "oitABuffer.glsl"
+
 // Stores the number of fragments processed so far per (MSAA) sample.
 layout(binding = IMG_AUX, r32ui) uniform restrict readonly uimage2DUsed imgAux;
 
@@ -163,21 +197,19 @@ void main()
 
   vec4 color = vec4(0);
 
-  // Get the number of pixels in the image.
-  int viewSize = scene.viewport.z;
   // Get the index of the current sample at the current fragment.
-  int listPos = viewSize * OIT_LAYERS * sampleID + coord.y * scene.viewport.x + coord.x;
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
   // Load the number of fragments for the given sample. Then load those
   // fragments and sort them.
 
   // The number of fragments for this sample.
-  int fragments = int(imageLoad(imgAux, coord).r);
+  int fragments = int(epochLoad(imageLoad(imgAux, coord).r));
   fragments     = min(OIT_LAYERS, fragments);
 
   for(int i = 0; i < fragments; i++)
   {
-    array[i] = loadOp(imageLoad(imgAbuffer, listPos + i * viewSize));
+    array[i] = loadOp(abufferLoad(listPos + abufferLayer(i)));
   }
 
   bubbleSort(array, fragments);
@@ -185,26 +217,12 @@ void main()
   vec4 colorSum = vec4(0);  // Initially completely transparent
 
 #if OIT_COVERAGE_SHADING
-  // Compute the blended color of each MSAA sample from the fragments stored
-  // in the A-buffer. For each MSAA sample, we loop through the fragments
-  // and see which fragments covered this sample.
-
-  for(int s = 0; s < OIT_MSAA; s++)
-  {
-    vec4 sColor = vec4(0);
-    for(int i = 0; i < fragments; i++)
-    {
-      if((array[i].b & (1 << s)) != 0)
-      {
-        doBlendPacked(sColor, array[i].r);
-      }
-    }
-    colorSum += sColor;
-  }
-  colorSum /= OIT_MSAA;
+  // Compute the average blended color of the MSAA samples, blending once per
+  // group of samples covered by the same fragments.
+  colorSum = blendCoverageGroups(array, fragments);
 #else
   // Blend all of the fragments together:
-  for(int i = 0; i < fragments; i++)
+  for(int i = 0; i < fragments && !opacitySaturated(colorSum); i++)
   {
     doBlendPacked(colorSum, array[i].x);
   }
@@ -39,47 +39,118 @@
 
 #include "oitColorDepthDefines.glsl"
 
-layout(binding = IMG_ABUFFER, rgba32ui) uniform coherent uimageBuffer imgAbuffer;
+// Each element stores (color, depth, sample mask, next element).
+#define ABUFFER_COMPONENTS 4
+#include "oitABuffer.glsl"
+
 layout(binding = IMG_AUX, r32ui) uniform coherent uimage2DUsed imgAux;
 // One major difference from the OpenGL version is that we use a 1x1 image here
 // instead of an atomic counter variable.
 layout(binding = IMG_COUNTER, r32ui) uniform uimage2D imgCounter;
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0, index = 0) out vec4 outColor;
 
 void main()
 {
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, true, IN))
+  {
+    discard;
+  }
+#endif
+
+#if OIT_HYBRID_SAMPLES
+  // Edge fragments only write the samples they tail-blend; see below.
+  gl_SampleMask[0] = -1;
+#endif
+
+  // Skip fragments hidden behind enough opacity.
+  if(opacityCulled(materialOpacity(IN.color.a)))
+  {
+    outColor = vec4(0);
+    return;
+  }
+
+  // Let the composite pass know that this fragment's tile contains transparency.
+  markTransparentTile();
+
+#if OIT_HYBRID_SAMPLES
+  if(isEdgeFragment())
+  {
+    // Shade and store each covered sample in its own element, and tail-blend
+    // the samples that don't fit.
+    uint tailMask = 0;
+    for(uint remaining = storeMask; remaining != 0u; remaining &= remaining - 1u)
+    {
+      const int  s            = findLSB(remaining);
+      const uint sampleOffset = imageAtomicAdd(imgCounter, ivec2(0), 1) + 1;
+      if(sampleOffset >= scene.linkedListAllocatedPerElement)
+      {
+        tailMask |= 1u << s;
+        continue;
+      }
+      const uint sampleNext  = imageAtomicExchange(imgAux, coord, epochStore(sampleOffset));
+      const uint sampleColor = packFragmentColor(interpolantsAtSample(s), inObjectID);
+      abufferStore(ABufferIndex(sampleOffset), uvec4(sampleColor, floatBitsToUint(FRAGMENT_DEPTH), 1u << s, sampleNext));
+    }
+
+    // Only write the samples that were tail-blended.
+    gl_SampleMask[0] = int(tailMask);
+    if(OIT_TAILBLEND && tailMask != 0u)
+    {
+      const vec4 color = shading(IN);
+      outColor         = vec4(color.rgb * color.a, color.a);  // Premultiply alpha
+    }
+    else
+    {
+      outColor = vec4(0);
+    }
+    return;
+  }
+#endif
+
   // +1 as 0 is used as a list terminator. Adds 1 to imgCounter[0,0] and
   // returns the original value.
   const uint newOffset = imageAtomicAdd(imgCounter, ivec2(0), 1) + 1;
-  // Get the unpremultiplied linear-space RGBA color of this pixel
-  const vec4 color = shading(IN);
 
   if(newOffset >= scene.linkedListAllocatedPerElement)
   {
     // we ran out of memory, so tail-blend using premultiplied alpha if allowed
-#if OIT_TAILBLEND
-    outColor = vec4(color.rgb * color.a, color.a);  // Premultiply alpha
-#else
-    outColor = vec4(0); // Make the fragment transparent
-#endif  // #if OIT_TAILBLEND
+    if(OIT_TAILBLEND)
+    {
+      const vec4 color = shading(IN);
+      outColor         = vec4(color.rgb * color.a, color.a);  // Premultiply alpha
+    }
+    else
+    {
+      outColor = vec4(0);  // Make the fragment transparent
+    }
     return;
   }
 
   // Note that this is indeed thread-safe! The order in which threads
   // reach this line determines the order of the fragments in the linked list.
-  const uint oldOffset = imageAtomicExchange(imgAux, coord, newOffset);
+  // With OIT_EPOCH_TAGS, a head from an earlier epoch ends the list when read.
+  const uint oldOffset = imageAtomicExchange(imgAux, coord, epochStore(newOffset));
 
-  // Convert to unpremultiplied sRGB for 8-bit storage
-  const vec4 sRGBColor = unPremultLinearToSRGB(color);
+  // Get the 32-bit color to store in the A-buffer. With OIT_DEFERRED_SHADING,
+  // this fragment is only shaded if it's composited.
+  const uint packedColor = packFragmentColor(IN, inObjectID);
 
-  const uvec4 storeValue = uvec4(packUnorm4x8(sRGBColor),          //
-                                 floatBitsToUint(gl_FragCoord.z),  //
+  const uvec4 storeValue = uvec4(packedColor,                      //
+                                 floatBitsToUint(FRAGMENT_DEPTH),  //
                                  storeMask,                        //
                                  oldOffset);
 
-  imageStore(imgAbuffer, int(newOffset), storeValue);
+  abufferStore(ABufferIndex(newOffset), storeValue);
 
   outColor = vec4(0);
 }
@@ -98,7 +169,10 @@ void main()
 
 #include "oitCompositeDefines.glsl"
 
-layout(binding = IMG_ABUFFER, abufferType) uniform restrict readonly uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS 4
+#define ABUFFER_READONLY
+#include "oitABuffer.glsl"
+
 layout(binding = IMG_AUX, r32ui) uniform restrict readonly uimage2DUsed imgAux;
 
 layout(location = 0) out vec4 outColor;
@@ -110,16 +184,16 @@ void main()
   vec4 color     = vec4(0);
   int  fragments = 0;  // The number of fragments for this sample.
 
-  uint startOffset = imageLoad(imgAux, coord).r;
+  uint startOffset = epochLoad(imageLoad(imgAux, coord).r);
 
   // Traverse the linked list:
   while(startOffset != uint(0) && fragments < OIT_LAYERS)
   {
-    const uvec4 stored = imageLoad(imgAbuffer, int(startOffset));
+    const uvec4 stored = abufferLoad(ABufferIndex(startOffset));
     array[fragments]   = loadOp(stored);
     fragments++;
 
-    startOffset = stored.a;
+    startOffset = epochLoad(stored.a);
   }
 
   // Sort the fragments:
@@ -130,37 +204,35 @@ void main()
 
   while(startOffset != uint(0))
   {
-    uvec4 stored = imageLoad(imgAbuffer, int(startOffset));
+    uvec4 stored = abufferLoad(ABufferIndex(startOffset));
 // Push the value into the array and tail-blend the furthest value
 // that comes out:
-#if OIT_TAILBLEND
-    loadType tail = insertionSortTail(array, loadOp(stored));
-    doBlendPacked(tailColor, tail.r);
-#else   // #if OIT_TAILBLEND
-    insertionSort(array, loadOp(stored));
-#endif  // #if OIT_TAILBLEND
-    startOffset = stored.a;
-  }
-
-  vec4 colorSum = vec4(0);
-
-#if OIT_COVERAGE_SHADING
-  for(int s = 0; s < OIT_MSAA; s++)
-  {
-    vec4 sColor = vec4(0);
-    for(int i = 0; i < fragments; i++)
+    if(OIT_TAILBLEND)
     {
-      if((array[i].b & (1 << s)) != 0)
+      loadType tail = insertionSortTail(array, loadOp(stored));
+      // Once the tail is opaque enough, further tail fragments don't need to
+      // be unpacked (or with OIT_DEFERRED_SHADING, shaded).
+      if(!opacitySaturated(tailColor))
       {
-        doBlendPacked(sColor, array[i].r);
+        doBlendPacked(tailColor, tail.r);
       }
     }
-    colorSum += sColor;
+    else
+    {
+      insertionSort(array, loadOp(stored));
+    }
+    startOffset = epochLoad(stored.a);
   }
-  colorSum /= OIT_MSAA;
+
+  vec4 colorSum = vec4(0);
+
+#if OIT_COVERAGE_SHADING
+  // Compute the average blended color of the MSAA samples, blending once per
+  // group of samples covered by the same fragments.
+  colorSum = blendCoverageGroups(array, fragments);
 #else
   // Blend all of the fragments together:
-  for(int i = 0; i < fragments; i++)
+  for(int i = 0; i < fragments && !opacitySaturated(colorSum); i++)
   {
     doBlendPacked(colorSum, array[i].x);
   }
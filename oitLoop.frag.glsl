@@ -18,8 +18,7 @@
  */
 
 
-// OIT_LOOP does not support MSAA at the moment.
-// It uses two passes and a resolve pass; the first stores the depths of the
+// OIT_LOOP uses two passes and a resolve pass; the first stores the depths of the
 // frontmost OIT_LAYERS fragments per pixel in the A-buffer, in order from
 // nearest to farthest. Then the second pass writes the sorted colors into
 // another section of the A-buffer, and tail blends colors that didn't make it in.
@@ -36,12 +35,26 @@
 //       a r32ui depth value (via floatBitsToUint, cleared to 0xffffffff)
 //     for each pixel...
 //       a packed color in a uvec4
+//   with MSAA pixel shading, for each OIT layer...
+//     for each pixel...
+//       the coverage mask of the fragment with that depth
+//
+// With MSAA pixel shading, the composite pass uses the coverage masks to
+// resolve each sample's color. Fragments with exactly the same depth share a
+// layer, so only the last one's color and coverage mask are kept.
 
 #version 460
 #extension GL_GOOGLE_include_directive : enable
 
 #include "shaderCommon.glsl"
 
+// The number of OIT_LAYERS-sized sections of the A-buffer per sample.
+#if OIT_COVERAGE_SHADING
+#define LOOP_SECTIONS 3  // Depths, colors, and coverage masks
+#else
+#define LOOP_SECTIONS 2  // Depths and colors
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Depth sorting pass                                                         //
 ////////////////////////////////////////////////////////////////////////////////
@@ -49,41 +62,57 @@
 
 #include "oitColorDepthDefines.glsl"
 
-layout(binding = IMG_ABUFFER, r32ui) uniform coherent uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS 1
+#include "oitABuffer.glsl"
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0, index = 0) out vec4 outColor;
 
 void main()
 {
-  // The number of pixels in the image
-  const int viewSize = scene.viewport.z;
-  const int listPos  = viewSize * OIT_LAYERS * 2 * sampleID + (coord.y * scene.viewport.x + coord.x);
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, true, IN))
+  {
+    discard;
+  }
+#endif
+
+  // Each sample has OIT_LAYERS depths followed by OIT_LAYERS colors (and
+  // OIT_LAYERS coverage masks)
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS * LOOP_SECTIONS);
 
   // Insert the floating-point depth (reinterpreted as a uint) into the list of depths
-  uint zcur = floatBitsToUint(gl_FragCoord.z);
+  uint zcur = floatBitsToUint(FRAGMENT_DEPTH);
   int  i    = 0;  // Current position in the array
 
-#if USE_EARLYDEPTH
-  // Do some early tests to minimize the amount of insertion-sorting work we
-  // have to do.
-  // If the fragment is further away than the last depth fragment, skip it:
-  uint pretest = imageLoad(imgAbuffer, listPos + (OIT_LAYERS - 1) * viewSize).x;
-  if(zcur > pretest)
-    return;
-  // Check to see if the fragment can be inserted in the latter half of the
-  // depth array:
-  pretest = imageLoad(imgAbuffer, listPos + (OIT_LAYERS / 2) * viewSize).x;
-  if(zcur > pretest)
-    i = (OIT_LAYERS / 2);
-#endif  // #if USE_EARLYDEPTH
+  if(USE_EARLYDEPTH)
+  {
+    // Do some early tests to minimize the amount of insertion-sorting work we
+    // have to do.
+    // If the fragment is further away than the last depth fragment, skip it:
+    uint pretest = abufferLoad(listPos + abufferLayer(OIT_LAYERS - 1)).x;
+    if(zcur > pretest)
+      return;
+    // Check to see if the fragment can be inserted in the latter half of the
+    // depth array:
+    pretest = abufferLoad(listPos + abufferLayer(OIT_LAYERS / 2)).x;
+    if(zcur > pretest)
+      i = (OIT_LAYERS / 2);
+  }
 
   // Try to insert zcur in the place of the first element of the array that
   // is greater than or equal to it. In the former case, shift all of the
   // remaining elements in the array down.
   for(; i < OIT_LAYERS; i++)
   {
-    const uint ztest = imageAtomicMin(imgAbuffer, listPos + i * viewSize, zcur);
+    const uint ztest = abufferAtomicMin(listPos + abufferLayer(i), zcur);
     if(ztest == 0xFFFFFFFFu || ztest == zcur)
     {
       // In the former case, we just inserted zcur into an empty space in the
@@ -112,38 +141,58 @@ void main()
 
 #include "oitColorDepthDefines.glsl"
 
-layout(binding = IMG_ABUFFER, r32ui) uniform coherent uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS 1
+#include "oitABuffer.glsl"
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0, index = 0) out vec4 outColor;
 
 void main()
 {
-  // Get the unpremultiplied linear-space RGBA color of this pixel
-  vec4 color = shading(IN);
-  // Convert to unpremultiplied sRGB for 8-bit storage
-  const vec4 sRGBColor = unPremultLinearToSRGB(color);
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, true, IN))
+  {
+    discard;
+  }
+#endif
+
+  // Let the composite pass know that this fragment's tile contains transparency.
+  markTransparentTile();
+
+  // Get the 32-bit color to store in the A-buffer. With OIT_DEFERRED_SHADING,
+  // this fragment is only shaded if it's composited or tail-blended.
+  const uint packedColor = packFragmentColor(IN, inObjectID);
 
   // Compute base index in the A-buffer
-  const int viewSize = scene.viewport.z;
-  const int listPos = viewSize * OIT_LAYERS * 2 * sampleID + (coord.y * scene.viewport.x + coord.x);
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS * LOOP_SECTIONS);
 
-  const uint zcur = floatBitsToUint(gl_FragCoord.z);
+  const uint zcur = floatBitsToUint(FRAGMENT_DEPTH);
 
-#if USE_EARLYDEPTH
   // If this fragment was behind the frontmost OIT_LAYERS fragments, it didn't
-  // make it in, so tail blend it:
-  if(imageLoad(imgAbuffer, listPos + (OIT_LAYERS - 1) * viewSize).x < zcur)
+  // make it in, so tail blend it. (Unlike the early test in the depth pass,
+  // this is needed even without USE_EARLYDEPTH, since otherwise the binary
+  // search below would overwrite the color of the last layer.)
+  if(abufferLoad(listPos + abufferLayer(OIT_LAYERS - 1)).x < zcur)
   {
-#if OIT_TAILBLEND
-    // Premultiply alpha
-    outColor = vec4(color.rgb * color.a, color.a);
-#else   // #if OIT_TAILBLEND
-    outColor = vec4(0);
-#endif  // #if OIT_TAILBLEND
+    if(OIT_TAILBLEND)
+    {
+      // Shade this fragment and premultiply alpha
+      const vec4 color = shading(IN);
+      outColor         = vec4(color.rgb * color.a, color.a);
+    }
+    else
+    {
+      outColor = vec4(0);
+    }
     return;
   }
-#endif  // #if USE_EARLYDEPTH
 
   // Use binary search to determine which index this depth value corresponds to
   // At each step, we know that it'll be in the closed interval [start, end].
@@ -153,7 +202,7 @@ void main()
   while(start < end)
   {
     int mid = (start + end) / 2;
-    ztest = imageLoad(imgAbuffer, listPos + mid * viewSize).x;
+    ztest = abufferLoad(listPos + abufferLayer(mid)).x;
     if(ztest < zcur)
     {
       start = mid + 1;  // in [mid + 1, end]
@@ -166,7 +215,10 @@ void main()
 
   // We now have start == end. Insert the packed color into the A-buffer at
   // this index.
-  imageStore(imgAbuffer, listPos + (OIT_LAYERS + start) * viewSize, uvec4(packUnorm4x8(sRGBColor)));
+  abufferStore(listPos + abufferLayer(OIT_LAYERS + start), uvec4(packedColor));
+#if OIT_COVERAGE_SHADING
+  abufferStore(listPos + abufferLayer(2 * OIT_LAYERS + start), uvec4(gl_SampleMaskIn[0]));
+#endif
 
   // Inserted, so make this color transparent:
   outColor = vec4(0);
@@ -184,7 +236,9 @@ void main()
 
 #include "oitCompositeDefines.glsl"
 
-layout(binding = IMG_ABUFFER, r32ui) uniform restrict readonly uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS 1
+#define ABUFFER_READONLY
+#include "oitABuffer.glsl"
 
 layout(location = 0) out vec4 outColor;
 
@@ -192,14 +246,13 @@ void main()
 {
   vec4 color = vec4(0);
 
-  const int viewSize = scene.viewport.z;
-  int       listPos  = viewSize * OIT_LAYERS * 2 * sampleID + (coord.y * scene.viewport.x + coord.x);
+  ABufferIndex listPos = abufferListPos(OIT_LAYERS * LOOP_SECTIONS);
 
   // Count the number of fragments for this pixel
   int fragments = 0;
   for(int i = 0; i < OIT_LAYERS; i++)
   {
-    const uint ztest = imageLoad(imgAbuffer, listPos + i * viewSize).r;
+    const uint ztest = abufferLoad(listPos + abufferLayer(i)).r;
     if(ztest != 0xFFFFFFFFu)
     {
       fragments++;
@@ -211,12 +264,23 @@ void main()
   }
 
   // Jump ahead to the color portion of the A-buffer
-  listPos += viewSize * OIT_LAYERS;
+  listPos += abufferLayer(OIT_LAYERS);
 
+#if OIT_COVERAGE_SHADING
+  // Gather each fragment's color and coverage mask, and compute the average
+  // blended color of the MSAA samples.
+  loadType array[OIT_LAYERS];
   for(int i = 0; i < fragments; i++)
   {
-    doBlendPacked(color, imageLoad(imgAbuffer, listPos + i * viewSize).r);
+    array[i] = uvec3(abufferLoad(listPos + abufferLayer(i)).r, 0, abufferLoad(listPos + abufferLayer(OIT_LAYERS + i)).r);
+  }
+  color = blendCoverageGroups(array, fragments);
+#else
+  for(int i = 0; i < fragments && !opacitySaturated(color); i++)
+  {
+    doBlendPacked(color, abufferLoad(listPos + abufferLayer(i)).r);
   }
+#endif
 
   outColor = color;
 }
@@ -19,8 +19,7 @@
 
 
 // OIT_LOOP64 is a variant of OIT_LOOP that combines the depth and color shader
-// passes into one pass if the GPU supports 64-bit atomics. It does not support
-// MSAA at the moment.
+// passes into one pass if the GPU supports 64-bit atomics.
 // The color pass sorts the frontmost OIT_LAYERS (depth, color) pairs per pixel
 // in the A-buffer, in order from nearest to furthest, tail blending colors
 // that didn't make it in. The resolve pass then blends the fragments from front
@@ -36,12 +35,50 @@
 //     for each pixel...
 //       a r32ui depth value (via floatBitsToUint, cleared to 0xffffffff)
 //       a r32ui packed sRGB unpremultiplied alpha color
+//
+// With OIT_EPOCH_TAGS, the depth value is instead a 24-bit unorm depth, with
+// (EPOCH_MAX - epoch) in its top 8 bits. Elements from earlier epochs have
+// larger tags, so they compare greater than every element from the current
+// epoch; atomicMin then replaces them just like cleared elements (which have
+// epoch 0), and the A-buffer doesn't need to be cleared each frame.
+//
+// With MSAA pixel shading, the depth value is instead a 24-bit unorm depth,
+// with the fragment's coverage mask in its bottom 8 bits, so that the mask is
+// sorted along with the fragment. There's no room left for an epoch tag, so
+// this doesn't use OIT_EPOCH_TAGS; see State::usesEpochTags.
 
 #version 460
 #extension GL_GOOGLE_include_directive : enable
 
 #include "shaderCommon.glsl"
 
+// Returns the depth value to store for depthBits (from floatBitsToUint) and
+// the fragment's coverage mask.
+uint loop64DepthStore(uint depthBits, uint coverage)
+{
+#if OIT_COVERAGE_SHADING
+  // Clamp the depth so that a fully covering fragment at the far plane isn't
+  // mistaken for an empty element.
+  return (min(depthBitsToUnorm24(depthBits, false), EPOCH_VALUE_MASK - 1u) << 8) | (coverage & 0xFFu);
+#else
+  if(OIT_EPOCH_TAGS)
+  {
+    return ((EPOCH_MAX - pushConstants.epoch) << EPOCH_SHIFT) | depthBitsToUnorm24(depthBits, false);
+  }
+  return depthBits;
+#endif
+}
+
+// Returns whether a stored depth value represents an empty element.
+bool loop64DepthIsEmpty(uint stored)
+{
+  if(OIT_EPOCH_TAGS)
+  {
+    return (stored >> EPOCH_SHIFT) != (EPOCH_MAX - pushConstants.epoch);
+  }
+  return stored == 0xFFFFFFFFu;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Color                                                                      //
 ////////////////////////////////////////////////////////////////////////////////
@@ -52,53 +89,74 @@
 #extension GL_NV_shader_atomic_int64 : require
 #extension GL_ARB_gpu_shader_int64 : require  // For uint64_t
 
-// Note that this is now bound as a storage buffer, instead of a
-// storage texel buffer.
-layout(binding = IMG_ABUFFER, std430) coherent buffer ssboAbuffer
-{
-  uint64_t abuffer[];
-};
+// Note that this is bound as a storage buffer (or accessed through its
+// buffer device address), instead of a storage texel buffer.
+#define ABUFFER_COMPONENTS 64
+#include "oitABuffer.glsl"
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0, index = 0) out vec4 outColor;
 
 void main()
 {
-  // Get the unpremultiplied linear-space RGBA color of this pixel
-  vec4 color = shading(IN);
-  // Convert to unpremultiplied sRGB for 8-bit storage
-  const vec4 sRGBColor = unPremultLinearToSRGB(color);
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, true, IN))
+  {
+    discard;
+  }
+#endif
+
+  // Skip fragments hidden behind enough opacity.
+  if(opacityCulled(materialOpacity(IN.color.a)))
+  {
+    outColor = vec4(0);
+    return;
+  }
+
+  // Let the composite pass know that this fragment's tile contains transparency.
+  markTransparentTile();
+
+  // Get the 32-bit color to store in the A-buffer. With OIT_DEFERRED_SHADING,
+  // this fragment is only shaded if it's composited or tail-blended.
+  const uint packedColor = packFragmentColor(IN, inObjectID);
 
   // Compute base index in the A-buffer
-  const int viewSize = scene.viewport.z;
-  const int listPos  = viewSize * OIT_LAYERS * sampleID + (coord.y * scene.viewport.x + coord.x);
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
   bool canInsert = true;  // If false, canot be inserted into the A-buffer.
 
   // Store the color in the least significant bits and the depth in the most significant bits.
-  uint64_t zcur = packUint2x32(uvec2(packUnorm4x8(sRGBColor), floatBitsToUint(gl_FragCoord.z)));
+  uint64_t zcur = packUint2x32(uvec2(packedColor, loop64DepthStore(floatBitsToUint(FRAGMENT_DEPTH), uint(gl_SampleMaskIn[0]))));
   int      i    = 0;  // Current position in the array
 
-#if USE_EARLYDEPTH
-  // Do some early tests to minimize the amount of insertion-sorting work we
-  // have to do.
-  // If the fragment is further away than the last depth fragment, skip it:
-  uint64_t pretest = abuffer[listPos + (OIT_LAYERS - 1) * viewSize];
-  if(zcur > pretest)
+  if(USE_EARLYDEPTH)
   {
-    canInsert = false;
-  }
-  else
-  {
-    // Check to see if the fragment can be inserted in the latter half of the
-    // depth array:
-    pretest = abuffer[listPos + (OIT_LAYERS / 2) * viewSize];
+    // Do some early tests to minimize the amount of insertion-sorting work we
+    // have to do.
+    // If the fragment is further away than the last depth fragment, skip it:
+    uint64_t pretest = abufferLoad(listPos + abufferLayer(OIT_LAYERS - 1));
     if(zcur > pretest)
     {
-      i = (OIT_LAYERS / 2);
+      canInsert = false;
+    }
+    else
+    {
+      // Check to see if the fragment can be inserted in the latter half of the
+      // depth array:
+      pretest = abufferLoad(listPos + abufferLayer(OIT_LAYERS / 2));
+      if(zcur > pretest)
+      {
+        i = (OIT_LAYERS / 2);
+      }
     }
   }
-#endif
 
   if(canInsert)
   {
@@ -107,9 +165,9 @@ void main()
     // remaining elements in the array down.
     for(; i < OIT_LAYERS; i++)
     {
-      uint64_t ztest = atomicMin(abuffer[listPos + i * viewSize], zcur);
+      uint64_t ztest = abufferAtomicMin(listPos + abufferLayer(i), zcur);
 
-      if(ztest == packUint2x32(uvec2(0xFFFFFFFFu, 0xFFFFFFFFu)))
+      if(loop64DepthIsEmpty(unpackUint2x32(ztest).y))
       {
         // We just inserted zcur into an empty space in the array.
         break;
@@ -126,14 +184,18 @@ void main()
   }
   else
   {
-#if OIT_TAILBLEND
-    // Unpack the current color and premultiply it
-    const uvec2 current      = unpackUint2x32(zcur);
-    const vec4  currentColor = unPremultSRGBToLinear(unpackUnorm4x8(current.x));
-    outColor                 = vec4(currentColor.rgb * currentColor.a, currentColor.a);
-#else   // #if OIT_TAILBLEND
-    outColor = vec4(0);
-#endif  // #if OIT_TAILBLEND
+    if(OIT_TAILBLEND)
+    {
+      // Unpack (and with OIT_DEFERRED_SHADING, shade) the current color and
+      // premultiply it
+      const uvec2 current      = unpackUint2x32(zcur);
+      const vec4  currentColor = unpackFragmentColor(current.x);
+      outColor                 = vec4(currentColor.rgb * currentColor.a, currentColor.a);
+    }
+    else
+    {
+      outColor = vec4(0);
+    }
   }
 }
 
@@ -149,10 +211,9 @@ void main()
 
 #include "oitCompositeDefines.glsl"
 
-layout(binding = IMG_ABUFFER, std430) restrict buffer ssboAbuffer
-{
-  uvec2 abuffer[];
-};
+#define ABUFFER_COMPONENTS 64
+#define ABUFFER_READONLY
+#include "oitABuffer.glsl"
 
 layout(location = 0) out vec4 outColor;
 
@@ -160,13 +221,28 @@ void main()
 {
   vec4 color = vec4(0);
 
-  const int viewSize = scene.viewport.z;
-  const int listPos  = viewSize * OIT_LAYERS * sampleID + (coord.y * scene.viewport.x + coord.x);
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
-  for(int i = 0; i < OIT_LAYERS; i++)
+#if OIT_COVERAGE_SHADING
+  // Gather each fragment's color and coverage mask, and compute the average
+  // blended color of the MSAA samples.
+  loadType array[OIT_LAYERS];
+  int      fragments = 0;
+  for(; fragments < OIT_LAYERS; fragments++)
+  {
+    const uvec2 stored = unpackUint2x32(abufferLoad(listPos + abufferLayer(fragments)));
+    if(loop64DepthIsEmpty(stored.y))
+    {
+      break;
+    }
+    array[fragments] = uvec3(stored.x, stored.y, stored.y & 0xFFu);
+  }
+  color = blendCoverageGroups(array, fragments);
+#else
+  for(int i = 0; i < OIT_LAYERS && !opacitySaturated(color); i++)
   {
-    uvec2 stored = abuffer[listPos + i * viewSize];
-    if(stored.y != 0xFFFFFFFFu)
+    uvec2 stored = unpackUint2x32(abufferLoad(listPos + abufferLayer(i)));
+    if(!loop64DepthIsEmpty(stored.y))
     {
       doBlendPacked(color, stored.x);
     }
@@ -175,6 +251,7 @@ void main()
       break;
     }
   }
+#endif
 
   outColor = color;
 }
@@ -23,17 +23,191 @@
 
 #include "oit.h"
 
+#include <cstddef>
+
 void Sample::render(VkCommandBuffer& cmdBuffer)
 {
   // Clear auxiliary buffers before we even start a render pass - this
   // reduces the number of render passes we need to use by 1.
+  cmdResetPassStatistics(cmdBuffer);
+  clearTransparent(cmdBuffer);
+
+  const int numObjects     = m_sceneTriangleIndices / m_objectTriangleIndices;
+  const int numTransparent = getNumTransparentObjects();
+  const int numOpaque      = numObjects - numTransparent;
+
+  // Transform the transparent objects' vertices once for all of the passes
+  // (and bands) that draw them.
+  if(m_state.preTransform)
+  {
+    cmdPreTransform(cmdBuffer, numTransparent);
+  }
+
+  // Likewise, find the visible objects once per frame.
+  if(m_state.frustumCulling)
+  {
+    cmdCullObjects(cmdBuffer);
+  }
+
+  // Start the main render pass
+  {
+    const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "Main", cmdBuffer);
+
+    // Transition the color image to work as a color attachment, in case it
+    // was set to VK_IMAGE_LAYOUT_GENERAL.
+    m_colorImage.transitionTo(cmdBuffer,                                 // Command buffer
+                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // New layout
+                              VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+    // The A-buffer and auxiliary images only cover a band of rows of
+    // m_colorImage. We render each band with a render area and scissor
+    // rectangle covering only that band, and clear and reuse the A-buffer
+    // between bands. (Usually, there's only one band, covering the whole image.)
+    const uint32_t bandHeight = m_state.bandHeight(m_colorImage.c_height);
+    for(uint32_t bandOffsetY = 0; bandOffsetY < m_colorImage.c_height; bandOffsetY += bandHeight)
+    {
+      setStatisticsBand(bandOffsetY / bandHeight);
+      if(bandOffsetY != 0)
+      {
+        // Wait for the previous band's composite pass before clearing the A-buffer again.
+        cmdFragmentToTransferBarrierSimple(cmdBuffer);
+        clearTransparent(cmdBuffer);
+      }
+
+      // (cmdBeginComposite uses m_bandRect to resume the render pass.)
+      VkRect2D& bandRect     = m_bandRect;
+      bandRect.offset        = {0, static_cast<int32_t>(bandOffsetY)};
+      bandRect.extent.width  = m_colorImage.c_width;
+      bandRect.extent.height = std::min(bandHeight, m_colorImage.c_height - bandOffsetY);
+
+      // Set up the render pass. Since the render area is the band, this only
+      // clears the band.
+      VkRenderPassBeginInfo renderPassInfo = nvvk::make<VkRenderPassBeginInfo>();
+      renderPassInfo.renderPass            = m_renderPassColorDepthClear;
+      renderPassInfo.framebuffer           = m_mainColorDepthFramebuffer;
+      renderPassInfo.renderArea            = bandRect;
+
+      std::array<VkClearValue, 2> clearValues = {};
+      clearValues[0].color                    = {0.2f, 0.2f, 0.2f, 0.2f};  // Background color, in linear space
+      clearValues[1].depthStencil             = {1.0f, 0};                 // Clear depth
+      renderPassInfo.clearValueCount          = static_cast<uint32_t>(clearValues.size());
+      renderPassInfo.pClearValues             = clearValues.data();
+
+      vkCmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+      // Restrict drawing to the band, and tell the shaders where it starts.
+      vkCmdSetScissor(cmdBuffer, 0, 1, &bandRect);
+      PushConstants pushConstants = {};
+      pushConstants.bandOffsetY   = static_cast<int>(bandOffsetY);
+      pushConstants.epoch         = currentOitFrame().epoch;
+      vkCmdPushConstants(cmdBuffer, m_descriptorInfo.getPipeLayout(),
+                         VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                         sizeof(pushConstants), &pushConstants);
+
+      // Draw all of the opaque objects
+      {
+        // Bind the descriptor set (constant buffers, images)
+        // Pipeline layout depends only on descriptor set layout.
+        VkDescriptorSet descriptorSet = getCurrentDescriptorSet();
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_descriptorInfo.getPipeLayout(), 0, 1,
+                                &descriptorSet, 0, nullptr);
+
+        cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_OPAQUE);
+        drawSceneObjects(cmdBuffer, numTransparent, numOpaque);
+        cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_OPAQUE);
+      }
+
+      // Now that the depth buffer holds the opaque objects, drop the
+      // transparent objects they hide, and give sphere impostors a copy of it
+      // to test their ray-cast depths against.
+      if(m_state.usesOcclusionCulling() || m_state.usesSphereImpostors())
+      {
+        cmdSuspendForOpaqueDepth(cmdBuffer);
+        if(m_state.usesOcclusionCulling())
+        {
+          cmdOcclusionCull(cmdBuffer, numTransparent);
+        }
+        if(m_state.usesSphereImpostors())
+        {
+          cmdCopyOpaqueDepth(cmdBuffer);
+        }
+        cmdResumeAfterOpaqueDepth(cmdBuffer);
+      }
+
+      // Now, draw the transparent objects.
+      switch(m_state.algorithm)
+      {
+        case OIT_SIMPLE:
+          drawTransparentSimple(cmdBuffer, numTransparent);
+          break;
+        case OIT_LINKEDLIST:
+          drawTransparentLinkedList(cmdBuffer, numTransparent);
+          break;
+        case OIT_LOOP:
+          drawTransparentLoop(cmdBuffer, numTransparent);
+          break;
+        case OIT_LOOP64:
+          drawTransparentLoop64(cmdBuffer, numTransparent);
+          break;
+        case OIT_INTERLOCK:
+        case OIT_SPINLOCK:
+          drawTransparentLock(cmdBuffer, numTransparent, (m_state.algorithm == OIT_INTERLOCK));
+          break;
+        case OIT_WEIGHTED:
+          drawTransparentWeighted(cmdBuffer, numTransparent);
+          break;
+        default:
+          assert(!"Algorithm case not called in switch statement!");
+      }
+
+      vkCmdEndRenderPass(cmdBuffer);
+    }
+  }
+
+  // Copy a few fragment counts to the CPU for the auto-tuner.
+  cmdSampleDepthComplexity(cmdBuffer);
+}
+
+void Sample::clearTransparent(VkCommandBuffer& cmdBuffer)
+{
+  // With epoch tags, values written in earlier epochs already read as
+  // cleared, so we only have to clear the resources when they were just
+  // created (epoch 0) or when the epoch would wrap around.
+  if(m_state.usesTiledComposite())
+  {
+    clearTiles(cmdBuffer);
+  }
+
+  if(m_state.usesOpacityCulling())
+  {
+    clearOpacity(cmdBuffer);
+  }
+
+  OitFrameResources& frame = currentOitFrame();
+  if(m_state.usesEpochTags())
+  {
+    if(frame.epoch != 0 && frame.epoch < EPOCH_MAX)
+    {
+      frame.epoch++;
+      // Make sure the last pass's reads and writes complete before this one's.
+      cmdFragmentBarrierSimple(cmdBuffer);
+      if(m_state.algorithm == OIT_LINKEDLIST)
+      {
+        // The atomic counter is a single texel, so it's still reset every pass.
+        clearTransparentLinkedList(cmdBuffer, false);
+      }
+      return;
+    }
+    frame.epoch = 1;
+  }
+
   switch(m_state.algorithm)
   {
     case OIT_SIMPLE:
       clearTransparentSimple(cmdBuffer);
       break;
     case OIT_LINKEDLIST:
-      clearTransparentLinkedList(cmdBuffer);
+      clearTransparentLinkedList(cmdBuffer, true);
       break;
     case OIT_LOOP:
       clearTransparentLoop(cmdBuffer);
@@ -51,83 +225,321 @@ void Sample::render(VkCommandBuffer& cmdBuffer)
     default:
       assert(!"Algorithm case not called in switch statement!");
   }
+}
 
+int Sample::getNumTransparentObjects() const
+{
   // We'll make the first m_state.percentTransparent percent of our spheres transparent;
   // the rest, at the end, will be opaque. Since we only have one mesh, we can do this
   // by drawing the last range of triangles using an opaque shader, and then drawing
   // the first using our OIT methods.
-  const int numObjects     = m_sceneTriangleIndices / m_objectTriangleIndices;
-  int       numTransparent = (numObjects * m_state.percentTransparent) / 100;
-  if(numTransparent > numObjects)
+  const int numObjects     = (m_objectTriangleIndices == 0) ? 0 : (m_sceneTriangleIndices / m_objectTriangleIndices);
+  const int numTransparent = (numObjects * static_cast<int>(m_state.percentTransparent)) / 100;
+  return std::min(numTransparent, numObjects);
+}
+
+void Sample::cmdCullObjects(VkCommandBuffer& cmdBuffer)
+{
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "CullObjects", cmdBuffer);
+
+  // Wait for the last frame's draws to finish reading the draw commands, then
+  // reset both counts.
   {
-    numTransparent = numObjects;
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier,
+                         0, nullptr, 0, nullptr);
+  }
+  vkCmdFillBuffer(cmdBuffer, m_drawCommandBuffer.buffer, 0, 2 * sizeof(uint32_t), 0);
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier,
+                         0, nullptr, 0, nullptr);
   }
-  const int numOpaque = numObjects - numTransparent;
 
-  // Start the main render pass
+  // One invocation per object.
+  const uint32_t  numObjects    = m_sceneTriangleIndices / m_objectTriangleIndices;
+  VkDescriptorSet descriptorSet = getCurrentDescriptorSet();
+  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineObjectCull);
+  vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_descriptorInfo.getPipeLayout(), 0, 1,
+                          &descriptorSet, 0, nullptr);
+  vkCmdDispatch(cmdBuffer, (numObjects + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+  // Make sure the draw commands are complete before drawing them.
   {
-    const nvvk::ProfilerVK::Section scopedTimer(m_profilerVK, "Main", cmdBuffer);
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+  }
+}
 
-    // Transition the color image to work as a color attachment, in case it
-    // was set to VK_IMAGE_LAYOUT_GENERAL.
-    m_colorImage.transitionTo(cmdBuffer,                                 // Command buffer
-                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // New layout
-                              VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+void Sample::cmdSuspendForOpaqueDepth(VkCommandBuffer& cmdBuffer)
+{
+  // We can't dispatch compute shaders inside a render pass, so we end it here
+  // and resume it afterwards, like cmdBeginComposite.
+  vkCmdEndRenderPass(cmdBuffer);
 
-    // Set up the render pass
-    VkRenderPassBeginInfo renderPassInfo    = nvvk::make<VkRenderPassBeginInfo>();
-    renderPassInfo.renderPass               = m_renderPassColorDepthClear;
-    renderPassInfo.framebuffer              = m_mainColorDepthFramebuffer;
-    renderPassInfo.renderArea.offset        = {0, 0};
-    renderPassInfo.renderArea.extent.width  = m_colorImage.c_width;
-    renderPassInfo.renderArea.extent.height = m_colorImage.c_height;
+  // Make the opaque draw's depth values readable through IMG_SCENE_DEPTH.
+  m_depthImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT);
 
-    std::array<VkClearValue, 2> clearValues = {};
-    clearValues[0].color                    = {0.2f, 0.2f, 0.2f, 0.2f};  // Background color, in linear space
-    clearValues[1].depthStencil             = {1.0f, 0};                 // Clear depth
-    renderPassInfo.clearValueCount          = static_cast<uint32_t>(clearValues.size());
-    renderPassInfo.pClearValues             = clearValues.data();
+  VkDescriptorSet descriptorSet = getCurrentDescriptorSet();
+  vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_descriptorInfo.getPipeLayout(), 0, 1,
+                          &descriptorSet, 0, nullptr);
+}
 
-    vkCmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+void Sample::cmdResumeAfterOpaqueDepth(VkCommandBuffer& cmdBuffer)
+{
+  // Give the depth image back to the render pass.
+  m_depthImage.transitionTo(cmdBuffer, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+  // Resume the main render pass over the same band, keeping what we've drawn.
+  VkRenderPassBeginInfo renderPassInfo = nvvk::make<VkRenderPassBeginInfo>();
+  renderPassInfo.renderPass            = m_renderPassColorDepthLoad;
+  renderPassInfo.framebuffer           = m_mainColorDepthFramebuffer;
+  renderPassInfo.renderArea            = m_bandRect;
+  vkCmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
 
-    // Draw all of the opaque objects
-    {
-      // Bind the descriptor set (constant buffers, images)
-      // Pipeline layout depends only on descriptor set layout.
-      VkDescriptorSet descriptorSet = m_descriptorInfo.getSet(m_swapChain.getActiveImageIndex());
-      vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_descriptorInfo.getPipeLayout(), 0, 1,
-                              &descriptorSet, 0, nullptr);
+void Sample::cmdOcclusionCull(VkCommandBuffer& cmdBuffer, int numObjects)
+{
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "OcclusionCull", cmdBuffer);
+
+  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineHiZBuild);
+
+  // Build each level of the Hi-Z pyramid from the one before it, one
+  // invocation per texel. Each level has to be complete before the next
+  // one reads it; the first one also has to wait for the last frame's
+  // culling to finish reading the pyramid.
+  uint32_t width  = m_depthImage.c_width;
+  uint32_t height = m_depthImage.c_height;
+  uint32_t level  = 0;
+  do
+  {
+    width  = std::max(1u, (width + 1) / 2);
+    height = std::max(1u, (height + 1) / 2);
+
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdPushConstants(cmdBuffer, m_descriptorInfo.getPipeLayout(),
+                       VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT,
+                       offsetof(PushConstants, hiZLevel), sizeof(uint32_t), &level);
+    vkCmdDispatch(cmdBuffer, (width + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE,
+                  (height + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE, 1);
+    level++;
+  } while(width > 1 || height > 1);
+
+  // Make the pyramid visible to the culling pass.
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  // Append the visible transparent objects' draw commands, one invocation
+  // per object. cmdCullObjects already reset their count.
+  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineOcclusionCull);
+  vkCmdDispatch(cmdBuffer, (static_cast<uint32_t>(numObjects) + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+  // Make sure the draw commands are complete before drawing them.
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+  }
+}
+
+void Sample::cmdCopyOpaqueDepth(VkCommandBuffer& cmdBuffer)
+{
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "OpaqueDepthCopy", cmdBuffer);
+
+  // Wait for the previous band's (or frame's) fragment shaders to finish
+  // reading the copy before overwriting it.
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                       nullptr, 0, nullptr, 0, nullptr);
+
+  // One invocation per pixel of the band.
+  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineOpaqueDepthCopy);
+  vkCmdDispatch(cmdBuffer, (m_bandRect.extent.width + OPAQUE_DEPTH_WORKGROUP_SIZE - 1) / OPAQUE_DEPTH_WORKGROUP_SIZE,
+                (m_bandRect.extent.height + OPAQUE_DEPTH_WORKGROUP_SIZE - 1) / OPAQUE_DEPTH_WORKGROUP_SIZE, 1);
+
+  // Make the copy visible to the transparent passes' fragment shaders.
+  VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+  barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+}
 
-      drawSceneObjects(cmdBuffer, numTransparent, numOpaque);
+void Sample::cmdPreTransform(VkCommandBuffer& cmdBuffer, int numObjects)
+{
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "PreTransform", cmdBuffer);
+
+  // Wait for the last frame's vertex shaders to finish reading the
+  // transformed vertices before overwriting them.
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                       nullptr, 0, nullptr, 0, nullptr);
+
+  // One invocation per vertex. Since all objects have the same number of
+  // vertices, the first numObjects objects' vertices come first.
+  const uint32_t  numVertices   = static_cast<uint32_t>(numObjects) * m_sceneUbo.verticesPerObject;
+  VkDescriptorSet descriptorSet = getCurrentDescriptorSet();
+  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelinePreTransform);
+  vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_descriptorInfo.getPipeLayout(), 0, 1,
+                          &descriptorSet, 0, nullptr);
+  vkCmdDispatch(cmdBuffer, (numVertices + PRE_TRANSFORM_WORKGROUP_SIZE - 1) / PRE_TRANSFORM_WORKGROUP_SIZE, 1, 1);
+
+  // Make the transformed vertices visible to vertex shaders.
+  VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+  barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+}
+
+void Sample::clearTiles(VkCommandBuffer& cmdBuffer)
+{
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClearTiles", cmdBuffer);
+  OitFrameResources& frame = currentOitFrame();
+
+  // Wait for the last pass to finish using the tile mask and tile list.
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                             | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  // Unmark all tiles, and set the draw command to draw a quad (6 vertices)
+  // for each of 0 tiles; oitTileClassify.comp.glsl counts the tiles up.
+  vkCmdFillBuffer(cmdBuffer, frame.tileMask.buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+  VkDrawIndirectCommand drawCommand = {};
+  drawCommand.vertexCount           = 6;
+  vkCmdUpdateBuffer(cmdBuffer, frame.tileList.buffer.buffer, 0, sizeof(drawCommand), &drawCommand);
+
+  // Make sure this completes before the color pass and tile classification.
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0,
+                         nullptr, 0, nullptr);
+  }
+}
+
+void Sample::clearOpacity(VkCommandBuffer& cmdBuffer)
+{
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClearOpacity", cmdBuffer);
+  OitFrameResources& frame = currentOitFrame();
+
+  // Wait for the last pass to finish using the opacity bounds.
+  {
+    VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+    barrier.srcAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask   = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier,
+                         0, nullptr, 0, nullptr);
+  }
+
+  // Depth 0 and a transmittance of 255 (i.e. 1.0); see opacityCulled.
+  VkClearColorValue clearColor;
+  clearColor.uint32[0] = 0xFFu;
+  VkImageSubresourceRange clearRange;
+  clearRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+  clearRange.baseArrayLayer = 0;
+  clearRange.baseMipLevel   = 0;
+  clearRange.layerCount     = frame.auxOpacityImage.c_layers;
+  clearRange.levelCount     = 1;
+  vkCmdClearColorImage(cmdBuffer, frame.auxOpacityImage.image.image, frame.auxOpacityImage.currentLayout, &clearColor, 1, &clearRange);
+
+  // Make sure this completes before the color pass.
+  cmdTransferBarrierSimple(cmdBuffer);
+}
+
+void Sample::cmdBeginComposite(VkCommandBuffer& cmdBuffer)
+{
+  if(!m_state.usesTiledComposite())
+  {
+    return;
+  }
+
+  // We can't dispatch compute shaders inside a render pass, and a subpass
+  // can't depend on its own fragment shader writes in an earlier stage (such
+  // as the composite's vertex shader). So we end the render pass here, and
+  // resume it once the tile list is ready.
+  vkCmdEndRenderPass(cmdBuffer);
+
+  {
+    const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClassifyTiles", cmdBuffer);
+
+    // Make the color pass's writes (to the tile mask, and to the A-buffer and
+    // auxiliary images that the composite pass reads) visible.
+    {
+      VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+      barrier.srcAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask   = barrier.srcAccessMask;
+      vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier,
+                           0, nullptr, 0, nullptr);
     }
 
-    // Now, draw the transparent objects.
-    switch(m_state.algorithm)
+    // Compact the marked tiles into the tile list, one invocation per tile.
+    const uint32_t  numTiles      = static_cast<uint32_t>(m_sceneUbo.tiles.x * m_sceneUbo.tiles.y);
+    VkDescriptorSet descriptorSet = getCurrentDescriptorSet();
+    vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineTileClassify);
+    vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_descriptorInfo.getPipeLayout(), 0, 1,
+                            &descriptorSet, 0, nullptr);
+    vkCmdDispatch(cmdBuffer, (numTiles + TILE_CLASSIFY_WORKGROUP_SIZE - 1) / TILE_CLASSIFY_WORKGROUP_SIZE, 1, 1);
+
+    // Make sure the tile list is complete before drawing it.
     {
-      case OIT_SIMPLE:
-        drawTransparentSimple(cmdBuffer, numTransparent);
-        break;
-      case OIT_LINKEDLIST:
-        drawTransparentLinkedList(cmdBuffer, numTransparent);
-        break;
-      case OIT_LOOP:
-        drawTransparentLoop(cmdBuffer, numTransparent);
-        break;
-      case OIT_LOOP64:
-        drawTransparentLoop64(cmdBuffer, numTransparent);
-        break;
-      case OIT_INTERLOCK:
-      case OIT_SPINLOCK:
-        drawTransparentLock(cmdBuffer, numTransparent, (m_state.algorithm == OIT_INTERLOCK));
-        break;
-      case OIT_WEIGHTED:
-        drawTransparentWeighted(cmdBuffer, numTransparent);
-        break;
-      default:
-        assert(!"Algorithm case not called in switch statement!");
+      VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+      barrier.srcAccessMask   = VK_ACCESS_SHADER_WRITE_BIT;
+      barrier.dstAccessMask   = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+      vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &barrier, 0,
+                           nullptr, 0, nullptr);
     }
+  }
 
-    vkCmdEndRenderPass(cmdBuffer);
+  // Resume the main render pass over the same band, keeping what we've drawn.
+  // The pipeline layout's descriptor sets, push constants, and scissor
+  // rectangle are still bound.
+  VkRenderPassBeginInfo renderPassInfo = nvvk::make<VkRenderPassBeginInfo>();
+  renderPassInfo.renderPass            = m_renderPassColorDepthLoad;
+  renderPassInfo.framebuffer           = m_mainColorDepthFramebuffer;
+  renderPassInfo.renderArea            = m_bandRect;
+  vkCmdBeginRenderPass(cmdBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void Sample::cmdDrawComposite(VkCommandBuffer& cmdBuffer)
+{
+  if(m_state.usesTiledComposite())
+  {
+    // Draw a quad per tile in the tile list; oitTileClassify.comp.glsl wrote
+    // the number of tiles to the draw command's instance count.
+    vkCmdDrawIndirect(cmdBuffer, currentOitFrame().tileList.buffer.buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+  }
+  else
+  {
+    vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
   }
 }
 
@@ -138,38 +550,68 @@ void Sample::drawSceneObjects(VkCommandBuffer& cmdBuffer, int firstObject, int n
   VkDeviceSize offsets[]       = {0};
   vkCmdBindVertexBuffers(cmdBuffer, 0, 1, vertexBuffers, offsets);
 
-  vkCmdBindIndexBuffer(cmdBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+  vkCmdBindIndexBuffer(cmdBuffer, m_indexBuffer.buffer, 0, m_indexType);
 
   // Bind the graphics pipeline state object (shaders, configuration)
   vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineOpaque);
 
   // Draw!
-  vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, firstObject * m_objectTriangleIndices, 0, 0);
+  if(m_state.frustumCulling)
+  {
+    // objectCull.comp.glsl wrote the visible opaque objects' draw commands
+    // after the header, and their number to the first uint.
+    const VkDeviceSize commandsOffset = DRAW_COMMANDS_HEADER_UINTS * sizeof(uint32_t);
+    vkCmdDrawIndexedIndirectCountKHR(cmdBuffer, m_drawCommandBuffer.buffer, commandsOffset, m_drawCommandBuffer.buffer,
+                                     0, numObjects, sizeof(VkDrawIndexedIndirectCommand));
+  }
+  else
+  {
+    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, firstObject * m_objectTriangleIndices, 0, 0);
+  }
+}
+
+void Sample::cmdDrawTransparentObjects(VkCommandBuffer& cmdBuffer, int numObjects)
+{
+  if(m_state.frustumCulling)
+  {
+    // The transparent objects' draw commands start after one per object in
+    // the scene, and their number is the second uint.
+    const uint32_t     sceneObjects   = m_sceneTriangleIndices / m_objectTriangleIndices;
+    const VkDeviceSize commandsOffset = DRAW_COMMANDS_HEADER_UINTS * sizeof(uint32_t)
+                                        + static_cast<VkDeviceSize>(sceneObjects) * sizeof(VkDrawIndexedIndirectCommand);
+    vkCmdDrawIndexedIndirectCountKHR(cmdBuffer, m_drawCommandBuffer.buffer, commandsOffset, m_drawCommandBuffer.buffer,
+                                     sizeof(uint32_t), numObjects, sizeof(VkDrawIndexedIndirectCommand));
+  }
+  else
+  {
+    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+  }
 }
 
 void Sample::clearTransparentSimple(VkCommandBuffer& cmdBuffer)
 {
   // Clears all values in m_oitAux to 0.
-  const nvvk::ProfilerVK::Section scopedTimer(m_profilerVK, "ClearSimple", cmdBuffer);
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClearSimple", cmdBuffer);
+  OitFrameResources& frame = currentOitFrame();
 
-  // Clear the base mip and layer of m_oitAuxImage
+  // Clear the base mip and layer of the aux image
   VkClearColorValue auxClearColor;
   auxClearColor.uint32[0] = 0;  // Since m_oitAux is R32UINT
   VkImageSubresourceRange auxClearRanges;
   auxClearRanges.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
   auxClearRanges.baseArrayLayer = 0;
   auxClearRanges.baseMipLevel   = 0;
-  auxClearRanges.layerCount     = m_oitAuxImage.c_layers;
+  auxClearRanges.layerCount     = frame.auxImage.c_layers;
   auxClearRanges.levelCount     = 1;
-  vkCmdClearColorImage(cmdBuffer,                  // Command buffer
-                       m_oitAuxImage.image.image,  // The VkImage
-                       VK_IMAGE_LAYOUT_GENERAL,    // The current image layout
-                       &auxClearColor,             // The color to clear it with
-                       1,                          // The number of VkImageSubresourceRanges below
-                       &auxClearRanges             // Range of mipmap levels, array layers, and aspects to be cleared
+  vkCmdClearColorImage(cmdBuffer,                   // Command buffer
+                       frame.auxImage.image.image,  // The VkImage
+                       VK_IMAGE_LAYOUT_GENERAL,     // The current image layout
+                       &auxClearColor,              // The color to clear it with
+                       1,                           // The number of VkImageSubresourceRanges below
+                       &auxClearRanges              // Range of mipmap levels, array layers, and aspects to be cleared
   );
 
-  // Make sure this completes before using m_oitAuxImage again.
+  // Make sure this completes before using the aux image again.
   cmdTransferBarrierSimple(cmdBuffer);
 }
 
@@ -181,7 +623,9 @@ void Sample::drawTransparentSimple(VkCommandBuffer& cmdBuffer, int numObjects)
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineSimpleColor);
     // Draw all objects
-    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
+    cmdDrawTransparentObjects(cmdBuffer, numObjects);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
   }
 
   // Make sure the color pass completes before the composite pass
@@ -190,16 +634,20 @@ void Sample::drawTransparentSimple(VkCommandBuffer& cmdBuffer, int numObjects)
   // COMPOSITE
   // Sorts the stored fragments per pixel or sample and composites them onto the color image.
   {
+    cmdBeginComposite(cmdBuffer);
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineSimpleComposite);
-    // Draw a full-screen triangle:
-    vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+    // Draw a full-screen triangle, or the tiles containing transparency:
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
+    cmdDrawComposite(cmdBuffer);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
   }
 }
 
-void Sample::clearTransparentLinkedList(VkCommandBuffer& cmdBuffer)
+void Sample::clearTransparentLinkedList(VkCommandBuffer& cmdBuffer, bool clearHeads)
 {
   // Sets the atomic counter (really a 1x1 image) to 0, and set imgAux to 0.
-  const nvvk::ProfilerVK::Section scopedTimer(m_profilerVK, "ClearLinkedList", cmdBuffer);
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClearLinkedList", cmdBuffer);
+  OitFrameResources& frame = currentOitFrame();
 
   VkClearColorValue auxClearColor;
   auxClearColor.uint32[0] = 0;  // Since m_oitAux is R32UINT
@@ -207,11 +655,14 @@ void Sample::clearTransparentLinkedList(VkCommandBuffer& cmdBuffer)
   auxClearRanges.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
   auxClearRanges.baseArrayLayer = 0;
   auxClearRanges.baseMipLevel   = 0;
-  auxClearRanges.layerCount     = m_oitAuxImage.c_layers;
+  auxClearRanges.layerCount     = frame.auxImage.c_layers;
   auxClearRanges.levelCount     = 1;
-  vkCmdClearColorImage(cmdBuffer, m_oitAuxImage.image.image, m_oitAuxImage.currentLayout, &auxClearColor, 1, &auxClearRanges);
+  if(clearHeads)
+  {
+    vkCmdClearColorImage(cmdBuffer, frame.auxImage.image.image, frame.auxImage.currentLayout, &auxClearColor, 1, &auxClearRanges);
+  }
   auxClearRanges.layerCount = 1;
-  vkCmdClearColorImage(cmdBuffer, m_oitCounterImage.image.image, m_oitCounterImage.currentLayout, &auxClearColor, 1, &auxClearRanges);
+  vkCmdClearColorImage(cmdBuffer, frame.counterImage.image.image, frame.counterImage.currentLayout, &auxClearColor, 1, &auxClearRanges);
 
   // Make sure this completes before using these images again.
   cmdTransferBarrierSimple(cmdBuffer);
@@ -224,7 +675,9 @@ void Sample::drawTransparentLinkedList(VkCommandBuffer& cmdBuffer, int numObject
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLinkedListColor);
     // Draw all objects
-    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
+    cmdDrawTransparentObjects(cmdBuffer, numObjects);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
   }
 
   // Make sure the color pass completes before the composite pass
@@ -233,16 +686,29 @@ void Sample::drawTransparentLinkedList(VkCommandBuffer& cmdBuffer, int numObject
   // COMPOSITE
   // Iterates through the linked lists and sorts and tail-blends fragments.
   {
+    cmdBeginComposite(cmdBuffer);
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLinkedListComposite);
-    // Draw a full-screen triangle
-    vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+    // Draw a full-screen triangle, or the tiles containing transparency
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
+    cmdDrawComposite(cmdBuffer);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
   }
 }
 
 void Sample::clearTransparentLoop(VkCommandBuffer& cmdBuffer)
 {
-  // Set all depth values in m_oitABuffer to 0xFFFFFFFF.
-  const nvvk::ProfilerVK::Section scopedTimer(m_profilerVK, "ClearLoop", cmdBuffer);
+  // Set all depth values in the A-buffer to 0xFFFFFFFF.
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClearLoop", cmdBuffer);
+  OitFrameResources& frame = currentOitFrame();
+
+  // With the other layouts, depths and colors are interleaved in smaller
+  // blocks, so we clear the whole A-buffer.
+  if(m_state.aBufferLayout() != ABUFFER_LAYOUT_LAYER_MAJOR)
+  {
+    vkCmdFillBuffer(cmdBuffer, frame.aBuffer.buffer.buffer, 0, VK_WHOLE_SIZE, 0xFFFFFFFFu);
+    cmdTransferBarrierSimple(cmdBuffer);
+    return;
+  }
 
   // This makes sure to only overwrite the depth portion of the A-buffer, which
   // should improve bandwidth. See the memory layout described in oitScene.frag.glsl
@@ -252,14 +718,14 @@ void Sample::clearTransparentLoop(VkCommandBuffer& cmdBuffer)
 
   for(size_t i = 0; i < (m_state.sampleShading ? m_state.msaa : 1); i++)
   {
-    vkCmdFillBuffer(cmdBuffer,                   // Command buffer
-                    m_oitABuffer.buffer.buffer,  // Buffer
-                    i * clearSize * 2,           // Offset
-                    clearSize,                   // Size
-                    0xFFFFFFFFu);                // Data
+    vkCmdFillBuffer(cmdBuffer,                    // Command buffer
+                    frame.aBuffer.buffer.buffer,  // Buffer
+                    i * clearSize * 2,            // Offset
+                    clearSize,                    // Size
+                    0xFFFFFFFFu);                 // Data
   }
 
-  // Make sure this completes before using m_oitABuffer again.
+  // Make sure this completes before using the A-buffer again.
   cmdTransferBarrierSimple(cmdBuffer);
 }
 
@@ -270,7 +736,9 @@ void Sample::drawTransparentLoop(VkCommandBuffer& cmdBuffer, int numObjects)
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLoopDepth);
     // Draw all objects
-    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_DEPTH);
+    cmdDrawTransparentObjects(cmdBuffer, numObjects);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_DEPTH);
   }
 
   // Make sure the depth pass completes before the composite pass
@@ -281,7 +749,9 @@ void Sample::drawTransparentLoop(VkCommandBuffer& cmdBuffer, int numObjects)
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLoopColor);
     // Draw all objects
-    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
+    cmdDrawTransparentObjects(cmdBuffer, numObjects);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
   }
 
   // Make sure the color pass completes before the composite pass
@@ -290,19 +760,23 @@ void Sample::drawTransparentLoop(VkCommandBuffer& cmdBuffer, int numObjects)
   // COMPOSITE
   // Blends the sorted colors together.
   {
+    cmdBeginComposite(cmdBuffer);
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLoopComposite);
-    // Draw a full-screen triangle
-    vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+    // Draw a full-screen triangle, or the tiles containing transparency
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
+    cmdDrawComposite(cmdBuffer);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
   }
 }
 
 void Sample::clearTransparentLoop64(VkCommandBuffer& cmdBuffer)
 {
-  // Sets all values in m_oitABuffer to 0xFFFFFFFF (depth), 0xFFFFFFFF (color)
-  const nvvk::ProfilerVK::Section scopedTimer(m_profilerVK, "ClearLoop64", cmdBuffer);
-  vkCmdFillBuffer(cmdBuffer, m_oitABuffer.buffer.buffer, 0, VK_WHOLE_SIZE, 0xFFFFFFFFu);
+  // Sets all values in the A-buffer to 0xFFFFFFFF (depth), 0xFFFFFFFF (color)
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClearLoop64", cmdBuffer);
+  OitFrameResources& frame = currentOitFrame();
+  vkCmdFillBuffer(cmdBuffer, frame.aBuffer.buffer.buffer, 0, VK_WHOLE_SIZE, 0xFFFFFFFFu);
 
-  // Make sure this completes before using m_oitABuffer again.
+  // Make sure this completes before using the A-buffer again.
   cmdTransferBarrierSimple(cmdBuffer);
 }
 
@@ -313,7 +787,9 @@ void Sample::drawTransparentLoop64(VkCommandBuffer& cmdBuffer, int numObjects)
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLoop64Color);
     // Draw all objects
-    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
+    cmdDrawTransparentObjects(cmdBuffer, numObjects);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
   }
 
   // Make sure the depth + color pass completes before the composite pass
@@ -322,9 +798,12 @@ void Sample::drawTransparentLoop64(VkCommandBuffer& cmdBuffer, int numObjects)
   // COMPOSITE
   // Blends the sorted colors together
   {
+    cmdBeginComposite(cmdBuffer);
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLoop64Composite);
-    // Draw a full-screen triangle
-    vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+    // Draw a full-screen triangle, or the tiles containing transparency
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
+    cmdDrawComposite(cmdBuffer);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
   }
 }
 
@@ -332,7 +811,8 @@ void Sample::clearTransparentLock(VkCommandBuffer& cmdBuffer, bool useInterlock)
 {
   // Sets the values in IMG_AUX to 0 and IMG_AUXDEPTH to 0xFFFFFFFF.
   // If using spinlock, sets the values in IMG_AUXSPIN to 0 as well.
-  const nvvk::ProfilerVK::Section scopedTimer(m_profilerVK, "ClearLock", cmdBuffer);
+  const TraceRecorder::ProfilerSection scopedTimer(m_profilerVK, m_trace, "ClearLock", cmdBuffer);
+  OitFrameResources& frame = currentOitFrame();
 
   VkClearColorValue auxClearColor0;
   auxClearColor0.uint32[0] = 0;  // Since m_oitAux is R32UINT
@@ -342,15 +822,15 @@ void Sample::clearTransparentLock(VkCommandBuffer& cmdBuffer, bool useInterlock)
   auxClearRanges.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
   auxClearRanges.baseArrayLayer = 0;
   auxClearRanges.baseMipLevel   = 0;
-  auxClearRanges.layerCount     = m_oitAuxDepthImage.c_layers;
+  auxClearRanges.layerCount     = frame.auxDepthImage.c_layers;
   auxClearRanges.levelCount     = 1;
 
-  vkCmdClearColorImage(cmdBuffer, m_oitAuxDepthImage.image.image, m_oitAuxDepthImage.currentLayout, &auxClearColorF, 1, &auxClearRanges);
-  vkCmdClearColorImage(cmdBuffer, m_oitAuxImage.image.image, m_oitAuxImage.currentLayout, &auxClearColor0, 1, &auxClearRanges);
+  vkCmdClearColorImage(cmdBuffer, frame.auxDepthImage.image.image, frame.auxDepthImage.currentLayout, &auxClearColorF, 1, &auxClearRanges);
+  vkCmdClearColorImage(cmdBuffer, frame.auxImage.image.image, frame.auxImage.currentLayout, &auxClearColor0, 1, &auxClearRanges);
   if(!useInterlock)
   {
-    // Also clear m_oitAuxSpinImage
-    vkCmdClearColorImage(cmdBuffer, m_oitAuxSpinImage.image.image, m_oitAuxSpinImage.currentLayout, &auxClearColor0, 1, &auxClearRanges);
+    // Also clear the spinlock image
+    vkCmdClearColorImage(cmdBuffer, frame.auxSpinImage.image.image, frame.auxSpinImage.currentLayout, &auxClearColor0, 1, &auxClearRanges);
   }
   cmdTransferBarrierSimple(cmdBuffer);
 }
@@ -362,7 +842,9 @@ void Sample::drawTransparentLock(VkCommandBuffer& cmdBuffer, int numObjects, boo
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, (useInterlock ? m_pipelineInterlockColor : m_pipelineSpinlockColor));
     // Draw all objects
-    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
+    cmdDrawTransparentObjects(cmdBuffer, numObjects);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
   }
 
   // Make sure the color pass completes before the composite pass
@@ -371,15 +853,20 @@ void Sample::drawTransparentLock(VkCommandBuffer& cmdBuffer, int numObjects, boo
   // COMPOSITE
   // Blends the sorted colors together
   {
+    cmdBeginComposite(cmdBuffer);
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                       (useInterlock ? m_pipelineInterlockComposite : m_pipelineSpinlockComposite));
-    // Draw a full-screen triangle
-    vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+    // Draw a full-screen triangle, or the tiles containing transparency
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
+    cmdDrawComposite(cmdBuffer);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
   }
 }
 
 void Sample::drawTransparentWeighted(VkCommandBuffer& cmdBuffer, int numObjects)
 {
+  OitFrameResources& frame = currentOitFrame();
+
   // Swap out the render pass for WBOIT's render pass
   vkCmdEndRenderPass(cmdBuffer);
 
@@ -389,10 +876,10 @@ void Sample::drawTransparentWeighted(VkCommandBuffer& cmdBuffer, int numObjects)
 
   VkRenderPassBeginInfo renderPassInfo    = nvvk::make<VkRenderPassBeginInfo>();
   renderPassInfo.renderPass               = m_renderPassWeighted;
-  renderPassInfo.framebuffer              = m_weightedFramebuffer;
+  renderPassInfo.framebuffer              = frame.weightedFramebuffer;
   renderPassInfo.renderArea.offset        = {0, 0};
-  renderPassInfo.renderArea.extent.width  = m_oitWeightedColorImage.c_width;
-  renderPassInfo.renderArea.extent.height = m_oitWeightedRevealImage.c_height;
+  renderPassInfo.renderArea.extent.width  = frame.weightedColorImage.c_width;
+  renderPassInfo.renderArea.extent.height = frame.weightedRevealImage.c_height;
   std::array<VkClearValue, 2> clearValues;
   clearValues[0].color.float32[0] = 0.0f;
   clearValues[0].color.float32[1] = 0.0f;
@@ -409,7 +896,9 @@ void Sample::drawTransparentWeighted(VkCommandBuffer& cmdBuffer, int numObjects)
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineWeightedColor);
     // Draw all objects
-    vkCmdDrawIndexed(cmdBuffer, numObjects * m_objectTriangleIndices, 1, 0, 0, 0);
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
+    cmdDrawTransparentObjects(cmdBuffer, numObjects);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COLOR);
   }
 
   // Move to the next subpass
@@ -419,6 +908,8 @@ void Sample::drawTransparentWeighted(VkCommandBuffer& cmdBuffer, int numObjects)
   {
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineWeightedComposite);
     // Draw a full-screen triangle
+    cmdBeginPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
     vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+    cmdEndPassStatistics(cmdBuffer, STATISTICS_PASS_COMPOSITE);
   }
 }
\ No newline at end of file
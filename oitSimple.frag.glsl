@@ -40,24 +40,57 @@
 #include "oitColorDepthDefines.glsl"
 
 // Stores up to OIT_LAYERS fragments per (MSAA) sample and their depths.
-layout(binding = IMG_ABUFFER, abufferType) uniform coherent uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS abufferComponents
+#include "oitABuffer.glsl"
+
 // Stores the number of fragments processed so far per (MSAA) sample.
 layout(binding = IMG_AUX, r32ui) uniform coherent uimage2DUsed imgAux;
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0, index = 0) out vec4 outColor;
 
 void main()
 {
-  // Get the unpremultiplied linear-space RGBA color of this pixel
-  vec4 color = shading(IN);
-  // Convert to unpremultiplied sRGB for 8-bit storage
-  const vec4 sRGBColor = unPremultLinearToSRGB(color);
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, true, IN))
+  {
+    discard;
+  }
+#endif
+
+#if OIT_HYBRID_SAMPLES
+  // Edge fragments only write the samples they tail-blend; see below.
+  gl_SampleMask[0] = -1;
+  const bool edge  = isEdgeFragment();
+  // Edge fragments take one slot per covered sample.
+  const uint slots = (edge ? uint(bitCount(storeMask)) : 1u);
+#else
+  const uint slots = 1u;
+#endif
+
+  // Skip fragments hidden behind enough opacity.
+  if(opacityCulled(materialOpacity(IN.color.a)))
+  {
+    outColor = vec4(0);
+    return;
+  }
+
+  // Let the composite pass know that this fragment's tile contains transparency.
+  markTransparentTile();
+
+  // Get the 32-bit color to store in the A-buffer. With OIT_DEFERRED_SHADING,
+  // this fragment is only shaded if it's composited or tail-blended.
+  const uint packedColor = packFragmentColor(IN, inObjectID);
 
-  // Get the number of pixels in the image
-  const int viewSize = scene.viewport.z;  // The number of pixels in the image
   // Get the index of the current sample at the current fragment
-  int listPos = viewSize * OIT_LAYERS * sampleID + coord.y * scene.viewport.x + coord.x;
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
   // For the first OIT_LAYERS fragments for this sample, store them in the
   // A-buffer. For the rest, blend them together using normal blending
@@ -67,26 +100,87 @@ void main()
   // the first and third components act as a payload. When using MSAA with
   // coverage shading, the third component let us know what MSAA samples this
   // element of the A-buffer covers.
-  uvec4 storeValue = uvec4(packUnorm4x8(sRGBColor), floatBitsToUint(gl_FragCoord.z), storeMask, 0);
+  uvec4 storeValue = uvec4(packedColor, floatBitsToUint(FRAGMENT_DEPTH), storeMask, 0);
 
   // Get the previous number of fragments stored in the A-buffer for this sample,
   // and increment it.
-  uint oldCounter = imageAtomicAdd(imgAux, coord, 1u);
+  uint oldCounter;
+  if(OIT_EPOCH_TAGS)
+  {
+    // A counter from an earlier epoch counts as 0, so we can't just add 1 to
+    // it; instead, compare-and-swap until we've incremented the current value.
+    uint expected = imageLoad(imgAux, coord).r;
+    while(true)
+    {
+      const uint actual = imageAtomicCompSwap(imgAux, coord, expected, epochStore(epochLoad(expected) + slots));
+      if(actual == expected)
+      {
+        break;
+      }
+      expected = actual;
+    }
+    oldCounter = epochLoad(expected);
+  }
+  else
+  {
+    oldCounter = imageAtomicAdd(imgAux, coord, slots);
+  }
+
+#if OIT_HYBRID_SAMPLES
+  if(edge)
+  {
+    // Shade and store each covered sample in its own slot, and tail-blend
+    // the samples that don't fit.
+    uint slot     = oldCounter;
+    uint tailMask = 0;
+    for(uint remaining = storeMask; remaining != 0u; remaining &= remaining - 1u)
+    {
+      const int s = findLSB(remaining);
+      if(slot < OIT_LAYERS)
+      {
+        const uint sampleColor = packFragmentColor(interpolantsAtSample(s), inObjectID);
+        abufferStore(listPos + abufferLayer(int(slot)), uvec4(sampleColor, storeValue.y, 1u << s, 0));
+        slot++;
+      }
+      else
+      {
+        tailMask |= 1u << s;
+      }
+    }
+
+    gl_SampleMask[0] = int(tailMask);
+    if(OIT_TAILBLEND && tailMask != 0u)
+    {
+      const vec4 color = shading(IN);
+      outColor         = vec4(color.rgb * color.a, color.a);
+    }
+    else
+    {
+      outColor = vec4(0);
+    }
+    return;
+  }
+#endif
+
   if(oldCounter < OIT_LAYERS)
   {
-    imageStore(imgAbuffer, listPos + int(oldCounter) * viewSize, storeValue);
+    abufferStore(listPos + abufferLayer(int(oldCounter)), storeValue);
 
     // Inserted, so make this fragment transparent:
     outColor = vec4(0);
   }
   else
   {
-#if OIT_TAILBLEND
-    // Premultiply alpha
-    outColor = vec4(color.rgb * color.a, color.a);
-#else   // #if OIT_TAILBLEND
-    outColor = vec4(0);  // Ignore tail-blended values
-#endif  // #if OIT_TAILBLEND
+    if(OIT_TAILBLEND)
+    {
+      // Shade this fragment and premultiply alpha
+      const vec4 color = shading(IN);
+      outColor         = vec4(color.rgb * color.a, color.a);
+    }
+    else
+    {
+      outColor = vec4(0);  // Ignore tail-blended values
+    }
   }
 }
 
@@ -106,7 +200,10 @@ void main()
 
 // Stores up to OIT_LAYERS fragments per (MSAA) sample and their depths.
 // Im Vulkan, an imageBuffer maps to a Storage Texel Buffer.
-layout(binding = IMG_ABUFFER, abufferType) uniform restrict readonly uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS abufferComponents
+#define ABUFFER_READONLY
+#include "oitABuffer.glsl"
+
 // Stores the number of fragments processed so far per (MSAA) sample.
 layout(binding = IMG_AUX, r32ui) uniform restrict readonly uimage2DUsed imgAux;
 
@@ -118,21 +215,19 @@ void main()
 
   vec4 color = vec4(0);
 
-  // Get the number of pixels in the image.
-  int viewSize = scene.viewport.z;
   // Get the index of the current sample at the current fragment.
-  int listPos = viewSize * OIT_LAYERS * sampleID + coord.y * scene.viewport.x + coord.x;
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
   // Load the number of fragments for the given sample. Then load those
   // fragments and sort them.
 
   // The number of fragments for this sample.
-  int fragments = int(imageLoad(imgAux, coord).r);
+  int fragments = int(epochLoad(imageLoad(imgAux, coord).r));
   fragments     = min(OIT_LAYERS, fragments);
 
   for(int i = 0; i < fragments; i++)
   {
-    array[i] = loadOp(imageLoad(imgAbuffer, listPos + i * viewSize));
+    array[i] = loadOp(abufferLoad(listPos + abufferLayer(i)));
   }
 
   bubbleSort(array, fragments);
@@ -140,26 +235,12 @@ void main()
   vec4 colorSum = vec4(0);  // Initially completely transparent
 
 #if OIT_COVERAGE_SHADING
-  // Compute the blended color of each MSAA sample from the fragments stored
-  // in the A-buffer. For each MSAA sample, we loop through the fragments
-  // and see which fragments covered this sample.
-
-  for(int s = 0; s < OIT_MSAA; s++)
-  {
-    vec4 sColor = vec4(0);
-    for(int i = 0; i < fragments; i++)
-    {
-      if((array[i].b & (1 << s)) != 0)
-      {
-        doBlendPacked(sColor, array[i].r);
-      }
-    }
-    colorSum += sColor;
-  }
-  colorSum /= OIT_MSAA;
+  // Compute the average blended color of the MSAA samples, blending once per
+  // group of samples covered by the same fragments.
+  colorSum = blendCoverageGroups(array, fragments);
 #else
   // Blend all of the fragments together:
-  for(int i = 0; i < fragments; i++)
+  for(int i = 0; i < fragments && !opacitySaturated(colorSum); i++)
   {
     doBlendPacked(colorSum, array[i].x);
   }
@@ -38,35 +38,62 @@
 
 #include "oitColorDepthDefines.glsl"
 
-layout(abufferType, binding = IMG_ABUFFER) uniform coherent uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS abufferComponents
+#include "oitABuffer.glsl"
+
 layout(r32ui, binding = IMG_AUX) uniform coherent uimage2DUsed imgAux;
 layout(r32ui, binding = IMG_AUXSPIN) uniform coherent uimage2DUsed imgSpin;
 layout(r32ui, binding = IMG_AUXDEPTH) uniform coherent uimage2DUsed imgDepth;
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0, index = 0) out vec4 outColor;
 
 void main()
 {
-  // Get the unpremultiplied linear-space RGBA color of this ixel
-  vec4 color = shading(IN);
-  // Convert to unpremultiplied sRGB for 8-bit storage
-  const vec4 sRGBColor = unPremultLinearToSRGB(color);
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, true, IN))
+  {
+    discard;
+  }
+#endif
+
+  // Skip fragments hidden behind enough opacity.
+  if(opacityCulled(materialOpacity(IN.color.a)))
+  {
+    outColor = vec4(0);
+    return;
+  }
+
+  // Let the composite pass know that this fragment's tile contains transparency.
+  markTransparentTile();
+
+  // Get the 32-bit color to store in the A-buffer. With OIT_DEFERRED_SHADING,
+  // this fragment is only shaded if it's composited or tail-blended.
+  const uint packedColor = packFragmentColor(IN, inObjectID);
+
+  // Which fragment to tail-blend, if any: this one, or one evicted from the
+  // A-buffer. Either is only shaded once we know it's tail-blended.
+  bool tailBlendSelf    = true;
+  bool tailBlendEvicted = false;
+  uint evictedColor     = 0;
 
   // Compute index in the A-buffer
-  const int viewSize = scene.viewport.z;
-  const int listPos  = viewSize * OIT_LAYERS * sampleID + (coord.y * scene.viewport.x + coord.x);
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
-  uvec4 storeValue = uvec4(packUnorm4x8(sRGBColor), floatBitsToUint(gl_FragCoord.z), storeMask, 0);
+  uvec4 storeValue = uvec4(packedColor, floatBitsToUint(FRAGMENT_DEPTH), storeMask, 0);
 
   // gl_order_independent_transparency has an #if for a different version of a
   // spinlock here, but since it's unstable (it flickers) and is disabled by
   // default, we don't implement it here.
 
-#if USE_EARLYDEPTH
-  uint oldDepth = imageLoad(imgDepth, coord).r;
-  if(storeValue.y <= oldDepth)
-#endif  // #if USE_EARLYDEPTH
+  if(!USE_EARLYDEPTH || furthestDepthTest(storeValue.y, imageLoad(imgDepth, coord).r))
   {
     // `done` tracks whether we've managed to complete the spinlock.
     // If the current thread is a helper thread, there's nothing to do.
@@ -83,13 +110,13 @@ void main()
         // Critical section --
 
         // See if there's enough space to avoid having to evict another fragment.
-        const uint oldCounter = imageLoad(imgAux, coord).r;
-        imageStore(imgAux, coord, uvec4(oldCounter + 1));
+        const uint oldCounter = epochLoad(imageLoad(imgAux, coord).r);
+        imageStore(imgAux, coord, uvec4(epochStore(oldCounter + 1)));
 
         if(oldCounter < OIT_LAYERS)
         {
-          imageStore(imgAbuffer, listPos + int(oldCounter) * viewSize, storeValue);
-          color = vec4(0);  // Inserted, so won't be tailblended
+          abufferStore(listPos + abufferLayer(int(oldCounter)), storeValue);
+          tailBlendSelf = false;  // Inserted, so won't be tailblended
         }
         else
         {
@@ -98,7 +125,7 @@ void main()
           uint maxDepth = 0;
           for(int i = 0; i < OIT_LAYERS; i++)
           {
-            uint testDepth = imageLoad(imgAbuffer, listPos + i * viewSize).g;
+            uint testDepth = abufferLoad(listPos + abufferLayer(i)).g;
             if(testDepth > maxDepth)
             {
               maxDepth = testDepth;
@@ -109,11 +136,14 @@ void main()
           if(maxDepth > storeValue.g)
           {
             // Replace the furthest fragment, tail-blending it, with this fragment.
-            color = unPremultSRGBToLinear(unpackUnorm4x8(imageLoad(imgAbuffer, listPos + furthest * viewSize).r));
-            imageStore(imgAbuffer, listPos + furthest * viewSize, storeValue);
-#if USE_EARLYDEPTH
-            imageStore(imgDepth, coord, uvec4(maxDepth));
-#endif  // #if USE_EARLYDEPTH
+            tailBlendSelf    = false;
+            tailBlendEvicted = true;
+            evictedColor     = abufferLoad(listPos + abufferLayer(furthest)).r;
+            abufferStore(listPos + abufferLayer(furthest), storeValue);
+            if(USE_EARLYDEPTH)
+            {
+              imageStore(imgDepth, coord, uvec4(furthestDepthStore(maxDepth)));
+            }
           }
         }
         // -- End critical section
@@ -123,9 +153,15 @@ void main()
     }
   }
 
-#if OIT_TAILBLEND
-  outColor = vec4(color.rgb * color.a, color.a);  // Premultiply the color
-#endif
+  if(OIT_TAILBLEND && (tailBlendSelf || tailBlendEvicted))
+  {
+    const vec4 color = tailBlendSelf ? shading(IN) : unpackFragmentColor(evictedColor);
+    outColor         = vec4(color.rgb * color.a, color.a);  // Premultiply the color
+  }
+  else
+  {
+    outColor = vec4(0);
+  }
 }
 
 #endif // #if PASS == PASS_COLOR
@@ -144,7 +180,10 @@ void main()
 
 // Stores up to OIT_LAYERS fragments per (MSAA) sample and their depths.
 // Im Vulkan, an imageBuffer maps to a Storage Texel Buffer.
-layout(binding = IMG_ABUFFER, abufferType) uniform restrict readonly uimageBuffer imgAbuffer;
+#define ABUFFER_COMPONENTS abufferComponents
+#define ABUFFER_READONLY
+#include "oitABuffer.glsl"
+
 // Stores the number of fragments processed so far per (MSAA) sample.
 layout(binding = IMG_AUX, r32ui) uniform restrict readonly uimage2DUsed imgAux;
 
@@ -156,21 +195,19 @@ void main()
 
   vec4 color = vec4(0);
 
-  // Get the number of pixels in the image.
-  int viewSize = scene.viewport.z;
   // Get the index of the current sample at the current fragment.
-  int listPos = viewSize * OIT_LAYERS * sampleID + coord.y * scene.viewport.x + coord.x;
+  const ABufferIndex listPos = abufferListPos(OIT_LAYERS);
 
   // Load the number of fragments for the given sample. Then load those
   // fragments and sort them.
 
   // The number of fragments for this sample.
-  int fragments = int(imageLoad(imgAux, coord).r);
+  int fragments = int(epochLoad(imageLoad(imgAux, coord).r));
   fragments     = min(OIT_LAYERS, fragments);
 
   for(int i = 0; i < fragments; i++)
   {
-    array[i] = loadOp(imageLoad(imgAbuffer, listPos + i * viewSize));
+    array[i] = loadOp(abufferLoad(listPos + abufferLayer(i)));
   }
 
   bubbleSort(array, fragments);
@@ -178,26 +215,12 @@ void main()
   vec4 colorSum = vec4(0);  // Initially completely transparent
 
 #if OIT_COVERAGE_SHADING
-  // Compute the blended color of each MSAA sample from the fragments stored
-  // in the A-buffer. For each MSAA sample, we loop through the fragments
-  // and see which fragments covered this sample.
-
-  for(int s = 0; s < OIT_MSAA; s++)
-  {
-    vec4 sColor = vec4(0);
-    for(int i = 0; i < fragments; i++)
-    {
-      if((array[i].b & (1 << s)) != 0)
-      {
-        doBlendPacked(sColor, array[i].r);
-      }
-    }
-    colorSum += sColor;
-  }
-  colorSum /= OIT_MSAA;
+  // Compute the average blended color of the MSAA samples, blending once per
+  // group of samples covered by the same fragments.
+  colorSum = blendCoverageGroups(array, fragments);
 #else
   // Blend all of the fragments together:
-  for(int i = 0; i < fragments; i++)
+  for(int i = 0; i < fragments && !opacitySaturated(colorSum); i++)
   {
     doBlendPacked(colorSum, array[i].x);
   }
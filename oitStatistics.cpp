@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// This file gathers statistics that help explain the GPU cost of each
+// algorithm. Pipeline statistics queries count the primitives and fragment
+// shader invocations of each pass, and VK_KHR_pipeline_executable_properties
+// lets the driver report per-shader statistics such as register counts,
+// spills, and instruction counts. For instance, a composite pass that gets
+// much slower at high OIT_LAYERS while its invocation count stays the same
+// usually shows register spilling here.
+//
+// Which executable statistics exist, and what they're called, depends on the
+// driver, so we store and display all of them.
+
+#include "oit.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+#include <nvvk/error_vk.hpp>
+
+// The pipeline statistics each query counts, in the order they're written.
+static const VkQueryPipelineStatisticFlags STATISTICS_FLAGS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+static const char* STATISTICS_PASS_NAMES[NUM_STATISTICS_PASSES] = {"Opaque", "Depth", "Color", "Composite"};
+
+static const char* ALGORITHM_NAMES[NUM_ALGORITHMS] = {"simple",   "linkedlist", "loop",    "loop64",
+                                                      "spinlock", "interlock",  "weighted"};
+
+// Writes text as a JSON string, including quotes.
+static void writeJsonString(FILE* file, const std::string& text)
+{
+  fputc('"', file);
+  for(char c : text)
+  {
+    if(c == '"' || c == '\\')
+    {
+      fputc('\\', file);
+      fputc(c, file);
+    }
+    else if(static_cast<unsigned char>(c) < 0x20)
+    {
+      fprintf(file, "\\u%04x", static_cast<unsigned>(c));
+    }
+    else
+    {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+bool Sample::supportsPipelineStatistics() const
+{
+  return (m_context.m_physicalInfo.features10.pipelineStatisticsQuery == VK_TRUE);
+}
+
+bool Sample::supportsPipelineExecutableStatistics() const
+{
+  return m_context.hasDeviceExtension(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME);
+}
+
+void Sample::destroyStatisticsResources()
+{
+  vkDestroyQueryPool(m_context, m_shaderStatistics.queryPool, nullptr);
+  m_shaderStatistics.queryPool = VK_NULL_HANDLE;
+  m_shaderStatistics.cycleBands.clear();
+}
+
+void Sample::createStatisticsResources()
+{
+  destroyStatisticsResources();
+
+  if(!supportsPipelineStatistics())
+  {
+    return;
+  }
+
+  // One set of queries per frame in flight, so that we never reset queries
+  // the GPU might still be writing to.
+  VkQueryPoolCreateInfo queryPoolInfo = nvvk::make<VkQueryPoolCreateInfo>();
+  queryPoolInfo.queryType             = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+  queryPoolInfo.queryCount            = nvvk::DEFAULT_RING_SIZE * ShaderStatistics::MAX_BANDS * NUM_STATISTICS_PASSES;
+  queryPoolInfo.pipelineStatistics    = STATISTICS_FLAGS;
+  NVVK_CHECK(vkCreateQueryPool(m_context, &queryPoolInfo, nullptr, &m_shaderStatistics.queryPool));
+  m_debug.setObjectName(m_shaderStatistics.queryPool, "m_shaderStatistics.queryPool");
+
+  m_shaderStatistics.cycleBands.assign(nvvk::DEFAULT_RING_SIZE, 0);
+}
+
+void Sample::updateExecutableStatistics()
+{
+  m_shaderStatistics.executables.clear();
+  if(!supportsPipelineExecutableStatistics())
+  {
+    return;
+  }
+
+  const std::pair<const char*, VkPipeline> pipelines[] = {
+      {"m_pipelineOpaque", m_pipelineOpaque},
+      {"m_pipelineSimpleColor", m_pipelineSimpleColor},
+      {"m_pipelineSimpleComposite", m_pipelineSimpleComposite},
+      {"m_pipelineLinkedListColor", m_pipelineLinkedListColor},
+      {"m_pipelineLinkedListComposite", m_pipelineLinkedListComposite},
+      {"m_pipelineLoopDepth", m_pipelineLoopDepth},
+      {"m_pipelineLoopColor", m_pipelineLoopColor},
+      {"m_pipelineLoopComposite", m_pipelineLoopComposite},
+      {"m_pipelineLoop64Color", m_pipelineLoop64Color},
+      {"m_pipelineLoop64Composite", m_pipelineLoop64Composite},
+      {"m_pipelineInterlockColor", m_pipelineInterlockColor},
+      {"m_pipelineInterlockComposite", m_pipelineInterlockComposite},
+      {"m_pipelineSpinlockColor", m_pipelineSpinlockColor},
+      {"m_pipelineSpinlockComposite", m_pipelineSpinlockComposite},
+      {"m_pipelineWeightedColor", m_pipelineWeightedColor},
+      {"m_pipelineWeightedComposite", m_pipelineWeightedComposite},
+  };
+
+  for(const auto& namedPipeline : pipelines)
+  {
+    if(namedPipeline.second == VK_NULL_HANDLE)
+    {
+      continue;
+    }
+
+    VkPipelineInfoKHR pipelineInfo = nvvk::make<VkPipelineInfoKHR>();
+    pipelineInfo.pipeline          = namedPipeline.second;
+    uint32_t numExecutables        = 0;
+    if(vkGetPipelineExecutablePropertiesKHR(m_context, &pipelineInfo, &numExecutables, nullptr) != VK_SUCCESS)
+    {
+      continue;
+    }
+    std::vector<VkPipelineExecutablePropertiesKHR> properties(numExecutables, nvvk::make<VkPipelineExecutablePropertiesKHR>());
+    NVVK_CHECK(vkGetPipelineExecutablePropertiesKHR(m_context, &pipelineInfo, &numExecutables, properties.data()));
+
+    for(uint32_t executableIndex = 0; executableIndex < numExecutables; executableIndex++)
+    {
+      // We're mainly interested in the fragment shaders, since they
+      // implement the algorithms.
+      if((properties[executableIndex].stages & VK_SHADER_STAGE_FRAGMENT_BIT) == 0)
+      {
+        continue;
+      }
+
+      ShaderStatistics::Executable executable;
+      executable.pipelineName = namedPipeline.first;
+      executable.name         = properties[executableIndex].name;
+      executable.subgroupSize = properties[executableIndex].subgroupSize;
+
+      VkPipelineExecutableInfoKHR executableInfo = nvvk::make<VkPipelineExecutableInfoKHR>();
+      executableInfo.pipeline                    = namedPipeline.second;
+      executableInfo.executableIndex             = executableIndex;
+      uint32_t numStatistics                     = 0;
+      NVVK_CHECK(vkGetPipelineExecutableStatisticsKHR(m_context, &executableInfo, &numStatistics, nullptr));
+      std::vector<VkPipelineExecutableStatisticKHR> statistics(numStatistics, nvvk::make<VkPipelineExecutableStatisticKHR>());
+      NVVK_CHECK(vkGetPipelineExecutableStatisticsKHR(m_context, &executableInfo, &numStatistics, statistics.data()));
+
+      for(const VkPipelineExecutableStatisticKHR& statistic : statistics)
+      {
+        char value[64];
+        switch(statistic.format)
+        {
+          case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_BOOL32_KHR:
+            snprintf(value, sizeof(value), "%s", (statistic.value.b32 == VK_TRUE) ? "true" : "false");
+            break;
+          case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_INT64_KHR:
+            snprintf(value, sizeof(value), "%" PRId64, statistic.value.i64);
+            break;
+          case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_UINT64_KHR:
+            snprintf(value, sizeof(value), "%" PRIu64, statistic.value.u64);
+            break;
+          case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_FLOAT64_KHR:
+            snprintf(value, sizeof(value), "%g", statistic.value.f64);
+            break;
+          default:
+            snprintf(value, sizeof(value), "0");
+            break;
+        }
+
+        ShaderStatistics::Statistic entry;
+        entry.name        = statistic.name;
+        entry.description = statistic.description;
+        entry.value       = value;
+        executable.statistics.push_back(entry);
+      }
+
+      m_shaderStatistics.executables.push_back(executable);
+    }
+  }
+}
+
+void Sample::cmdResetPassStatistics(VkCommandBuffer cmdBuffer)
+{
+  m_shaderStatistics.currentQuery = ~0u;
+  if(m_shaderStatistics.queryPool == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  const uint32_t cycle           = m_ringFences.getCycleIndex();
+  const uint32_t queriesPerCycle = ShaderStatistics::MAX_BANDS * NUM_STATISTICS_PASSES;
+  vkCmdResetQueryPool(cmdBuffer, m_shaderStatistics.queryPool, cycle * queriesPerCycle, queriesPerCycle);
+  m_shaderStatistics.cycleBands[cycle] = 0;
+}
+
+void Sample::setStatisticsBand(uint32_t band)
+{
+  m_shaderStatistics.currentQuery = ~0u;
+  if(m_shaderStatistics.queryPool == VK_NULL_HANDLE || band >= ShaderStatistics::MAX_BANDS)
+  {
+    return;
+  }
+
+  const uint32_t cycle                 = m_ringFences.getCycleIndex();
+  m_shaderStatistics.currentQuery      = (cycle * ShaderStatistics::MAX_BANDS + band) * NUM_STATISTICS_PASSES;
+  m_shaderStatistics.cycleBands[cycle] = band + 1;
+}
+
+void Sample::cmdBeginPassStatistics(VkCommandBuffer cmdBuffer, StatisticsPass pass)
+{
+  if(m_shaderStatistics.currentQuery != ~0u)
+  {
+    vkCmdBeginQuery(cmdBuffer, m_shaderStatistics.queryPool, m_shaderStatistics.currentQuery + pass, 0);
+  }
+}
+
+void Sample::cmdEndPassStatistics(VkCommandBuffer cmdBuffer, StatisticsPass pass)
+{
+  if(m_shaderStatistics.currentQuery != ~0u)
+  {
+    vkCmdEndQuery(cmdBuffer, m_shaderStatistics.queryPool, m_shaderStatistics.currentQuery + pass);
+  }
+}
+
+void Sample::collectPassStatistics()
+{
+  if(m_shaderStatistics.queryPool == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  const uint32_t cycle    = m_ringFences.getCycleIndex();
+  const uint32_t numBands = m_shaderStatistics.cycleBands[cycle];
+  if(numBands == 0)
+  {
+    return;
+  }
+
+  // Each query has a value for each bit in STATISTICS_FLAGS, followed by
+  // whether it's available; passes that weren't used are never available.
+  const uint32_t        valuesPerQuery = 3;
+  const uint32_t        numQueries     = numBands * NUM_STATISTICS_PASSES;
+  std::vector<uint64_t> values(numQueries * valuesPerQuery);
+  const VkResult        result = vkGetQueryPoolResults(
+      m_context, m_shaderStatistics.queryPool, cycle * ShaderStatistics::MAX_BANDS * NUM_STATISTICS_PASSES, numQueries,
+      values.size() * sizeof(uint64_t), values.data(), valuesPerQuery * sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if(result != VK_SUCCESS && result != VK_NOT_READY)
+  {
+    return;
+  }
+
+  for(uint32_t pass = 0; pass < NUM_STATISTICS_PASSES; pass++)
+  {
+    ShaderStatistics::Pass summed;
+    for(uint32_t band = 0; band < numBands; band++)
+    {
+      const uint64_t* query = &values[(band * NUM_STATISTICS_PASSES + pass) * valuesPerQuery];
+      if(query[2] != 0)
+      {
+        summed.valid = true;
+        summed.inputAssemblyPrimitives += query[0];
+        summed.fragmentShaderInvocations += query[1];
+      }
+    }
+    m_shaderStatistics.passes[pass] = summed;
+  }
+  m_shaderStatistics.cycleBands[cycle] = 0;
+}
+
+bool Sample::writeStatisticsReport(const char* filename) const
+{
+  FILE* file = fopen(filename, "w");
+  if(file == nullptr)
+  {
+    return false;
+  }
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"algorithm\": \"%s\",\n", ALGORITHM_NAMES[m_state.algorithm]);
+  fprintf(file, "  \"oitLayers\": %u,\n", m_state.oitLayers);
+  fprintf(file, "  \"tailBlend\": %s,\n", m_state.tailBlend ? "true" : "false");
+  fprintf(file, "  \"msaa\": %d,\n", m_state.msaa);
+  fprintf(file, "  \"sampleShading\": %s,\n", m_state.sampleShading ? "true" : "false");
+  fprintf(file, "  \"hybridSamples\": %s,\n", m_state.hybridSamples ? "true" : "false");
+  fprintf(file, "  \"aBufferLayout\": %u,\n", m_state.aBufferLayout());
+  fprintf(file, "  \"bands\": %u,\n", m_state.bands);
+  fprintf(file, "  \"width\": %u,\n", m_colorImage.c_width);
+  fprintf(file, "  \"height\": %u,\n", m_colorImage.c_height);
+
+  fprintf(file, "  \"passes\": [");
+  bool first = true;
+  for(uint32_t pass = 0; pass < NUM_STATISTICS_PASSES; pass++)
+  {
+    const ShaderStatistics::Pass& statistics = m_shaderStatistics.passes[pass];
+    if(!statistics.valid)
+    {
+      continue;
+    }
+    fprintf(file, "%s\n    {\"name\": \"%s\", \"inputAssemblyPrimitives\": %" PRIu64 ", \"fragmentShaderInvocations\": %" PRIu64 "}",
+            first ? "" : ",", STATISTICS_PASS_NAMES[pass], statistics.inputAssemblyPrimitives, statistics.fragmentShaderInvocations);
+    first = false;
+  }
+  fprintf(file, "\n  ],\n");
+
+  fprintf(file, "  \"executables\": [");
+  first = true;
+  for(const ShaderStatistics::Executable& executable : m_shaderStatistics.executables)
+  {
+    fprintf(file, "%s\n    {\"pipeline\": \"%s\", \"name\": ", first ? "" : ",", executable.pipelineName);
+    writeJsonString(file, executable.name);
+    fprintf(file, ", \"subgroupSize\": %u, \"statistics\": {", executable.subgroupSize);
+    for(size_t i = 0; i < executable.statistics.size(); i++)
+    {
+      fprintf(file, "%s", (i == 0) ? "" : ", ");
+      writeJsonString(file, executable.statistics[i].name);
+      fprintf(file, ": %s", executable.statistics[i].value.c_str());
+    }
+    fprintf(file, "}}");
+    first = false;
+  }
+  fprintf(file, "\n  ]\n}\n");
+
+  const bool succeeded = (ferror(file) == 0);
+  fclose(file);
+  return succeeded;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Compacts the tiles marked in the tile mask by the color pass into the tile
+// list, which tileComposite.vert.glsl then draws using vkCmdDrawIndirect.
+// Each invocation handles one tile. Sample::clearTiles sets the tile list's
+// draw command to 6 vertices and 0 instances beforehand, so that the number
+// of instances ends up being the number of marked tiles.
+
+#include "common.h"
+
+layout(local_size_x = TILE_CLASSIFY_WORKGROUP_SIZE) in;
+
+layout(binding = IMG_TILE_MASK, std430) restrict readonly buffer tileMaskBuffer
+{
+  uint tileMask[];
+};
+
+// Starts with a VkDrawIndirectCommand.
+layout(binding = IMG_TILE_LIST, std430) restrict buffer tileListBuffer
+{
+  uint vertexCount;
+  uint instanceCount;
+  uint firstVertex;
+  uint firstInstance;
+  uint tileList[];
+};
+
+void main()
+{
+  const uint tile = gl_GlobalInvocationID.x;
+  if(tile >= uint(scene.tiles.x * scene.tiles.y))
+  {
+    return;
+  }
+
+  if((tileMask[tile / 32u] & (1u << (tile % 32u))) != 0)
+  {
+    tileList[atomicAdd(instanceCount, 1u)] = tile;
+  }
+}
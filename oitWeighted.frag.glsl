@@ -46,12 +46,27 @@
 ////////////////////////////////////////////////////////////////////////////////
 #if PASS == PASS_COLOR
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+layout(location = OBJECT_ID_LOCATION) flat in uint inObjectID;
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) out vec4 outColor;
 layout(location = 1) out float outReveal;
 
 void main()
 {
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, true, IN))
+  {
+    discard;
+  }
+#endif
+
   vec4 color = shading(IN);
   color.rgb *= color.a;  // Premultiply it
 
@@ -23,12 +23,32 @@
 
 #include "shaderCommon.glsl"
 
+#if OIT_SPHERE_IMPOSTORS
+#include "sphereImpostor.glsl"
+layout(location = OBJECT_ID_LOCATION) flat in uint inObjectID;
+// The interpolants of the impostor quad, and those of the sphere's surface.
+layout(location = 0) in Interpolants rasterIN;
+Interpolants                         IN;
+#else  // #if OIT_SPHERE_IMPOSTORS
 layout(location = 0) in Interpolants IN;
+#endif  // #if OIT_SPHERE_IMPOSTORS
 
 layout(location = 0) out vec4 outColor;
+#if OIT_SPHERE_IMPOSTORS
+// The sphere's surface is behind its impostor quad, so depth can only increase.
+layout(depth_greater) out float gl_FragDepth;
+#endif
 
 void main()
 {
+#if OIT_SPHERE_IMPOSTORS
+  if(!raycastImpostor(rasterIN, inObjectID, false, IN))
+  {
+    discard;
+  }
+  gl_FragDepth = impostorDepth;
+#endif
+
   vec3 color = IN.color.rgb * goochLighting(IN.normal);
 
   outColor = vec4(color, 1.0f);
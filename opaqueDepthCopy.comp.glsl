@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Copies the current band of m_depthImage after the opaque draw to
+// IMG_OPAQUE_DEPTH for raycastImpostor (see sphereImpostor.glsl), which can't
+// read the depth image while it's bound as an attachment. Each invocation
+// copies a pixel; with OIT_SAMPLE_SHADING, it copies each of its samples to
+// its own layer, and otherwise the farthest depth of its samples.
+
+#include "common.h"
+#include "sceneDepth.glsl"
+
+layout(local_size_x = OPAQUE_DEPTH_WORKGROUP_SIZE, local_size_y = OPAQUE_DEPTH_WORKGROUP_SIZE) in;
+
+layout(binding = IMG_OPAQUE_DEPTH, std430) restrict writeonly buffer opaqueDepthBuffer
+{
+  float opaqueDepth[];
+};
+
+void main()
+{
+  // Relative to the top of the band, like the A-buffer.
+  const ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+  if(any(greaterThanEqual(coord, scene.viewport.xy)))
+  {
+    return;
+  }
+
+  const ivec2 pixel = coord + ivec2(0, pushConstants.bandOffsetY);
+  const int   index = coord.y * scene.viewport.x + coord.x;
+#if OIT_SAMPLE_SHADING
+  for(int s = 0; s < OIT_MSAA; s++)
+  {
+    opaqueDepth[s * scene.viewport.z + index] = sceneDepth(pixel, s);
+  }
+#else
+  // A fragment shaded once per pixel can't be tested per sample. Taking the
+  // farthest sample is conservative: the impostor is only discarded where
+  // the opaque objects cover all of the pixel, and elsewhere the transparent
+  // pass's depth test still resolves the covered samples.
+  float farthest = 0.0;
+  for(int s = 0; s < OIT_MSAA; s++)
+  {
+    farthest = max(farthest, sceneDepth(pixel, s));
+  }
+  opaqueDepth[index] = farthest;
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Runs object.vert.glsl's work once per vertex of the transparent objects,
+// and stores the results in the transformed vertex buffer, so that passes
+// that draw the transparent objects several times (such as OIT_LOOP's depth
+// and color passes, or a pass per band) can use preTransformed.vert.glsl
+// instead of transforming each vertex again. Used with State::preTransform.
+
+#include "shaderCommon.glsl"
+#include "sceneVertex.glsl"
+
+layout(local_size_x = PRE_TRANSFORM_WORKGROUP_SIZE) in;
+
+layout(binding = IMG_TRANSFORMED, std430) restrict writeonly buffer transformedBuffer
+{
+  TransformedVertex transformed[];
+};
+
+void main()
+{
+  const uint v = gl_GlobalInvocationID.x;
+  if(v >= numSceneVertices())
+  {
+    return;
+  }
+
+  const SceneVertex vertex = loadSceneVertex(v);
+
+  TransformedVertex result;
+  result.position = scene.projViewMatrix * vec4(vertex.position, 1.0);
+  result.pos      = vertex.position;
+  result.depth    = (scene.viewMatrix * vec4(vertex.position, 1.0)).z;
+  result.normal   = vertex.normal;
+  // All objects have the same number of vertices, and are stored in order.
+  result.objectID = v / scene.verticesPerObject;
+  result.color    = vertex.color;
+  transformed[v]  = result;
+}
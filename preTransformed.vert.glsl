@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Used instead of object.vert.glsl for the transparent objects with
+// State::preTransform. preTransform.comp.glsl has already transformed each
+// vertex this frame, so this only passes its results on.
+
+#include "shaderCommon.glsl"
+
+layout(binding = IMG_TRANSFORMED, std430) restrict readonly buffer transformedBuffer
+{
+  TransformedVertex transformed[];
+};
+
+layout(location = 0) out Interpolants OUT;
+layout(location = OBJECT_ID_LOCATION) flat out uint outObjectID;
+
+void main()
+{
+  const TransformedVertex v = transformed[gl_VertexIndex];
+  gl_Position               = v.position;
+  OUT.depth                 = v.depth;
+  OUT.pos                   = v.pos;
+  OUT.normal                = v.normal;
+  OUT.color                 = v.color;
+  outObjectID               = v.objectID;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Declares m_depthImage as a sampled image (IMG_SCENE_DEPTH), for compute
+// passes that read the opaque objects' depth; see
+// Sample::cmdSuspendForOpaqueDepth. Sampling it doesn't need a sampler, since
+// we only use texelFetch.
+//
+// Requires common.h to have been included.
+
+#extension GL_EXT_samplerless_texture_functions : require
+
+#if OIT_MSAA != 1
+layout(binding = IMG_SCENE_DEPTH) uniform texture2DMS sceneDepthTexture;
+#else
+layout(binding = IMG_SCENE_DEPTH) uniform texture2D sceneDepthTexture;
+#endif
+
+// Returns the depth of sample s of a pixel of m_depthImage. Pixels past the
+// edge of the image repeat the edge.
+float sceneDepth(ivec2 pixel, int s)
+{
+  pixel = min(pixel, scene.colorSize - 1);
+#if OIT_MSAA != 1
+  return texelFetch(sceneDepthTexture, pixel, s).r;
+#else
+  return texelFetch(sceneDepthTexture, pixel, 0).r;
+#endif
+}
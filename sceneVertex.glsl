@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Reads the scene's vertex buffer (IMG_SCENE_VERTICES) as a storage buffer,
+// for shaders that fetch vertices by index instead of through vertex
+// attributes: preTransform.comp.glsl, and object.vert.glsl with
+// OIT_COMPRESSED_VERTICES. With OIT_COMPRESSED_VERTICES, the buffer holds a
+// CompressedVertex per vertex; otherwise, it holds a Vertex per vertex.
+//
+// Requires shaderCommon.glsl to have been included.
+
+struct SceneVertex
+{
+  vec3 position;  // World-space position
+  vec3 normal;    // World-space normal
+  vec4 color;     // Linear-space color
+};
+
+#if OIT_COMPRESSED_VERTICES
+layout(binding = IMG_SCENE_VERTICES, std430) restrict readonly buffer sceneVertexBuffer
+{
+  CompressedVertex sceneVertices[];
+};
+
+uint numSceneVertices()
+{
+  return uint(sceneVertices.length());
+}
+
+// Decodes a unit vector from a point of the octahedron [-1, 1]^2 unfolded
+// onto a square; see "A Survey of Efficient Representations for Independent
+// Unit Vectors" (Cigolle et al., 2014).
+vec3 octDecode(vec2 e)
+{
+  vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if(v.z < 0.0)
+  {
+    v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(v);
+}
+
+SceneVertex loadSceneVertex(uint index)
+{
+  const CompressedVertex packed = sceneVertices[index];
+  // All objects have the same number of vertices, and are stored in order.
+  const uint object = index / scene.verticesPerObject;
+  const vec4 sphere = objectBounds[object];
+
+  const vec3 local = vec3(unpackSnorm2x16(packed.positionXY), unpackSnorm2x16(packed.positionZNormal).x);
+
+  SceneVertex result;
+  result.position = sphere.xyz + sphere.w * local;
+  result.normal   = octDecode(unpackSnorm4x8(packed.positionZNormal).zw);
+  result.color    = materials[object];
+  return result;
+}
+#else  // #if OIT_COMPRESSED_VERTICES
+// Read as floats, since Vertex's vec3s aren't aligned the way std430 requires.
+layout(binding = IMG_SCENE_VERTICES, std430) restrict readonly buffer sceneVertexBuffer
+{
+  float sceneVertices[];
+};
+
+uint numSceneVertices()
+{
+  return uint(sceneVertices.length()) / VERTEX_FLOATS;
+}
+
+SceneVertex loadSceneVertex(uint index)
+{
+  const uint base = index * VERTEX_FLOATS;
+
+  SceneVertex result;
+  result.position = vec3(sceneVertices[base + 0], sceneVertices[base + 1], sceneVertices[base + 2]);
+  result.normal   = vec3(sceneVertices[base + 3], sceneVertices[base + 4], sceneVertices[base + 5]);
+  result.color    = vec4(sceneVertices[base + 6], sceneVertices[base + 7], sceneVertices[base + 8], sceneVertices[base + 9]);
+  return result;
+}
+#endif  // #if OIT_COMPRESSED_VERTICES
@@ -21,6 +21,7 @@
 #extension GL_GOOGLE_include_directive : enable
 
 #include "common.h"
+#include "srgbLut.glsl"
 
 struct Interpolants
 {
@@ -30,6 +31,35 @@ struct Interpolants
   float depth;   // Z coordinate after applying the view matrix (larger = further away)
 };
 
+// Interpolants uses locations 0 through 3. The index of the object being
+// drawn is passed separately, since it needs to be flat.
+#define OBJECT_ID_LOCATION 4
+
+// The unpremultiplied linear-space color of each object, indexed by object
+// index. OIT_DEFERRED_SHADING uses this to shade fragments from their payload.
+layout(binding = IMG_MATERIALS, std430) restrict readonly buffer materialBuffer
+{
+  vec4 materials[];
+};
+
+// The world-space center (xyz) and radius (w) of each object's bounding
+// sphere. Sphere impostors are drawn from these.
+layout(binding = IMG_OBJECT_BOUNDS, std430) restrict readonly buffer objectBoundsBuffer
+{
+  vec4 objectBounds[];
+};
+
+// The depth that OIT passes store for a fragment. With OIT_SPHERE_IMPOSTORS,
+// fragments belong to a camera-facing quad in front of their sphere (see
+// sphereImpostor.vert.glsl), so this is instead the depth of the ray-cast
+// surface, set by raycastImpostor in sphereImpostor.glsl.
+#if OIT_SPHERE_IMPOSTORS
+float impostorDepth = 1.0;
+#define FRAGMENT_DEPTH impostorDepth
+#else  // #if OIT_SPHERE_IMPOSTORS
+#define FRAGMENT_DEPTH gl_FragCoord.z
+#endif  // #if OIT_SPHERE_IMPOSTORS
+
 // Gooch shading!
 // Interpolates between white and a cooler color based on the angle
 // between the normal and the light.
@@ -43,16 +73,26 @@ vec3 goochLighting(vec3 normal)
   return mix(vec3(0, 0.25, 0.75), vec3(1, 1, 1), warmth);
 }
 
+// Returns the opacity of a surface with the given material alpha, in
+// [alphaMin, alphaMin+alphaWidth].
+float materialOpacity(float materialAlpha)
+{
+  return clamp(scene.alphaMin + materialAlpha * scene.alphaWidth, 0, 1);
+}
+
+// Applies Gooch shading to a surface with the given material color and
+// normal, and returns an unpremultiplied RGBA color.
+vec4 shadeMaterial(vec4 materialColor, vec3 normal)
+{
+  vec3 colorRGB = materialColor.rgb * goochLighting(normal);
+  return vec4(colorRGB, materialOpacity(materialColor.a));
+}
+
 // Applies Gooch shading to a surface with color and alpha and returns
 // an unpremultiplied RGBA color.
 vec4 shading(const Interpolants its)
 {
-  vec3 colorRGB = its.color.rgb * goochLighting(its.normal);
-
-  // Calculate transparency in [alphaMin, alphaMin+alphaWidth]
-  float alpha = clamp(scene.alphaMin + its.color.a * scene.alphaWidth, 0, 1);
-
-  return vec4(colorRGB, alpha);
+  return shadeMaterial(its.color, its.normal);
 }
 
 // Converts an unpremultiplied scalar from linear space to sRGB. Note that
@@ -103,6 +143,98 @@ vec4 unPremultSRGBToLinear(vec4 c)
   return c;
 }
 
+// Returns (sign(v.x), sign(v.y)), except that 0 maps to 1.
+vec2 signNotZero(vec2 v)
+{
+  return vec2((v.x >= 0.0) ? 1.0 : -1.0, (v.y >= 0.0) ? 1.0 : -1.0);
+}
+
+// Encodes a nonzero normal in the lower 16 bits of a uint, using an
+// octahedral mapping with 8 bits per component.
+uint encodeNormalOct16(vec3 n)
+{
+  n /= (abs(n.x) + abs(n.y) + abs(n.z));
+  const vec2 e = (n.z >= 0.0) ? n.xy : ((1.0 - abs(n.yx)) * signNotZero(n.xy));
+  return packSnorm4x8(vec4(e, 0.0, 0.0)) & 0xFFFFu;
+}
+
+// Decodes a normal encoded with encodeNormalOct16 (ignoring the upper 16 bits).
+vec3 decodeNormalOct16(uint bits)
+{
+  const vec2 e = unpackSnorm4x8(bits).xy;
+  vec3       n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if(n.z < 0.0)
+  {
+    n.xy = (1.0 - abs(e.yx)) * signNotZero(e);
+  }
+  return normalize(n);
+}
+
+// Packs an unpremultiplied linear-space RGBA color into 32 bits using
+// OIT_COLOR_ENCODING.
+uint packColor(vec4 color)
+{
+  if(OIT_COLOR_ENCODING == COLOR_ENCODING_GAMMA2)
+  {
+    return packUnorm4x8(vec4(sqrt(color.rgb), color.a));
+  }
+  else if(OIT_COLOR_ENCODING == COLOR_ENCODING_RGB10A2)
+  {
+    const uvec4 c = uvec4(round(clamp(color, 0.0, 1.0) * vec4(1023.0, 1023.0, 1023.0, 3.0)));
+    return c.r | (c.g << 10) | (c.b << 20) | (c.a << 30);
+  }
+  // Both sRGB encodings store the same bits.
+  return packUnorm4x8(unPremultLinearToSRGB(color));
+}
+
+// Unpacks a color packed with packColor.
+vec4 unpackColor(uint packedColor)
+{
+  if(OIT_COLOR_ENCODING == COLOR_ENCODING_SRGB_LUT)
+  {
+    return vec4(SRGB_TO_LINEAR_LUT[packedColor & 0xFFu],          //
+                SRGB_TO_LINEAR_LUT[(packedColor >> 8) & 0xFFu],   //
+                SRGB_TO_LINEAR_LUT[(packedColor >> 16) & 0xFFu],  //
+                float(packedColor >> 24) / 255.0);
+  }
+  else if(OIT_COLOR_ENCODING == COLOR_ENCODING_GAMMA2)
+  {
+    const vec4 c = unpackUnorm4x8(packedColor);
+    return vec4(c.rgb * c.rgb, c.a);
+  }
+  else if(OIT_COLOR_ENCODING == COLOR_ENCODING_RGB10A2)
+  {
+    const uvec4 c = uvec4(packedColor, packedColor >> 10, packedColor >> 20, packedColor >> 30) & uvec4(1023u, 1023u, 1023u, 3u);
+    return vec4(c) / vec4(1023.0, 1023.0, 1023.0, 3.0);
+  }
+  return unPremultSRGBToLinear(unpackUnorm4x8(packedColor));
+}
+
+// Returns the 32-bit color that color passes store in the A-buffer for a
+// fragment of the given object. Usually, this is its shaded color, encoded
+// with packColor. With OIT_DEFERRED_SHADING, it's instead a payload with the
+// object index in the upper 16 bits and the encoded normal in the lower 16
+// bits, and shading is left to unpackFragmentColor.
+uint packFragmentColor(const Interpolants its, uint objectID)
+{
+  if(OIT_DEFERRED_SHADING)
+  {
+    return (objectID << 16) | encodeNormalOct16(its.normal);
+  }
+  return packColor(shading(its));
+}
+
+// Returns the unpremultiplied linear-space RGBA color of a value returned by
+// packFragmentColor.
+vec4 unpackFragmentColor(uint packedColor)
+{
+  if(OIT_DEFERRED_SHADING)
+  {
+    return shadeMaterial(materials[packedColor >> 16], decodeNormalOct16(packedColor));
+  }
+  return unpackColor(packedColor);
+}
+
 // Sets color to the result of blending color over baseColor.
 // Color and baseColor are both premultiplied colors.
 void doBlend(inout vec4 color, vec4 baseColor)
@@ -112,13 +244,76 @@ void doBlend(inout vec4 color, vec4 baseColor)
 }
 
 // Sets color to the result of blending color over fragment.
-// Color and fragment are both premultiplied colors; fragment
-// is an rgba8 sRGB unpremultiplied color packed in a 32-bit uint.
+// Color is a premultiplied color; fragment is a color returned by
+// packFragmentColor.
 void doBlendPacked(inout vec4 color, uint fragment)
 {
-  vec4 unpackedColor = unpackUnorm4x8(fragment);
-  // Convert from unpremultiplied sRGB to premultiplied alpha
-  unpackedColor = unPremultSRGBToLinear(unpackedColor);
+  vec4 unpackedColor = unpackFragmentColor(fragment);
+  // Convert to premultiplied alpha
   unpackedColor.rgb *= unpackedColor.a;
   doBlend(color, unpackedColor);
-}
\ No newline at end of file
+}
+
+// Returns whether color, a premultiplied color blended front-to-back, is
+// opaque enough that fragments behind it can be skipped. Always false if
+// OIT_OPACITY_EARLY_OUT is disabled.
+bool opacitySaturated(vec4 color)
+{
+  return OIT_OPACITY_EARLY_OUT && (color.a >= scene.opacityThreshold);
+}
+
+// Returns the value of an auxiliary value written with epochStore. If
+// OIT_EPOCH_TAGS is true, values written in other epochs read as 0.
+uint epochLoad(uint stored)
+{
+  if(OIT_EPOCH_TAGS)
+  {
+    return ((stored >> EPOCH_SHIFT) == pushConstants.epoch) ? (stored & EPOCH_VALUE_MASK) : 0u;
+  }
+  return stored;
+}
+
+// Returns the value to store for an auxiliary value. If OIT_EPOCH_TAGS is
+// true, value must fit in EPOCH_VALUE_MASK, and is tagged with the current epoch.
+uint epochStore(uint value)
+{
+  if(OIT_EPOCH_TAGS)
+  {
+    return (pushConstants.epoch << EPOCH_SHIFT) | (value & EPOCH_VALUE_MASK);
+  }
+  return value;
+}
+
+// Converts floatBitsToUint(depth) for a depth in [0, 1] to a 24-bit unsigned
+// normalized value, so that it fits in an epoch-tagged value. roundUp chooses
+// which way to round, so that comparisons can be made conservative.
+uint depthBitsToUnorm24(uint depthBits, bool roundUp)
+{
+  const float scaled = clamp(uintBitsToFloat(depthBits), 0.0f, 1.0f) * float(EPOCH_VALUE_MASK);
+  return uint(roundUp ? ceil(scaled) : floor(scaled));
+}
+
+// OIT_SPINLOCK and OIT_INTERLOCK store the depth of the furthest fragment in
+// the A-buffer in imgDepth, which is cleared to 0xFFFFFFFF. Returns the value
+// to store there for depthBits (from floatBitsToUint).
+uint furthestDepthStore(uint depthBits)
+{
+  if(OIT_EPOCH_TAGS)
+  {
+    return epochStore(depthBitsToUnorm24(depthBits, true));
+  }
+  return depthBits;
+}
+
+// Returns whether a fragment with the given depth bits might be in front of
+// the furthest fragment, given the stored value of imgDepth. Values from other
+// epochs act like the cleared value, so every fragment passes.
+bool furthestDepthTest(uint depthBits, uint stored)
+{
+  if(OIT_EPOCH_TAGS)
+  {
+    return ((stored >> EPOCH_SHIFT) != pushConstants.epoch)
+           || (depthBitsToUnorm24(depthBits, false) <= (stored & EPOCH_VALUE_MASK));
+  }
+  return depthBits <= stored;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Included by fragment shaders after shaderCommon.glsl when
+// OIT_SPHERE_IMPOSTORS is 1, to replace the interpolants of the quads drawn
+// by sphereImpostor.vert.glsl with those of the sphere's surface.
+//
+// Since the quads are in front of their sphere, the depth test against the
+// opaque objects only rejects fragments that are certainly hidden. OIT
+// passes can't write gl_FragDepth (they force early fragment tests), so
+// raycastImpostor tests the surface's depth against IMG_OPAQUE_DEPTH itself.
+
+// A copy of the current band of the opaque depth buffer; see
+// opaqueDepthCopy.comp.glsl.
+layout(binding = IMG_OPAQUE_DEPTH, std430) restrict readonly buffer opaqueDepthBuffer
+{
+  float opaqueDepth[];
+};
+
+// Intersects the view ray through the rasterized impostor position with the
+// sphere of object objectID. If the ray hits the sphere (and, if
+// testOpaqueDepth is true, the hit is in front of the opaque objects), sets
+// its to the interpolants of the surface, sets impostorDepth, and returns
+// true; otherwise, the fragment should be discarded.
+bool raycastImpostor(const Interpolants rasterized, uint objectID, bool testOpaqueDepth, out Interpolants its)
+{
+  its = rasterized;
+
+  // The view matrix is a rotation followed by a translation, so the camera's
+  // world-space position is -R^T * t.
+  const vec4  sphere   = objectBounds[objectID];
+  const vec3  camera   = -(transpose(mat3(scene.viewMatrix)) * scene.viewMatrix[3].xyz);
+  const vec3  ray      = normalize(rasterized.pos - camera);
+  const vec3  toCenter = sphere.xyz - camera;
+  const float b        = dot(toCenter, ray);
+  const float disc     = b * b - dot(toCenter, toCenter) + sphere.w * sphere.w;
+  if(disc < 0.0)
+  {
+    return false;
+  }
+
+  const float t    = b + (gl_FrontFacing ? -sqrt(disc) : sqrt(disc));
+  const vec3  hit  = camera + t * ray;
+  const vec4  clip = scene.projViewMatrix * vec4(hit, 1.0);
+  impostorDepth    = clip.z / clip.w;
+
+  if(testOpaqueDepth)
+  {
+    // Like coord in oitColorDepthDefines.glsl, relative to the top of the band.
+    const ivec2 pixel = ivec2(gl_FragCoord.x, int(gl_FragCoord.y) - pushConstants.bandOffsetY);
+    int         index = pixel.y * scene.viewport.x + pixel.x;
+#if OIT_SAMPLE_SHADING
+    index += gl_SampleID * scene.viewport.z;
+#endif
+    // Without sample shading, this is the farthest depth of the pixel's
+    // samples; see opaqueDepthCopy.comp.glsl.
+    if(impostorDepth >= opaqueDepth[index])
+    {
+      return false;
+    }
+  }
+
+  its.pos    = hit;
+  its.normal = (hit - sphere.xyz) / sphere.w;
+  its.depth  = (scene.viewMatrix * vec4(hit, 1.0)).z;
+  return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Replaces object.vert.glsl when OIT_SPHERE_IMPOSTORS is 1. Each object is
+// then 8 vertices that all have the object's center as their position; their
+// normals are (x, y, side), where (x, y) is the corner of a quad in [-1, 1]^2
+// and side is 1 for the front quad and -1 for the back quad. Both quads face
+// the camera and lie on the plane that touches the sphere's near side, where
+// a square of the sphere's radius covers its silhouette. The back quad has
+// its x coordinates mirrored, so that it's back-facing and fragment shaders
+// can find the sphere's back surface with gl_FrontFacing, as they would for a
+// double-sided mesh; see raycastImpostor. This makes vertex work independent
+// of sphere detail, so scenes with millions of objects stay cheap.
+
+#include "shaderCommon.glsl"
+
+layout(location = VERTEX_POS) in vec3 inPosition;
+layout(location = VERTEX_NORMAL) in vec3 inNormal;
+layout(location = VERTEX_COLOR) in vec4 inColor;
+
+layout(location = 0) out Interpolants OUT;
+layout(location = OBJECT_ID_LOCATION) flat out uint outObjectID;
+
+void main()
+{
+  // All objects have the same number of vertices, and are stored in order.
+  outObjectID = uint(gl_VertexIndex) / scene.verticesPerObject;
+
+  const float radius   = objectBounds[outObjectID].w;
+  const vec3  camera   = -(transpose(mat3(scene.viewMatrix)) * scene.viewMatrix[3].xyz);
+  const vec3  toCamera = camera - inPosition;
+  const float distance = length(toCamera);
+
+  // Spheres that contain the camera get a degenerate quad.
+  vec3       pos     = inPosition;
+  const vec3 forward = toCamera / max(distance, 1e-6);
+  if(distance > radius)
+  {
+    const vec3 up0   = (abs(forward.y) < 0.99) ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    const vec3 right = normalize(cross(up0, forward));
+    const vec3 up    = cross(forward, right);
+    pos += radius * (forward + right * (inNormal.x * inNormal.z) + up * inNormal.y);
+  }
+
+  gl_Position = scene.projViewMatrix * vec4(pos, 1.0);
+  OUT.depth   = (scene.viewMatrix * vec4(pos, 1.0)).z;
+  OUT.pos     = pos;
+  OUT.normal  = forward;  // Replaced by raycastImpostor
+  OUT.color   = inColor;
+}
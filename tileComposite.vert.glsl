@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+
+// Draws a quad over each tile in the tile list built by
+// oitTileClassify.comp.glsl, with one instance per tile. Composite passes use
+// this instead of fullScreenTriangle.vert.glsl with State::tiledComposite.
+
+#include "common.h"
+
+layout(binding = IMG_TILE_LIST, std430) restrict readonly buffer tileListBuffer
+{
+  uint vertexCount;
+  uint instanceCount;
+  uint firstVertex;
+  uint firstInstance;
+  uint tileList[];
+};
+
+// The corners of the two triangles of a quad, in units of tiles.
+const ivec2 quadCorners[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+
+void main()
+{
+  const uint  tile      = tileList[gl_InstanceIndex];
+  const ivec2 tileCoord = ivec2(tile % uint(scene.tiles.x), tile / uint(scene.tiles.x));
+
+  // Tiles are relative to the top of the band, while the viewport covers all
+  // of m_colorImage. Tiles at the right and bottom edges can extend past the
+  // band; the scissor rectangle clips them.
+  const ivec2 pixel = (tileCoord + quadCorners[gl_VertexIndex]) * TILE_SIZE + ivec2(0, pushConstants.bandOffsetY);
+  gl_Position       = vec4((vec2(pixel) / vec2(scene.colorSize)) * 2.0 - 1.0, 0, 1.0);
+}
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Implements TraceRecorder; see trace_vk.h.
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif  // #ifndef NOMINMAX
+#include <Windows.h>
+#endif
+
+#include "trace_vk.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include <nvvk/error_vk.hpp>
+#include <nvvk/structs_vk.hpp>
+
+// On Windows, steady_clock and the QueryPerformanceCounter time domain use the
+// same clock; on other platforms, steady_clock uses CLOCK_MONOTONIC.
+#ifdef _WIN32
+static const VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+static const VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+// Converts a timestamp from HOST_TIME_DOMAIN to nanoseconds.
+static int64_t hostTimestampToNs(uint64_t timestamp)
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return int64_t(double(timestamp) * (1e9 / double(frequency.QuadPart)));
+#else
+  return int64_t(timestamp);
+#endif
+}
+
+TraceRecorder::CpuZone::CpuZone(TraceRecorder& trace, const char* name)
+    : m_trace(trace)
+    , m_name(name)
+    , m_beginNs(0)
+    , m_active(trace.isRecording())
+{
+  if(m_active)
+  {
+    m_beginNs = nowNs();
+  }
+}
+
+TraceRecorder::CpuZone::~CpuZone()
+{
+  if(m_active)
+  {
+    m_trace.addCpuZone(m_name, m_beginNs, nowNs());
+  }
+}
+
+TraceRecorder::ProfilerSection::ProfilerSection(nvvk::ProfilerVK& profiler, TraceRecorder& trace, const char* name, VkCommandBuffer cmdBuffer)
+    : m_section(profiler, name, cmdBuffer)
+    , m_trace(trace)
+    , m_cmdBuffer(cmdBuffer)
+    , m_zone(trace.cmdBeginGpuZone(cmdBuffer, name))
+{
+}
+
+TraceRecorder::ProfilerSection::~ProfilerSection()
+{
+  m_trace.cmdEndGpuZone(m_cmdBuffer, m_zone);
+}
+
+void TraceRecorder::init(nvvk::Context& context, uint32_t ringSize, bool hasCalibratedTimestamps)
+{
+  m_device    = context.m_device;
+  m_queue     = context.m_queueGCT.queue;
+  m_nsPerTick = double(context.m_physicalInfo.properties10.limits.timestampPeriod);
+
+  const uint32_t validBits = context.m_physicalInfo.queueProperties[context.m_queueGCT.familyIndex].timestampValidBits;
+  m_timestampMask          = (validBits >= 64) ? ~0ull : ((1ull << validBits) - 1);
+
+  m_cycles.resize(ringSize);
+
+  // Two queries per zone, plus one at the end for calibrating without
+  // VK_EXT_calibrated_timestamps.
+  VkQueryPoolCreateInfo queryPoolInfo = nvvk::make<VkQueryPoolCreateInfo>();
+  queryPoolInfo.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+  queryPoolInfo.queryCount            = ringSize * 2 * MAX_GPU_ZONES + 1;
+  NVVK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_queryPool));
+
+  VkCommandPoolCreateInfo commandPoolInfo = nvvk::make<VkCommandPoolCreateInfo>();
+  commandPoolInfo.flags                   = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  commandPoolInfo.queueFamilyIndex        = context.m_queueGCT.familyIndex;
+  NVVK_CHECK(vkCreateCommandPool(m_device, &commandPoolInfo, nullptr, &m_commandPool));
+
+  // We can only use calibrated timestamps if the device can calibrate both its
+  // own clock and the clock that nowNs uses.
+  m_hostTimeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+  if(hasCalibratedTimestamps)
+  {
+    uint32_t numTimeDomains = 0;
+    NVVK_CHECK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(context.m_physicalDevice, &numTimeDomains, nullptr));
+    std::vector<VkTimeDomainEXT> timeDomains(numTimeDomains);
+    NVVK_CHECK(vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(context.m_physicalDevice, &numTimeDomains, timeDomains.data()));
+
+    bool hasDevice = false;
+    bool hasHost   = false;
+    for(VkTimeDomainEXT timeDomain : timeDomains)
+    {
+      hasDevice = hasDevice || (timeDomain == VK_TIME_DOMAIN_DEVICE_EXT);
+      hasHost   = hasHost || (timeDomain == HOST_TIME_DOMAIN);
+    }
+    if(hasDevice && hasHost)
+    {
+      m_hostTimeDomain = HOST_TIME_DOMAIN;
+    }
+  }
+}
+
+void TraceRecorder::deinit()
+{
+  vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+  vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+  m_queryPool   = VK_NULL_HANDLE;
+  m_commandPool = VK_NULL_HANDLE;
+  m_recording   = false;
+  m_cycles.clear();
+  m_events.clear();
+}
+
+void TraceRecorder::start()
+{
+  m_events.clear();
+  for(Cycle& cycle : m_cycles)
+  {
+    cycle.zoneNames.clear();
+  }
+  m_currentCycle = ~0u;
+  m_startNs      = nowNs();
+  calibrate();
+  m_recording = true;
+}
+
+bool TraceRecorder::stop(const std::string& filename)
+{
+  if(!m_recording)
+  {
+    return false;
+  }
+
+  NVVK_CHECK(vkDeviceWaitIdle(m_device));
+  for(uint32_t cycle = 0; cycle < uint32_t(m_cycles.size()); cycle++)
+  {
+    collectCycle(cycle);
+  }
+  m_recording    = false;
+  m_currentCycle = ~0u;
+
+  FILE* file = fopen(filename.c_str(), "w");
+  if(file == nullptr)
+  {
+    m_events.clear();
+    return false;
+  }
+
+  // Times in the Chrome trace event format are in microseconds. Zone names are
+  // string literals, so they don't need to be escaped.
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"GPU\"}}");
+  for(const Event& event : m_events)
+  {
+    fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+            event.name, event.gpu ? "gpu" : "cpu", event.gpu ? 1 : 0, double(event.beginNs - m_startNs) / 1000.0,
+            double(event.endNs - event.beginNs) / 1000.0, event.frame);
+  }
+  fprintf(file, "\n]}\n");
+  const bool succeeded = (ferror(file) == 0);
+  fclose(file);
+
+  m_events.clear();
+  return succeeded;
+}
+
+void TraceRecorder::collectCycle(uint32_t cycle)
+{
+  Cycle& zones = m_cycles[cycle];
+  if(m_recording && !zones.zoneNames.empty())
+  {
+    // The device and host clocks drift apart over time, so recalibrate for
+    // each cycle if that's cheap.
+    if(m_hostTimeDomain != VK_TIME_DOMAIN_DEVICE_EXT)
+    {
+      calibrate();
+    }
+
+    const uint32_t        numQueries = 2 * uint32_t(zones.zoneNames.size());
+    std::vector<uint64_t> timestamps(numQueries);
+    const VkResult result = vkGetQueryPoolResults(m_device, m_queryPool, cycle * 2 * MAX_GPU_ZONES, numQueries,
+                                                  timestamps.size() * sizeof(uint64_t), timestamps.data(),
+                                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if(result == VK_SUCCESS)
+    {
+      for(size_t zone = 0; zone < zones.zoneNames.size(); zone++)
+      {
+        Event event;
+        event.name    = zones.zoneNames[zone];
+        event.beginNs = deviceTicksToNs(timestamps[2 * zone + 0]);
+        event.endNs   = deviceTicksToNs(timestamps[2 * zone + 1]);
+        event.frame   = zones.frame;
+        event.gpu     = true;
+        m_events.push_back(event);
+      }
+    }
+  }
+  zones.zoneNames.clear();
+}
+
+void TraceRecorder::cmdBeginCycle(VkCommandBuffer cmdBuffer, uint32_t cycle)
+{
+  m_currentCycle = ~0u;
+  if(!m_recording)
+  {
+    return;
+  }
+
+  vkCmdResetQueryPool(cmdBuffer, m_queryPool, cycle * 2 * MAX_GPU_ZONES, 2 * MAX_GPU_ZONES);
+  m_cycles[cycle].zoneNames.clear();
+  m_cycles[cycle].frame = m_currentFrame;
+  m_currentCycle        = cycle;
+}
+
+uint32_t TraceRecorder::cmdBeginGpuZone(VkCommandBuffer cmdBuffer, const char* name)
+{
+  if(!m_recording || m_currentCycle == ~0u)
+  {
+    return ~0u;
+  }
+
+  std::vector<const char*>& zoneNames = m_cycles[m_currentCycle].zoneNames;
+  if(zoneNames.size() >= MAX_GPU_ZONES)
+  {
+    return ~0u;
+  }
+
+  const uint32_t zone = uint32_t(zoneNames.size());
+  zoneNames.push_back(name);
+  vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, (m_currentCycle * MAX_GPU_ZONES + zone) * 2 + 0);
+  return zone;
+}
+
+void TraceRecorder::cmdEndGpuZone(VkCommandBuffer cmdBuffer, uint32_t zone)
+{
+  if(zone == ~0u || m_currentCycle == ~0u)
+  {
+    return;
+  }
+
+  vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, (m_currentCycle * MAX_GPU_ZONES + zone) * 2 + 1);
+}
+
+void TraceRecorder::addCpuZone(const char* name, int64_t beginNs, int64_t endNs)
+{
+  if(!m_recording)
+  {
+    return;
+  }
+
+  Event event;
+  event.name    = name;
+  event.beginNs = beginNs;
+  event.endNs   = endNs;
+  event.frame   = m_currentFrame;
+  event.gpu     = false;
+  m_events.push_back(event);
+}
+
+int64_t TraceRecorder::nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceRecorder::calibrate()
+{
+  if(m_hostTimeDomain != VK_TIME_DOMAIN_DEVICE_EXT)
+  {
+    VkCalibratedTimestampInfoEXT timestampInfos[2];
+    timestampInfos[0]            = nvvk::make<VkCalibratedTimestampInfoEXT>();
+    timestampInfos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    timestampInfos[1]            = nvvk::make<VkCalibratedTimestampInfoEXT>();
+    timestampInfos[1].timeDomain = m_hostTimeDomain;
+
+    uint64_t timestamps[2];
+    uint64_t maxDeviation = 0;
+    if(vkGetCalibratedTimestampsEXT(m_device, 2, timestampInfos, timestamps, &maxDeviation) == VK_SUCCESS)
+    {
+      m_calibrationTicks = timestamps[0] & m_timestampMask;
+      m_calibrationNs    = hostTimestampToNs(timestamps[1]);
+      return;
+    }
+  }
+
+  // Otherwise, write a timestamp on the GPU and wait for it. The timestamp was
+  // written somewhere between submitting and the queue going idle, so we
+  // use the midpoint; this is accurate to within half the round trip.
+  const uint32_t calibrationQuery = uint32_t(m_cycles.size()) * 2 * MAX_GPU_ZONES;
+
+  VkCommandBufferAllocateInfo allocInfo = nvvk::make<VkCommandBufferAllocateInfo>();
+  allocInfo.commandPool                 = m_commandPool;
+  allocInfo.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount          = 1;
+  VkCommandBuffer cmdBuffer             = VK_NULL_HANDLE;
+  NVVK_CHECK(vkAllocateCommandBuffers(m_device, &allocInfo, &cmdBuffer));
+
+  VkCommandBufferBeginInfo beginInfo = nvvk::make<VkCommandBufferBeginInfo>();
+  beginInfo.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  NVVK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+  vkCmdResetQueryPool(cmdBuffer, m_queryPool, calibrationQuery, 1);
+  vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, calibrationQuery);
+  NVVK_CHECK(vkEndCommandBuffer(cmdBuffer));
+
+  NVVK_CHECK(vkQueueWaitIdle(m_queue));
+  VkSubmitInfo submitInfo       = nvvk::make<VkSubmitInfo>();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers    = &cmdBuffer;
+  const int64_t beforeNs        = nowNs();
+  NVVK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+  NVVK_CHECK(vkQueueWaitIdle(m_queue));
+  const int64_t afterNs = nowNs();
+
+  uint64_t ticks = 0;
+  NVVK_CHECK(vkGetQueryPoolResults(m_device, m_queryPool, calibrationQuery, 1, sizeof(ticks), &ticks, sizeof(ticks),
+                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+  vkFreeCommandBuffers(m_device, m_commandPool, 1, &cmdBuffer);
+
+  m_calibrationTicks = ticks & m_timestampMask;
+  m_calibrationNs    = beforeNs + (afterNs - beforeNs) / 2;
+}
+
+int64_t TraceRecorder::deviceTicksToNs(uint64_t ticks) const
+{
+  // Timestamps only have timestampValidBits bits, so compute the signed
+  // difference modulo the mask; zones usually happen before the calibration.
+  ticks &= m_timestampMask;
+  const uint64_t forward = (ticks - m_calibrationTicks) & m_timestampMask;
+  int64_t        delta   = int64_t(forward);
+  if(forward > (m_timestampMask >> 1))
+  {
+    delta = -int64_t((m_calibrationTicks - ticks) & m_timestampMask);
+  }
+  return m_calibrationNs + int64_t(double(delta) * m_nsPerTick);
+}
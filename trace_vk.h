@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020-2021, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2020-2021 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+// Contains TraceRecorder, which records CPU and GPU timing zones over a number
+// of frames and writes them in the Chrome trace event format. The resulting
+// JSON file can be opened in chrome://tracing or https://ui.perfetto.dev.
+//
+// CPU zones are timed using std::chrono::steady_clock. GPU zones are timed
+// using timestamp queries, and are converted to the CPU's clock using
+// VK_EXT_calibrated_timestamps if the device supports it. Otherwise, the
+// clocks are calibrated once when recording starts by submitting a timestamp
+// and waiting for it. This way, CPU/GPU overlap and stalls line up in the trace.
+//
+// Like utilities_vk.h, this doesn't depend on the sample.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <nvvk/context_vk.hpp>
+#include <nvvk/profiler_vk.hpp>
+#include <vulkan/vulkan_core.h>
+
+class TraceRecorder
+{
+public:
+  // The maximum number of GPU zones per ring cycle; additional zones aren't recorded.
+  static const uint32_t MAX_GPU_ZONES = 64;
+
+  // Times a CPU zone from construction to destruction, if the recorder is
+  // recording. name must outlive the zone.
+  class CpuZone
+  {
+  public:
+    CpuZone(TraceRecorder& trace, const char* name);
+    ~CpuZone();
+
+  private:
+    TraceRecorder& m_trace;
+    const char*    m_name;
+    int64_t        m_beginNs;
+    bool           m_active;
+  };
+
+  // Times a section of a command buffer with both an nvvk::ProfilerVK (as
+  // nvvk::ProfilerVK::Section does) and, if recording, a TraceRecorder.
+  // name must be a string literal.
+  class ProfilerSection
+  {
+  public:
+    ProfilerSection(nvvk::ProfilerVK& profiler, TraceRecorder& trace, const char* name, VkCommandBuffer cmdBuffer);
+    ~ProfilerSection();
+
+  private:
+    nvvk::ProfilerVK::Section m_section;
+    TraceRecorder&            m_trace;
+    VkCommandBuffer           m_cmdBuffer;
+    uint32_t                  m_zone;
+  };
+
+  // Creates the timestamp query pool, with space for ringSize cycles of
+  // MAX_GPU_ZONES zones. If hasCalibratedTimestamps is true,
+  // VK_EXT_calibrated_timestamps must have been enabled.
+  void init(nvvk::Context& context, uint32_t ringSize, bool hasCalibratedTimestamps);
+
+  // Device must not be using resources when called.
+  void deinit();
+
+  // Discards any previously recorded events and starts recording.
+  void start();
+
+  // Waits for the device to go idle, collects all remaining GPU zones, stops
+  // recording, and writes the trace to filename. Returns false if the file
+  // couldn't be written.
+  bool stop(const std::string& filename);
+
+  bool isRecording() const { return m_recording; }
+
+  // Reads the GPU zones of the given ring cycle into the trace. Call once the
+  // cycle's fence has been waited on, and before calling cmdBeginCycle for it.
+  void collectCycle(uint32_t cycle);
+
+  // Sets the frame number that subsequent zones belong to.
+  void beginFrame(uint32_t frame) { m_currentFrame = frame; }
+
+  // Resets the queries of the given ring cycle and makes it the cycle that
+  // GPU zones are recorded to. Must be called outside of a render pass, in the
+  // first command buffer submitted for the frame.
+  void cmdBeginCycle(VkCommandBuffer cmdBuffer, uint32_t cycle);
+
+  // Begins a GPU zone. Returns an index to pass to cmdEndGpuZone, or ~0u if the
+  // zone isn't being recorded. name must be a string literal.
+  uint32_t cmdBeginGpuZone(VkCommandBuffer cmdBuffer, const char* name);
+
+  // Ends a GPU zone started by cmdBeginGpuZone.
+  void cmdEndGpuZone(VkCommandBuffer cmdBuffer, uint32_t zone);
+
+  // Adds a CPU zone with the given begin and end times (from nowNs) for the
+  // current frame.
+  void addCpuZone(const char* name, int64_t beginNs, int64_t endNs);
+
+  // Returns the current time of the CPU's clock in nanoseconds.
+  static int64_t nowNs();
+
+private:
+  // A single zone in the trace.
+  struct Event
+  {
+    const char* name    = nullptr;
+    int64_t     beginNs = 0;  // On the CPU's clock
+    int64_t     endNs   = 0;
+    uint32_t    frame   = 0;
+    bool        gpu     = false;
+  };
+
+  // The GPU zones recorded for a ring cycle, waiting to be read back.
+  struct Cycle
+  {
+    std::vector<const char*> zoneNames;
+    uint32_t                 frame = 0;
+  };
+
+  // Computes a corresponding pair of device and host timestamps, so that
+  // device timestamps can be converted to nowNs's clock.
+  void calibrate();
+
+  // Converts a device timestamp to nowNs's clock using the last calibration.
+  int64_t deviceTicksToNs(uint64_t ticks) const;
+
+  VkDevice           m_device         = VK_NULL_HANDLE;
+  VkQueue            m_queue          = VK_NULL_HANDLE;
+  VkQueryPool        m_queryPool      = VK_NULL_HANDLE;
+  VkCommandPool      m_commandPool    = VK_NULL_HANDLE;             // For calibrating without VK_EXT_calibrated_timestamps
+  VkTimeDomainEXT    m_hostTimeDomain = VK_TIME_DOMAIN_DEVICE_EXT;  // VK_TIME_DOMAIN_DEVICE_EXT if calibration isn't supported
+  double             m_nsPerTick      = 1.0;
+  uint64_t           m_timestampMask  = ~0ull;
+  std::vector<Cycle> m_cycles;
+  uint32_t           m_currentCycle = ~0u;  // The cycle GPU zones are recorded to, or ~0u if none
+  uint32_t           m_currentFrame = 0;
+
+  bool               m_recording        = false;
+  int64_t            m_startNs          = 0;
+  uint64_t           m_calibrationTicks = 0;
+  int64_t            m_calibrationNs    = 0;
+  std::vector<Event> m_events;
+};
@@ -56,6 +56,13 @@ struct Vertex
     color = nvmath::vec4(1.0f);
   }
 
+  Vertex(const nvmath::vec3& pos_, const nvmath::vec3& normal_, const nvmath::vec4& color_)
+      : pos(pos_)
+      , normal(normal_)
+      , color(color_)
+  {
+  }
+
   static VkVertexInputBindingDescription getBindingDescription()
   {
     VkVertexInputBindingDescription bindingDescription = {};
@@ -261,7 +268,7 @@ public:
 
     // Maps to barrier.subresourceRange.aspectMask
     VkImageAspectFlags aspectMask = 0;
-    if(dstLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+    if((dstLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) || (dstLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL))
     {
       aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
       if(c_format == VK_FORMAT_D32_SFLOAT_S8_UINT || c_format == VK_FORMAT_D24_UNORM_S8_UINT)
@@ -333,4 +340,65 @@ inline void cmdFragmentBarrierSimple(VkCommandBuffer cmdBuffer)
                        1, &barrier,                                  //
                        0, VK_NULL_HANDLE,                            //
                        0, VK_NULL_HANDLE);
-}
\ No newline at end of file
+}
+
+// Adds a simple command that ensures that all fragment shader and attachment reads and writes have
+// finished before all subsequent transfers, fragment shader reads and writes, and attachment accesses.
+// This is used between render passes that reuse the same buffers, such as when rendering in bands.
+// Unlike the barriers above, this must be called outside of a render pass.
+inline void cmdFragmentToTransferBarrierSimple(VkCommandBuffer cmdBuffer)
+{
+  const VkPipelineStageFlags srcStageFlags = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+                                             | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  const VkPipelineStageFlags dstStageFlags = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+                                             | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+  VkMemoryBarrier barrier = nvvk::make<VkMemoryBarrier>();
+  barrier.srcAccessMask   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                          | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+                          | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                          | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  vkCmdPipelineBarrier(cmdBuffer, srcStageFlags, dstStageFlags, 0,  //
+                       1, &barrier,                                 //
+                       0, VK_NULL_HANDLE,                           //
+                       0, VK_NULL_HANDLE);
+}
+
+// Returns the total budget and current usage in bytes of all device-local
+// memory heaps. If VK_EXT_memory_budget is not enabled (hasMemoryBudgetExtension
+// is false), the budget is the size of the heaps and the usage is 0.
+inline void getDeviceLocalMemoryBudget(VkPhysicalDevice physicalDevice,
+                                       bool             hasMemoryBudgetExtension,
+                                       VkDeviceSize&    budget,
+                                       VkDeviceSize&    usage)
+{
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = nvvk::make<VkPhysicalDeviceMemoryBudgetPropertiesEXT>();
+  VkPhysicalDeviceMemoryProperties2         memoryProperties = nvvk::make<VkPhysicalDeviceMemoryProperties2>();
+  if(hasMemoryBudgetExtension)
+  {
+    memoryProperties.pNext = &budgetProperties;
+  }
+  vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+  budget = 0;
+  usage  = 0;
+  for(uint32_t heap = 0; heap < memoryProperties.memoryProperties.memoryHeapCount; heap++)
+  {
+    if((memoryProperties.memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) == 0)
+    {
+      continue;
+    }
+
+    if(hasMemoryBudgetExtension)
+    {
+      budget += budgetProperties.heapBudget[heap];
+      usage += budgetProperties.heapUsage[heap];
+    }
+    else
+    {
+      budget += memoryProperties.memoryProperties.memoryHeaps[heap].size;
+    }
+  }
+}